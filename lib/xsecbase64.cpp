@@ -0,0 +1,560 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define XSEC_BASE64_X86
+#include <immintrin.h>
+#endif
+
+#include "xseccore.hpp"
+#include "xsecbase64.hpp"
+#include "xsecmetrics.hpp"
+
+namespace XSec {
+
+#include <xmlsec/xmlsec.h>
+#include <xmlsec/transforms.h>
+#include <xmlsec/buffer.h>
+#include <xmlsec/base64.h>
+#include <xmlsec/errors.h>
+
+
+#define B64_INVALID    -1
+#define B64_WHITESPACE -2
+#define B64_PAD        -3
+
+static const char enc_table[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static const struct dec_table_t {
+	signed char   v[256];   // value of a char or one of B64_*
+	unsigned char lut[128]; // value of an ascii char or 0x80 if invalid, for vpermi2b
+	unsigned char pack[64]; // collects 3 bytes out of every 32bit lane, for vpermb
+
+	dec_table_t() {
+		memset( v, B64_INVALID, sizeof(v) );
+		memset( lut, 0x80, sizeof(lut) );
+		for( int i = 0; i < 64; i++ ) {
+			v[(unsigned char) enc_table[i]] = i;
+			lut[(unsigned char) enc_table[i]] = i;
+		}
+		v[(unsigned char) ' ']  = B64_WHITESPACE;
+		v[(unsigned char) '\t'] = B64_WHITESPACE;
+		v[(unsigned char) '\n'] = B64_WHITESPACE;
+		v[(unsigned char) '\r'] = B64_WHITESPACE;
+		v[(unsigned char) '=']  = B64_PAD;
+
+		for( int i = 0; i < 64; i++ )
+			pack[i] = i < 48 ? (i / 3) * 4 + 2 - i % 3 : 0;
+	}
+} dec_table;
+
+typedef size_t (*encode_fn)(const unsigned char *in, size_t len, char *out);
+// decodes as many whole blocks without whitespace or padding as possible,
+// returns the bytes written and sets consumed to the chars read
+typedef size_t (*decode_fn)(const char *in, size_t len, unsigned char *out, size_t *consumed);
+
+
+static size_t encode_scalar(const unsigned char *in, size_t len, char *out) {
+	char *o = out;
+	size_t i = 0;
+
+	for( ; i + 3 <= len; i += 3 ) {
+		uint32_t v = (in[i] << 16) | (in[i+1] << 8) | in[i+2];
+		*o++ = enc_table[(v >> 18) & 0x3f];
+		*o++ = enc_table[(v >> 12) & 0x3f];
+		*o++ = enc_table[(v >>  6) & 0x3f];
+		*o++ = enc_table[ v        & 0x3f];
+	}
+
+	if( len - i == 1 ) {
+		*o++ = enc_table[in[i] >> 2];
+		*o++ = enc_table[(in[i] & 0x03) << 4];
+		*o++ = '=';
+		*o++ = '=';
+	}
+	else if( len - i == 2 ) {
+		*o++ = enc_table[in[i] >> 2];
+		*o++ = enc_table[((in[i] & 0x03) << 4) | (in[i+1] >> 4)];
+		*o++ = enc_table[(in[i+1] & 0x0f) << 2];
+		*o++ = '=';
+	}
+
+	return o - out;
+}
+
+static size_t decode_scalar(const char *in, size_t len, unsigned char *out, size_t *consumed) {
+	unsigned char *o = out;
+	size_t i = 0;
+
+	for( ; i + 4 <= len; i += 4 ) {
+		signed char a = dec_table.v[(unsigned char) in[i]],   b = dec_table.v[(unsigned char) in[i+1]];
+		signed char c = dec_table.v[(unsigned char) in[i+2]], d = dec_table.v[(unsigned char) in[i+3]];
+		if( (a | b | c | d) < 0 )
+			break;
+		*o++ = (a << 2) | (b >> 4);
+		*o++ = (b << 4) | (c >> 2);
+		*o++ = (c << 6) |  d;
+	}
+
+	*consumed = i;
+	return o - out;
+}
+
+#ifdef XSEC_BASE64_X86
+
+// 6bit indices to ascii, the offset to add is picked by pshufb from the range of the index
+__attribute__((target("ssse3")))
+static inline __m128i lookup_ssse3(__m128i indices) {
+	const __m128i offsets = _mm_setr_epi8( 'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+	                                       '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+	                                       '/' - 63, 'A', 0, 0 );
+	__m128i reduced = _mm_subs_epu8( indices, _mm_set1_epi8(51) );
+	__m128i less    = _mm_cmpgt_epi8( _mm_set1_epi8(26), indices );
+	reduced = _mm_or_si128( reduced, _mm_and_si128( less, _mm_set1_epi8(13) ));
+	return _mm_add_epi8( _mm_shuffle_epi8( offsets, reduced ), indices );
+}
+
+__attribute__((target("avx2")))
+static inline __m256i lookup_avx2(__m256i indices) {
+	const __m256i offsets = _mm256_broadcastsi128_si256( _mm_setr_epi8(
+	                          'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+	                          '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+	                          '/' - 63, 'A', 0, 0 ));
+	__m256i reduced = _mm256_subs_epu8( indices, _mm256_set1_epi8(51) );
+	__m256i less    = _mm256_cmpgt_epi8( _mm256_set1_epi8(26), indices );
+	reduced = _mm256_or_si256( reduced, _mm256_and_si256( less, _mm256_set1_epi8(13) ));
+	return _mm256_add_epi8( _mm256_shuffle_epi8( offsets, reduced ), indices );
+}
+
+// ascii to 6bit values, returns false if a char is not part of the alphabet
+__attribute__((target("ssse3")))
+static inline bool translate_ssse3(__m128i in, __m128i *values) {
+	__m128i upper = _mm_and_si128( _mm_cmpgt_epi8( in, _mm_set1_epi8('A' - 1) ), _mm_cmpgt_epi8( _mm_set1_epi8('Z' + 1), in ));
+	__m128i lower = _mm_and_si128( _mm_cmpgt_epi8( in, _mm_set1_epi8('a' - 1) ), _mm_cmpgt_epi8( _mm_set1_epi8('z' + 1), in ));
+	__m128i digit = _mm_and_si128( _mm_cmpgt_epi8( in, _mm_set1_epi8('0' - 1) ), _mm_cmpgt_epi8( _mm_set1_epi8('9' + 1), in ));
+	__m128i plus  = _mm_cmpeq_epi8( in, _mm_set1_epi8('+') );
+	__m128i slash = _mm_cmpeq_epi8( in, _mm_set1_epi8('/') );
+
+	__m128i valid = _mm_or_si128( _mm_or_si128( upper, lower ), _mm_or_si128( digit, _mm_or_si128( plus, slash )));
+	if( _mm_movemask_epi8( valid ) != 0xffff )
+		return false;
+
+	__m128i shift = _mm_or_si128(
+	  _mm_or_si128( _mm_and_si128( upper, _mm_set1_epi8(-65) ), _mm_and_si128( lower, _mm_set1_epi8(-71) )),
+	  _mm_or_si128( _mm_and_si128( digit, _mm_set1_epi8(4) ),
+	                _mm_or_si128( _mm_and_si128( plus, _mm_set1_epi8(19) ), _mm_and_si128( slash, _mm_set1_epi8(16) ))));
+	*values = _mm_add_epi8( in, shift );
+	return true;
+}
+
+__attribute__((target("avx2")))
+static inline bool translate_avx2(__m256i in, __m256i *values) {
+	__m256i upper = _mm256_and_si256( _mm256_cmpgt_epi8( in, _mm256_set1_epi8('A' - 1) ), _mm256_cmpgt_epi8( _mm256_set1_epi8('Z' + 1), in ));
+	__m256i lower = _mm256_and_si256( _mm256_cmpgt_epi8( in, _mm256_set1_epi8('a' - 1) ), _mm256_cmpgt_epi8( _mm256_set1_epi8('z' + 1), in ));
+	__m256i digit = _mm256_and_si256( _mm256_cmpgt_epi8( in, _mm256_set1_epi8('0' - 1) ), _mm256_cmpgt_epi8( _mm256_set1_epi8('9' + 1), in ));
+	__m256i plus  = _mm256_cmpeq_epi8( in, _mm256_set1_epi8('+') );
+	__m256i slash = _mm256_cmpeq_epi8( in, _mm256_set1_epi8('/') );
+
+	__m256i valid = _mm256_or_si256( _mm256_or_si256( upper, lower ), _mm256_or_si256( digit, _mm256_or_si256( plus, slash )));
+	if( _mm256_movemask_epi8( valid ) != -1 )
+		return false;
+
+	__m256i shift = _mm256_or_si256(
+	  _mm256_or_si256( _mm256_and_si256( upper, _mm256_set1_epi8(-65) ), _mm256_and_si256( lower, _mm256_set1_epi8(-71) )),
+	  _mm256_or_si256( _mm256_and_si256( digit, _mm256_set1_epi8(4) ),
+	                   _mm256_or_si256( _mm256_and_si256( plus, _mm256_set1_epi8(19) ), _mm256_and_si256( slash, _mm256_set1_epi8(16) ))));
+	*values = _mm256_add_epi8( in, shift );
+	return true;
+}
+
+
+__attribute__((target("ssse3")))
+static size_t encode_ssse3(const unsigned char *in, size_t len, char *out) {
+	const __m128i shuf = _mm_set_epi8( 10,11,9,10, 7,8,6,7, 4,5,3,4, 1,2,0,1 );
+	char *o = out;
+	size_t i = 0;
+
+	// reads 16 bytes, uses 12 of them
+	for( ; len - i >= 16; i += 12, o += 16 ) {
+		__m128i v = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)(in + i) ), shuf );
+		__m128i t0 = _mm_mulhi_epu16( _mm_and_si128( v, _mm_set1_epi32(0x0fc0fc00) ), _mm_set1_epi32(0x04000040) );
+		__m128i t1 = _mm_mullo_epi16( _mm_and_si128( v, _mm_set1_epi32(0x003f03f0) ), _mm_set1_epi32(0x01000010) );
+		_mm_storeu_si128( (__m128i *) o, lookup_ssse3( _mm_or_si128( t0, t1 )));
+	}
+
+	return (o - out) + encode_scalar( in + i, len - i, o );
+}
+
+__attribute__((target("ssse3")))
+static size_t decode_ssse3(const char *in, size_t len, unsigned char *out, size_t *consumed) {
+	const __m128i pack = _mm_setr_epi8( 2,1,0, 6,5,4, 10,9,8, 14,13,12, -1,-1,-1,-1 );
+	unsigned char *o = out;
+	size_t i = 0;
+
+	// stores 16 bytes, 12 of them are used. the slack in the input makes sure they fit into the output
+	for( ; len - i >= 24; i += 16, o += 12 ) {
+		__m128i values;
+		if( !translate_ssse3( _mm_loadu_si128( (const __m128i *)(in + i) ), &values ))
+			break;
+		__m128i merged = _mm_madd_epi16( _mm_maddubs_epi16( values, _mm_set1_epi32(0x01400140) ),
+		                                 _mm_set1_epi32(0x00011000) );
+		_mm_storeu_si128( (__m128i *) o, _mm_shuffle_epi8( merged, pack ));
+	}
+
+	size_t rest = 0;
+	o += decode_scalar( in + i, len - i, o, &rest );
+	*consumed = i + rest;
+	return o - out;
+}
+
+__attribute__((target("avx2")))
+static size_t encode_avx2(const unsigned char *in, size_t len, char *out) {
+	const __m256i shuf = _mm256_set_epi8( 10,11,9,10, 7,8,6,7, 4,5,3,4, 1,2,0,1,
+	                                      10,11,9,10, 7,8,6,7, 4,5,3,4, 1,2,0,1 );
+	char *o = out;
+	size_t i = 0;
+
+	// two lanes of 12 bytes each, the second load ends 28 bytes in
+	for( ; len - i >= 28; i += 24, o += 32 ) {
+		__m256i v = _mm256_inserti128_si256(
+		              _mm256_castsi128_si256( _mm_loadu_si128( (const __m128i *)(in + i) )),
+		              _mm_loadu_si128( (const __m128i *)(in + i + 12) ), 1 );
+		v = _mm256_shuffle_epi8( v, shuf );
+		__m256i t0 = _mm256_mulhi_epu16( _mm256_and_si256( v, _mm256_set1_epi32(0x0fc0fc00) ), _mm256_set1_epi32(0x04000040) );
+		__m256i t1 = _mm256_mullo_epi16( _mm256_and_si256( v, _mm256_set1_epi32(0x003f03f0) ), _mm256_set1_epi32(0x01000010) );
+		_mm256_storeu_si256( (__m256i *) o, lookup_avx2( _mm256_or_si256( t0, t1 )));
+	}
+
+	return (o - out) + encode_ssse3( in + i, len - i, o );
+}
+
+__attribute__((target("avx2")))
+static size_t decode_avx2(const char *in, size_t len, unsigned char *out, size_t *consumed) {
+	const __m256i pack = _mm256_setr_epi8( 2,1,0, 6,5,4, 10,9,8, 14,13,12, -1,-1,-1,-1,
+	                                       2,1,0, 6,5,4, 10,9,8, 14,13,12, -1,-1,-1,-1 );
+	const __m256i lanes = _mm256_setr_epi32( 0,1,2, 4,5,6, 7,7 );
+	unsigned char *o = out;
+	size_t i = 0;
+
+	for( ; len - i >= 48; i += 32, o += 24 ) {
+		__m256i values;
+		if( !translate_avx2( _mm256_loadu_si256( (const __m256i *)(in + i) ), &values ))
+			break;
+		__m256i merged = _mm256_madd_epi16( _mm256_maddubs_epi16( values, _mm256_set1_epi32(0x01400140) ),
+		                                    _mm256_set1_epi32(0x00011000) );
+		merged = _mm256_permutevar8x32_epi32( _mm256_shuffle_epi8( merged, pack ), lanes );
+		_mm256_storeu_si256( (__m256i *) o, merged );
+	}
+
+	size_t rest = 0;
+	o += decode_ssse3( in + i, len - i, o, &rest );
+	*consumed = i + rest;
+	return o - out;
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+static size_t encode_avx512vbmi(const unsigned char *in, size_t len, char *out) {
+	const __m512i shuf = _mm512_setr_epi32(
+		0x01020001, 0x04050304, 0x07080607, 0x0a0b090a,
+		0x0d0e0c0d, 0x10110f10, 0x13141213, 0x16171516,
+		0x191a1819, 0x1c1d1b1c, 0x1f201e1f, 0x22232122,
+		0x25262425, 0x28292728, 0x2b2c2a2b, 0x2e2f2d2e );
+	const __m512i shifts = _mm512_set1_epi64( 0x3036242a1016040aLL );
+	const __m512i lookup = _mm512_loadu_si512( enc_table );
+	char *o = out;
+	size_t i = 0;
+
+	for( ; len - i >= 48; i += 48, o += 64 ) {
+		__m512i v = _mm512_maskz_loadu_epi8( 0x0000ffffffffffffULL, in + i );
+		v = _mm512_permutexvar_epi8( shuf, v );
+		v = _mm512_multishift_epi64_epi8( shifts, v );
+		_mm512_storeu_si512( o, _mm512_permutexvar_epi8( v, lookup ));
+	}
+
+	return (o - out) + encode_avx2( in + i, len - i, o );
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+static size_t decode_avx512vbmi(const char *in, size_t len, unsigned char *out, size_t *consumed) {
+	const __m512i lut_lo = _mm512_loadu_si512( dec_table.lut );
+	const __m512i lut_hi = _mm512_loadu_si512( dec_table.lut + 64 );
+	const __m512i pack   = _mm512_loadu_si512( dec_table.pack );
+	unsigned char *o = out;
+	size_t i = 0;
+
+	for( ; len - i >= 64; i += 64, o += 48 ) {
+		__m512i v = _mm512_loadu_si512( in + i );
+		__m512i values = _mm512_permutex2var_epi8( lut_lo, v, lut_hi );
+		// non-ascii input or a char outside of the alphabet
+		if( _mm512_movepi8_mask( _mm512_or_si512( v, values )) != 0 )
+			break;
+		__m512i merged = _mm512_madd_epi16( _mm512_maddubs_epi16( values, _mm512_set1_epi32(0x01400140) ),
+		                                    _mm512_set1_epi32(0x00011000) );
+		_mm512_mask_storeu_epi8( o, 0x0000ffffffffffffULL, _mm512_permutexvar_epi8( pack, merged ));
+	}
+
+	size_t rest = 0;
+	o += decode_avx2( in + i, len - i, o, &rest );
+	*consumed = i + rest;
+	return o - out;
+}
+
+#endif // XSEC_BASE64_X86
+
+
+typedef struct kernels_t {
+	const char *name;
+	encode_fn encode;
+	decode_fn decode;
+} Kernels;
+
+static Kernels pick_kernels() {
+#ifdef XSEC_BASE64_X86
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports("avx512vbmi") && __builtin_cpu_supports("avx512bw") )
+		return { "avx512vbmi", encode_avx512vbmi, decode_avx512vbmi };
+	if( __builtin_cpu_supports("avx2") )
+		return { "avx2", encode_avx2, decode_avx2 };
+	if( __builtin_cpu_supports("ssse3") )
+		return { "ssse3", encode_ssse3, decode_ssse3 };
+#endif
+	return { "scalar", encode_scalar, decode_scalar };
+}
+
+static const Kernels &kernels() {
+	static const Kernels k = pick_kernels();
+	return k;
+}
+
+
+// decodes whole quanta only and sets consumed to where it stopped, the rest has to be passed again
+// with more data. a padded quantum ends the data, so it is only taken when last is set.
+static long decode_chunk(const char *in, size_t len, unsigned char *out, size_t *consumed, bool last) {
+	auto decode = kernels().decode;
+	unsigned char *o = out;
+	size_t pos = 0;
+
+	for(;;) {
+		while( pos < len && dec_table.v[(unsigned char) in[pos]] == B64_WHITESPACE )
+			pos++;
+		if( pos == len )
+			break;
+
+		size_t blocks = 0;
+		o += decode( in + pos, len - pos, o, &blocks );
+		pos += blocks;
+		if( blocks > 0 )
+			continue;
+
+		// something the kernels do not like, line break, padding or garbage. do one quantum by hand.
+		signed char q[4];
+		int n = 0;
+		size_t end = pos;
+		for( ; end < len && n < 4; end++ ) {
+			signed char v = dec_table.v[(unsigned char) in[end]];
+			if( v == B64_WHITESPACE )
+				continue;
+			if( v == B64_INVALID )
+				return -1;
+			q[n++] = v;
+		}
+		if( n < 4 ) {
+			if( last ) // xmlsec does not accept missing padding either
+				return -1;
+			break;
+		}
+
+		if( q[0] == B64_PAD || q[1] == B64_PAD || (q[2] == B64_PAD && q[3] != B64_PAD) )
+			return -1;
+
+		if( q[3] != B64_PAD ) {
+			*o++ = (q[0] << 2) | (q[1] >> 4);
+			*o++ = (q[1] << 4) | (q[2] >> 2);
+			*o++ = (q[2] << 6) |  q[3];
+			pos = end;
+			continue;
+		}
+
+		if( !last )
+			break;
+
+		*o++ = (q[0] << 2) | (q[1] >> 4);
+		if( q[2] != B64_PAD )
+			*o++ = (q[1] << 4) | (q[2] >> 2);
+
+		// nothing but whitespace may follow the padding
+		for( pos = end; pos < len; pos++ ) {
+			if( dec_table.v[(unsigned char) in[pos]] != B64_WHITESPACE )
+				return -1;
+		}
+	}
+
+	*consumed = pos;
+	return o - out;
+}
+
+
+const char *base64_kernel() {
+	return kernels().name;
+}
+
+size_t base64_encoded_size(size_t len, int columns) {
+	size_t n = (len + 2) / 3 * 4;
+	if( columns > 0 && n > 0 )
+		n += (n - 1) / columns;
+	return n;
+}
+
+size_t base64_encode(const unsigned char *in, size_t len, char *out, int columns) {
+	size_t n = kernels().encode( in, len, out );
+	if( columns <= 0 || n <= (size_t) columns )
+		return n;
+
+	// spread the lines out from the back, so nothing gets overwritten before it is moved
+	size_t lines = (n - 1) / columns;
+	for( size_t l = lines; l > 0; l-- ) {
+		size_t from = l * columns;
+		size_t to   = from + l;
+		memmove( out + to, out + from, (l == lines ? n - from : columns) );
+		out[to - 1] = '\n';
+	}
+	return n + lines;
+}
+
+size_t base64_decoded_size(size_t len) {
+	return (len + 3) / 4 * 3;
+}
+
+long base64_decode(const char *in, size_t len, unsigned char *out) {
+	size_t consumed = 0;
+	return decode_chunk( in, len, out, &consumed, true );
+}
+
+
+// xmlsec's own initialize and finalize are not used, so the line size is always the default one
+static int base64_step(xmlSecTransformPtr transform, int last) {
+	xmlSecBufferPtr in  = &(transform->inBuf);
+	xmlSecBufferPtr out = &(transform->outBuf);
+
+	if( transform->status == xmlSecTransformStatusNone )
+		transform->status = xmlSecTransformStatusWorking;
+
+	if( transform->status == xmlSecTransformStatusFinished )
+		return xmlSecBufferGetSize( in ) == 0 ? 0 : -1;
+
+	if( transform->status != xmlSecTransformStatusWorking )
+		return -1;
+
+	size_t inSize  = xmlSecBufferGetSize( in );
+	size_t outSize = xmlSecBufferGetSize( out );
+
+	if( transform->operation == xmlSecTransformOperationEncode ) {
+		int columns = xmlSecBase64GetDefaultLineSize();
+		// whole lines only, keeping at least one byte back so we know another line follows
+		size_t quantum = columns > 0 ? 3 * columns : 3;
+		size_t n = last ? inSize : (inSize > 0 ? (inSize - 1) / quantum * quantum : 0);
+
+		if( n > 0 ) {
+			if( xmlSecBufferSetMaxSize( out, outSize + base64_encoded_size( n, columns ) + 1 ) < 0 )
+				return -1;
+
+			auto dst = (char *) xmlSecBufferGetData( out ) + outSize;
+			size_t written = base64_encode( xmlSecBufferGetData( in ), n, dst, columns );
+			if( !last && columns > 0 )
+				dst[written++] = '\n';
+
+			xmlSecBufferSetSize( out, outSize + written );
+			xmlSecBufferRemoveHead( in, n );
+		}
+	}
+	else {
+		if( inSize > 0 ) {
+			if( xmlSecBufferSetMaxSize( out, outSize + base64_decoded_size( inSize )) < 0 )
+				return -1;
+
+			size_t consumed = 0;
+			long written = decode_chunk( (const char *) xmlSecBufferGetData( in ), inSize,
+			                             xmlSecBufferGetData( out ) + outSize, &consumed, last );
+			if( written < 0 ) {
+				xmlSecError( XMLSEC_ERRORS_HERE, (const char *) xmlSecTransformGetName( transform ), "base64_decode",
+				             XMLSEC_ERRORS_R_INVALID_DATA, "invalid base64 data" );
+				return -1;
+			}
+
+			xmlSecBufferSetSize( out, outSize + written );
+			xmlSecBufferRemoveHead( in, consumed );
+		}
+	}
+
+	if( last )
+		transform->status = xmlSecTransformStatusFinished;
+
+	return 0;
+}
+
+static int base64_execute(xmlSecTransformPtr transform, int last, xmlSecTransformCtxPtr) {
+	int prev = metrics_phase( MP_BASE64 );
+	int ret = base64_step( transform, last );
+	metrics_phase( prev );
+	return ret;
+}
+
+static struct _xmlSecTransformKlass base64_klass = {
+	sizeof(xmlSecTransformKlass),      /* klassSize */
+	sizeof(xmlSecTransform),           /* objSize */
+	xmlSecNameBase64,                  /* name */
+	xmlSecHrefBase64,                  /* href */
+	xmlSecTransformUsageDSigTransform, /* usage */
+	nullptr,                           /* initialize */
+	nullptr,                           /* finalize */
+	nullptr,                           /* readNode */
+	nullptr,                           /* writeNode */
+	nullptr,                           /* setKeyReq */
+	nullptr,                           /* setKey */
+	nullptr,                           /* verify */
+	xmlSecTransformDefaultGetDataType, /* getDataType */
+	xmlSecTransformDefaultPushBin,     /* pushBin */
+	xmlSecTransformDefaultPopBin,      /* popBin */
+	nullptr,                           /* pushXml */
+	nullptr,                           /* popXml */
+	base64_execute,                    /* execute */
+	nullptr,                           /* reserved0 */
+	nullptr,                           /* reserved1 */
+};
+
+int base64_replace_transforms(xmlSecTransformCtxPtr ctx) {
+	for( auto cur = ctx->first; cur != nullptr; cur = cur->next ) {
+		if( cur->id != xmlSecTransformBase64Id )
+			continue;
+
+		cur = replace_transform( ctx, cur, &base64_klass );
+		if( cur == nullptr )
+			return -1;
+	}
+	return 0;
+}
+
+} // namespace XSec
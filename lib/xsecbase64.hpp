@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#ifndef XSEC_BASE64_H
+#define XSEC_BASE64_H
+
+
+namespace XSec {
+
+#include <xmlsec/transforms.h>
+
+/* name of the kernel picked for this cpu: "avx512vbmi", "avx2", "ssse3" or "scalar" */
+const char *base64_kernel();
+
+/* space needed by base64_encode(), including line breaks but without a nullbyte */
+size_t base64_encoded_size(size_t len, int columns);
+
+/* encodes len bytes of in to out, inserting a '\n' after every columns chars like xmlsec does
+ * (none after the last line, none at all if columns <= 0), returns the number of chars written */
+size_t base64_encode(const unsigned char *in, size_t len, char *out, int columns);
+
+/* space needed by base64_decode() for len chars of input */
+size_t base64_decoded_size(size_t len);
+
+/* decodes len chars of in to out, whitespace is skipped,
+ * returns the number of bytes written or -1 if the input is not valid base64 */
+long base64_decode(const char *in, size_t len, unsigned char *out);
+
+/* preExecCallback for a transform context, replaces xmlsec's base64 transforms in the chain
+ * (like the one xmlenc adds for the CipherValue) with one using the kernels above */
+int base64_replace_transforms(xmlSecTransformCtxPtr ctx);
+
+} // namespace XSec
+#endif
@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#include "xseccore.hpp"
+#include "xsecc14n.hpp"
+#include "xsecmetrics.hpp"
+
+namespace XSec {
+
+#include <libxml/tree.h>
+#include <libxml/c14n.h>
+
+#include <xmlsec/xmlsec.h>
+#include <xmlsec/xmltree.h>
+#include <xmlsec/nodeset.h>
+#include <xmlsec/transforms.h>
+#include <xmlsec/strings.h>
+
+
+static xmlSecTransformDataType c14n_get_data_type(xmlSecTransformPtr, xmlSecTransformMode mode, xmlSecTransformCtxPtr) {
+	// takes a node set, gives the canonical bytes
+	return mode == xmlSecTransformModePush ? xmlSecTransformDataTypeXml : xmlSecTransformDataTypeBin;
+}
+
+static int c14n_push_xml(xmlSecTransformPtr transform, xmlSecNodeSetPtr nodes, xmlSecTransformCtxPtr transformCtx);
+
+#define C14N_KLASS(NAME, HREF) {                                                  \
+	sizeof(xmlSecTransformKlass), sizeof(xmlSecTransform), NAME, HREF,              \
+	xmlSecTransformUsageC14NMethod | xmlSecTransformUsageDSigTransform,             \
+	nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,                  \
+	c14n_get_data_type, nullptr, nullptr, c14n_push_xml, nullptr, nullptr,          \
+	nullptr, nullptr }
+
+static struct _xmlSecTransformKlass incl_klass          = C14N_KLASS( xmlSecNameC14N,                xmlSecHrefC14N );
+static struct _xmlSecTransformKlass incl_comments_klass = C14N_KLASS( xmlSecNameC14NWithComments,    xmlSecHrefC14NWithComments );
+static struct _xmlSecTransformKlass excl_klass          = C14N_KLASS( xmlSecNameExcC14N,             xmlSecHrefExcC14N );
+static struct _xmlSecTransformKlass excl_comments_klass = C14N_KLASS( xmlSecNameExcC14NWithComments, xmlSecHrefExcC14NWithComments );
+
+
+// the element at the top of a node set that is nothing but one whole subtree, nullptr for any other set.
+// xpointer results come intersected with the set of all nodes, which changes nothing and is skipped.
+// comments is set if the subtree includes its comments.
+static xmlNodePtr subtree_apex(xmlSecNodeSetPtr nodes, int mode, bool *comments) {
+	xmlSecNodeSetPtr tree = nullptr;
+	auto cur = nodes;
+	do {
+		if( cur->op != xmlSecNodeSetIntersection || cur->children != nullptr )
+			return nullptr;
+
+		if( cur->type == xmlSecNodeSetNormal && cur->nodes == nullptr ) {
+			// all nodes
+		}
+		else if( tree == nullptr && (cur->type == xmlSecNodeSetTree || cur->type == xmlSecNodeSetTreeWithoutComments )) {
+			tree = cur;
+		}
+		else {
+			return nullptr;
+		}
+		cur = cur->next;
+	} while( cur != nodes );
+
+	if( tree == nullptr || tree->nodes == nullptr || tree->nodes->nodeNr != 1 )
+		return nullptr;
+	*comments = tree->type == xmlSecNodeSetTree;
+
+	auto apex = tree->nodes->nodeTab[0];
+	if( apex == nullptr || apex->type != XML_ELEMENT_NODE )
+		return nullptr;
+
+	// inclusive c14n pulls xml:* attributes of the ancestors down onto the apex, leave that to libxml2
+	if( mode == XML_C14N_1_0 ) {
+		for( auto cur = apex->parent; cur != nullptr && cur->type == XML_ELEMENT_NODE; cur = cur->parent ) {
+			for( auto attr = cur->properties; attr != nullptr; attr = attr->next ) {
+				if( attr->ns != nullptr && xmlStrEqual( attr->ns->href, XML_XML_NAMESPACE ))
+					return nullptr;
+			}
+		}
+	}
+
+	return apex;
+}
+
+// canonicalizes a copy of the subtree in a document of its own, so only the subtree gets walked.
+// the namespaces in scope at the apex are declared on the copy, exclusive c14n drops the unused ones again.
+static int c14n_subtree(xmlNodePtr apex, int mode, int with_comments, xmlOutputBufferPtr buf) {
+	auto doc = xmlNewDoc( BAD_CAST "1.0" );
+	if( doc == nullptr )
+		return -1;
+
+	auto copy = xmlDocCopyNode( apex, doc, 1 );
+	if( copy == nullptr ) {
+		xmlFreeDoc( doc );
+		return -1;
+	}
+	xmlDocSetRootElement( doc, copy );
+
+	auto nsList = xmlGetNsList( apex->doc, apex );
+	if( nsList != nullptr ) {
+		for( auto ns = nsList; *ns != nullptr; ns++ ) {
+			if( xmlSearchNs( doc, copy, (*ns)->prefix ) == nullptr )
+				xmlNewNs( copy, (*ns)->href, (*ns)->prefix );
+		}
+		xmlFree( nsList );
+	}
+
+	int ret = xmlC14NDocSaveTo( doc, nullptr, mode, nullptr, with_comments, buf );
+	xmlFreeDoc( doc );
+	return ret;
+}
+
+// the canonical bytes go straight on to the digest, this charges that part to MP_CRYPTO.
+// xmlOutputBufferWrite() returns what it flushed, not what it took, the caller drops len bytes either way
+static int metered_write(void *context, const char *data, int len) {
+	int prev = metrics_phase( MP_CRYPTO );
+	int ret = xmlOutputBufferWrite( (xmlOutputBufferPtr) context, len, data );
+	metrics_phase( prev );
+	return ret < 0 ? -1 : len;
+}
+
+static int metered_close(void *context) {
+	int prev = metrics_phase( MP_CRYPTO );
+	int ret = xmlOutputBufferClose( (xmlOutputBufferPtr) context );
+	metrics_phase( prev );
+	return ret;
+}
+
+static int c14n_push_xml(xmlSecTransformPtr transform, xmlSecNodeSetPtr nodes, xmlSecTransformCtxPtr transformCtx) {
+	if( nodes == nullptr )
+		return -1;
+
+	int mode = (transform->id == &excl_klass || transform->id == &excl_comments_klass)
+	           ? XML_C14N_EXCLUSIVE_1_0 : XML_C14N_1_0;
+	int with_comments = (transform->id == &incl_comments_klass || transform->id == &excl_comments_klass);
+
+	auto buf = xmlSecTransformCreateOutputBuffer( transform->next, transformCtx );
+	if( buf == nullptr )
+		return -1;
+
+	int prev = MP_OTHER;
+	if( metrics_active() ) {
+		auto metered = xmlOutputBufferCreateIO( metered_write, metered_close, buf, nullptr );
+		if( metered == nullptr ) {
+			xmlOutputBufferClose( buf );
+			return -1;
+		}
+		buf = metered;
+		prev = metrics_phase( MP_C14N );
+	}
+
+	int ret;
+	bool comments = false;
+	auto apex = subtree_apex( nodes, mode, &comments );
+	if( apex != nullptr )
+		ret = c14n_subtree( apex, mode, with_comments && comments, buf );
+	else // the same xmlsec does
+		ret = xmlC14NExecute( nodes->doc, (xmlC14NIsVisibleCallback) xmlSecNodeSetContains, nodes,
+		                      mode, nullptr, with_comments, buf );
+
+	int closed = xmlOutputBufferClose( buf );
+	if( metrics_active() )
+		metrics_phase( prev );
+	if( closed < 0 || ret < 0 )
+		return -1;
+
+	transform->status = xmlSecTransformStatusFinished;
+	return 0;
+}
+
+
+int c14n_replace_transforms(xmlSecTransformCtxPtr ctx) {
+	// a reference to another document is parsed into a document of its own, nothing to gain there
+	if( ctx->uri != nullptr && ctx->uri[0] != '\0' )
+		return 0;
+
+	for( auto cur = ctx->first; cur != nullptr; cur = cur->next ) {
+		xmlSecTransformId id = nullptr;
+		if( cur->id == xmlSecTransformInclC14NId )
+			id = &incl_klass;
+		else if( cur->id == xmlSecTransformInclC14NWithCommentsId )
+			id = &incl_comments_klass;
+		else if( cur->id == xmlSecTransformExclC14NId )
+			id = &excl_klass;
+		else if( cur->id == xmlSecTransformExclC14NWithCommentsId )
+			id = &excl_comments_klass;
+		else
+			continue;
+
+		// an InclusiveNamespaces PrefixList only lives in the private part of xmlsec's transform, keep it
+		if( cur->hereNode != nullptr && xmlSecGetNextElementNode( cur->hereNode->children ) != nullptr )
+			continue;
+
+		cur = replace_transform( ctx, cur, id );
+		if( cur == nullptr )
+			return -1;
+	}
+	return 0;
+}
+
+} // namespace XSec
@@ -0,0 +1,523 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#include <limits.h>
+#include <string.h>
+#include <deque>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "xseccapi.h"
+#include "xseccore.hpp"
+#include "xseckey.hpp"
+
+namespace XSec {
+
+#include <xmlsec/crypto.h>
+
+}
+
+using namespace XSec;
+
+struct xsec_core {
+	std::shared_ptr<Core> core;
+	std::string error;
+	int         error_code = 0;
+	/* result of the last call that didn't fit the callers buffer */
+	std::string spill;
+	bool        spilled = false;
+};
+
+struct xsec_key {
+	std::shared_ptr<Key> key;
+};
+
+struct xsec_profile {
+	xsec_op op;
+	sign_options_t    sign;
+	verify_options_t  verify;
+	encrypt_options_t encrypt;
+	decrypt_options_t decrypt;
+	/* sign.references points into this, a deque doesn't move its elements */
+	std::deque<Reference> references;
+	/* the options only hold plain pointers, these keep the keys alive */
+	std::vector<std::shared_ptr<Key>> keys;
+};
+
+
+static_assert( (int) XSEC_SF_DETACHED == (int) SF_DETACHED && (int) XSEC_EF_ROOT == (int) EF_ROOT, "xseccapi.h out of sync" );
+static_assert( (int) XSEC_C14N_EXCLUSIVE == (int) C14N_EXCLUSIVE && (int) XSEC_HA_SHA512 == (int) HA_SHA512, "xseccapi.h out of sync" );
+static_assert( (int) XSEC_SA_ECDSA_SHA1 == (int) SA_ECDSA_SHA1 && (int) XSEC_SA_HMAC_SHA512 == (int) SA_HMAC_SHA512, "xseccapi.h out of sync" );
+static_assert( (int) XSEC_EA_3DES_CBC == (int) EA_3DES_CBC && (int) XSEC_EA_AES256_GCM == (int) EA_AES256_GCM, "xseccapi.h out of sync" );
+static_assert( (int) XSEC_KT_AES128_KW == (int) KT_AES128_KW && (int) XSEC_KT_AES256_KW == (int) KT_AES256_KW, "xseccapi.h out of sync" );
+static_assert( (int) XSEC_OF_INDENTED == (int) OF_INDENTED && (int) XSEC_PD_LOAD == (int) PD_LOAD, "xseccapi.h out of sync" );
+
+
+static int fail(xsec_core *core, int status, int code, const std::string &msg) {
+	core->error = msg;
+	core->error_code = code;
+	return status;
+}
+
+// no exception may leave through the C interface, bad_alloc is the only one expected
+template<typename Fn>
+static int guarded(Fn fn) {
+	try {
+		return fn();
+	}
+	catch( const std::bad_alloc & ) {
+		return XSEC_ERR_MEMORY;
+	}
+	catch( ... ) {
+		return XSEC_ERR_FAILED;
+	}
+}
+
+static bool key_format(xsec_key_format format, xmlSecKeyDataFormat &out) {
+	switch( format ) {
+		case XSEC_KEY_PEM:      out = xmlSecKeyDataFormatPem;     return true;
+		case XSEC_KEY_DER:      out = xmlSecKeyDataFormatDer;     return true;
+		case XSEC_KEY_PKCS12:   out = xmlSecKeyDataFormatPkcs12;  return true;
+		case XSEC_KEY_CERT_PEM: out = xmlSecKeyDataFormatCertPem; return true;
+		case XSEC_KEY_CERT_DER: out = xmlSecKeyDataFormatCertDer; return true;
+		default:                return false;
+	}
+}
+
+static int new_key(xsec_core *core, Key *loaded, xsec_key **key) {
+	if( loaded == nullptr )
+		return fail( core, XSEC_ERR_KEY, 0, "Error: failed to load key" );
+
+	// the deleter holds the core, so xmlsec stays initialized until the key is gone
+	auto lib = core->core;
+	auto k = new (std::nothrow) xsec_key;
+	if( k == nullptr ) {
+		delete loaded;
+		return XSEC_ERR_MEMORY;
+	}
+	k->key = std::shared_ptr<Key>( loaded, [lib](Key *key) { delete key; } );
+	*key = k;
+	return XSEC_OK;
+}
+
+
+uint32_t xsec_api_version(void) {
+	return XSEC_API_MAJOR << 16 | XSEC_API_MINOR;
+}
+
+int xsec_core_new(xsec_core **core) {
+	if( core == nullptr )
+		return XSEC_ERR_ARGUMENT;
+
+	return guarded( [&] {
+		auto c = std::unique_ptr<xsec_core>( new xsec_core );
+		c->core = std::make_shared<Core>();
+		if( !c->core->error_message().empty())
+			return XSEC_ERR_FAILED;
+
+		*core = c.release();
+		return XSEC_OK;
+	} );
+}
+
+void xsec_core_free(xsec_core *core) {
+	delete core;
+}
+
+const char *xsec_core_error(const xsec_core *core) {
+	return core != nullptr ? core->error.c_str() : "";
+}
+
+int xsec_core_error_code(const xsec_core *core) {
+	return core != nullptr ? core->error_code : 0;
+}
+
+int xsec_core_set_ca_dir(xsec_core *core, const char *dir) {
+	if( core == nullptr || dir == nullptr )
+		return XSEC_ERR_ARGUMENT;
+
+	return guarded( [&] {
+		auto ret = core->core->set_ca_dir( dir );
+		if( ret != 0 )
+			return fail( core, XSEC_ERR_FAILED, ret, core->core->error_message());
+		return XSEC_OK;
+	} );
+}
+
+int xsec_core_set_limit(xsec_core *core, xsec_limit limit, uint64_t value) {
+	if( core == nullptr )
+		return XSEC_ERR_ARGUMENT;
+
+	auto limits = core->core->get_limits();
+	bool small = value <= UINT_MAX;
+	switch( limit ) {
+		case XSEC_LIMIT_DOCUMENT_BYTES: limits.document_bytes = value; break;
+		case XSEC_LIMIT_DEPTH:          if( !small ) return XSEC_ERR_ARGUMENT; limits.depth = value; break;
+		case XSEC_LIMIT_NODES:          limits.nodes = value; break;
+		case XSEC_LIMIT_ENTITY_BYTES:   limits.entity_bytes = value; break;
+		case XSEC_LIMIT_REFERENCES:     if( !small ) return XSEC_ERR_ARGUMENT; limits.references = value; break;
+		case XSEC_LIMIT_TRANSFORMS:     if( !small ) return XSEC_ERR_ARGUMENT; limits.transforms = value; break;
+		case XSEC_LIMIT_XPATH_OPS:      limits.xpath_ops = value; break;
+		default:                        return XSEC_ERR_ARGUMENT;
+	}
+	core->core->set_limits( limits );
+	return XSEC_OK;
+}
+
+int xsec_core_take_result(xsec_core *core, char *out, size_t cap, size_t *out_len) {
+	if( core == nullptr || out_len == nullptr || !core->spilled )
+		return XSEC_ERR_ARGUMENT;
+
+	*out_len = core->spill.size();
+	if( core->spill.size() > cap )
+		return XSEC_ERR_BUFFER;
+
+	memcpy( out, core->spill.data(), core->spill.size() );
+	std::string().swap( core->spill );
+	core->spilled = false;
+	return XSEC_OK;
+}
+
+int xsec_key_load_file(xsec_core *core, const char *path, xsec_key_format format, const char *password,
+                       xsec_key **key) {
+	if( core == nullptr || path == nullptr || key == nullptr )
+		return XSEC_ERR_ARGUMENT;
+
+	return guarded( [&] {
+		xmlSecKeyDataFormat fmt;
+		if( format == XSEC_KEY_HMAC )
+			return new_key( core, Key::load_raw_file( xmlSecKeyDataHmacId, path ), key );
+		if( format == XSEC_KEY_AES )
+			return new_key( core, Key::load_raw_file( xmlSecKeyDataAesId, path ), key );
+		if( !key_format( format, fmt ))
+			return XSEC_ERR_ARGUMENT;
+		return new_key( core, Key::load_file( path, fmt, password != nullptr ? password : "" ), key );
+	} );
+}
+
+int xsec_key_load_memory(xsec_core *core, const void *data, size_t len, xsec_key_format format,
+                         const char *password, xsec_key **key) {
+	if( core == nullptr || data == nullptr || key == nullptr )
+		return XSEC_ERR_ARGUMENT;
+
+	return guarded( [&] {
+		xmlSecKeyDataFormat fmt;
+		if( format == XSEC_KEY_HMAC )
+			return new_key( core, Key::load_raw( xmlSecKeyDataHmacId, data, len ), key );
+		if( format == XSEC_KEY_AES )
+			return new_key( core, Key::load_raw( xmlSecKeyDataAesId, data, len ), key );
+		if( !key_format( format, fmt ))
+			return XSEC_ERR_ARGUMENT;
+		return new_key( core, Key::load_memory( data, len, fmt, password != nullptr ? password : "" ), key );
+	} );
+}
+
+int xsec_key_set_name(xsec_key *key, const char *name) {
+	if( key == nullptr || name == nullptr )
+		return XSEC_ERR_ARGUMENT;
+
+	return guarded( [&] {
+		return key->key->set_name( name ) == 0 ? XSEC_OK : XSEC_ERR_MEMORY;
+	} );
+}
+
+void xsec_key_free(xsec_key *key) {
+	delete key;
+}
+
+int xsec_profile_new(xsec_op op, xsec_profile **profile) {
+	if( profile == nullptr || op < XSEC_SIGN || op > XSEC_DECRYPT )
+		return XSEC_ERR_ARGUMENT;
+
+	return guarded( [&] {
+		auto p = new xsec_profile;
+		p->op = op;
+		// documents come as pointer and length, never as path
+		p->sign.doc_in_memory = true;
+		p->verify.doc_in_memory = true;
+		*profile = p;
+		return XSEC_OK;
+	} );
+}
+
+void xsec_profile_free(xsec_profile *profile) {
+	delete profile;
+}
+
+int xsec_profile_set_int(xsec_profile *profile, xsec_option option, int value) {
+	if( profile == nullptr || value < 0 )
+		return XSEC_ERR_ARGUMENT;
+
+	auto op = profile->op;
+	auto &parse = op == XSEC_SIGN ? profile->sign.parse : op == XSEC_VERIFY ? profile->verify.parse
+	            : op == XSEC_ENCRYPT ? profile->encrypt.parse : profile->decrypt.parse;
+	switch( option ) {
+		case XSEC_OPT_FORMAT:
+			if( op == XSEC_SIGN )         profile->sign.format = value;
+			else if( op == XSEC_ENCRYPT ) profile->encrypt.encryption_form = value;
+			else return XSEC_ERR_ARGUMENT;
+			break;
+		case XSEC_OPT_C14N:
+			if( op != XSEC_SIGN ) return XSEC_ERR_ARGUMENT;
+			profile->sign.c14n_algorithm = value;
+			break;
+		case XSEC_OPT_SIGN_ALGORITHM:
+			if( op != XSEC_SIGN ) return XSEC_ERR_ARGUMENT;
+			profile->sign.sign_algorithm = value;
+			break;
+		case XSEC_OPT_HASH_ALGORITHM:
+			if( op != XSEC_SIGN ) return XSEC_ERR_ARGUMENT;
+			profile->sign.hash_algorithm = value;
+			break;
+		case XSEC_OPT_ENC_ALGORITHM:
+			if( op != XSEC_ENCRYPT ) return XSEC_ERR_ARGUMENT;
+			profile->encrypt.encryption_algorithm = value;
+			break;
+		case XSEC_OPT_KEY_TRANSPORT:
+			if( op != XSEC_ENCRYPT ) return XSEC_ERR_ARGUMENT;
+			profile->encrypt.key_transport_algorithm = value;
+			break;
+		case XSEC_OPT_OUTPUT_FORMAT:
+			if( op != XSEC_DECRYPT ) return XSEC_ERR_ARGUMENT;
+			profile->decrypt.output_format = value;
+			break;
+		case XSEC_OPT_EMBED_CERTIFICATE:
+			if( op == XSEC_SIGN ) {
+				profile->sign.public_key_is_cert = value != 0;
+			}
+			else if( op == XSEC_ENCRYPT ) {
+				profile->encrypt.public_key_is_cert = value != 0;
+				for( auto &rcpt : profile->encrypt.recipients )
+					rcpt.public_key_is_cert = value != 0;
+			}
+			else return XSEC_ERR_ARGUMENT;
+			break;
+		case XSEC_OPT_TRUST_SELFSIGNED:
+			if( op == XSEC_VERIFY )       profile->verify.trust_selfsigned_cert = value != 0;
+			else if( op == XSEC_ENCRYPT ) profile->encrypt.trust_selfsigned_cert = value != 0;
+			else if( op == XSEC_DECRYPT ) profile->decrypt.trust_selfsigned_cert = value != 0;
+			else return XSEC_ERR_ARGUMENT;
+			break;
+		case XSEC_OPT_PARSE_FLAGS:
+			if( value & ~(XSEC_PARSE_HUGE | XSEC_PARSE_COMPACT | XSEC_PARSE_NO_BLANKS | XSEC_PARSE_SHARED_DICT) )
+				return XSEC_ERR_ARGUMENT;
+			parse.huge        = value & XSEC_PARSE_HUGE;
+			parse.compact     = value & XSEC_PARSE_COMPACT;
+			parse.no_blanks   = value & XSEC_PARSE_NO_BLANKS;
+			parse.shared_dict = value & XSEC_PARSE_SHARED_DICT;
+			break;
+		case XSEC_OPT_DTD:
+			if( value > XSEC_PD_LOAD ) return XSEC_ERR_ARGUMENT;
+			parse.dtd = value;
+			break;
+		default:
+			return XSEC_ERR_ARGUMENT;
+	}
+	return XSEC_OK;
+}
+
+int xsec_profile_set_base_url(xsec_profile *profile, const char *url) {
+	if( profile == nullptr )
+		return XSEC_ERR_ARGUMENT;
+
+	return guarded( [&] {
+		std::string base = url != nullptr ? url : "";
+		if( profile->op == XSEC_SIGN )
+			profile->sign.base_url = base;
+		else if( profile->op == XSEC_VERIFY )
+			profile->verify.base_url = base;
+		else
+			return XSEC_ERR_ARGUMENT;
+		return XSEC_OK;
+	} );
+}
+
+int xsec_profile_set_key(xsec_profile *profile, xsec_key *key) {
+	if( profile == nullptr || key == nullptr )
+		return XSEC_ERR_ARGUMENT;
+
+	return guarded( [&] {
+		auto k = key->key.get();
+		switch( profile->op ) {
+			case XSEC_SIGN:    profile->sign.key = k;    break;
+			case XSEC_VERIFY:  profile->verify.key = k;  break;
+			case XSEC_ENCRYPT: profile->encrypt.key = k; break;
+			case XSEC_DECRYPT: profile->decrypt.key = k; break;
+		}
+		profile->keys.push_back( key->key );
+		return XSEC_OK;
+	} );
+}
+
+int xsec_profile_add_recipient(xsec_profile *profile, xsec_key *key) {
+	if( profile == nullptr || key == nullptr || profile->op != XSEC_ENCRYPT )
+		return XSEC_ERR_ARGUMENT;
+
+	return guarded( [&] {
+		Recipient rcpt;
+		rcpt.public_key_is_cert = profile->encrypt.public_key_is_cert;
+		rcpt.key = key->key.get();
+		profile->encrypt.recipients.push_back( rcpt );
+		profile->keys.push_back( key->key );
+		return XSEC_OK;
+	} );
+}
+
+int xsec_profile_set_kek(xsec_profile *profile, xsec_key *key) {
+	if( profile == nullptr || key == nullptr )
+		return XSEC_ERR_ARGUMENT;
+
+	return guarded( [&] {
+		if( profile->op == XSEC_ENCRYPT )
+			profile->encrypt.kek = key->key.get();
+		else if( profile->op == XSEC_DECRYPT )
+			profile->decrypt.kek = key->key.get();
+		else
+			return XSEC_ERR_ARGUMENT;
+		profile->keys.push_back( key->key );
+		return XSEC_OK;
+	} );
+}
+
+int xsec_profile_add_reference(xsec_profile *profile, const char *uri, int hash, int transform) {
+	if( profile == nullptr || uri == nullptr || profile->op != XSEC_SIGN )
+		return XSEC_ERR_ARGUMENT;
+
+	return guarded( [&] {
+		Reference ref;
+		ref.hash = hash;
+		ref.transform = transform;
+		ref.uri = uri;
+		profile->references.push_back( ref );
+		profile->sign.references.push_back( &profile->references.back() );
+		return XSEC_OK;
+	} );
+}
+
+int xsec_profile_add_xpath(xsec_profile *profile, const char *xpath) {
+	if( profile == nullptr || xpath == nullptr || profile->op != XSEC_ENCRYPT )
+		return XSEC_ERR_ARGUMENT;
+
+	return guarded( [&] {
+		profile->encrypt.xpaths.push_back( xpath );
+		return XSEC_OK;
+	} );
+}
+
+
+static int run(xsec_core *core, const xsec_profile *profile, const char *doc, size_t len, const Sink &sink) {
+	core->error.clear();
+	core->error_code = 0;
+
+	Source src;
+	src.data = doc;
+	src.size = len;
+
+	int ret = 0;
+	bool valid = false;
+	switch( profile->op ) {
+		case XSEC_SIGN:    ret = core->core->sign( src, sink, profile->sign );       break;
+		case XSEC_VERIFY:  ret = core->core->verify( src, valid, profile->verify );  break;
+		case XSEC_ENCRYPT: ret = core->core->encrypt( src, sink, profile->encrypt ); break;
+		case XSEC_DECRYPT: ret = core->core->decrypt( src, sink, profile->decrypt ); break;
+	}
+
+	if( ret != 0 )
+		return fail( core, ret == LIMIT_EXCEEDED ? XSEC_ERR_LIMIT : XSEC_ERR_FAILED, ret, core->core->error_message());
+	if( profile->op == XSEC_VERIFY && !valid )
+		return XSEC_INVALID;
+	return XSEC_OK;
+}
+
+struct BufferWrite {
+	xsec_core *core;
+	char      *out;
+	size_t     cap;
+	size_t     len;
+};
+
+// fills the callers buffer, everything from the first piece that doesn't fit on goes to the core
+static int buffer_write(void *ctx, const char *data, size_t len) {
+	auto buf = (BufferWrite *) ctx;
+	auto core = buf->core;
+	if( !core->spilled && buf->len + len <= buf->cap ) {
+		memcpy( buf->out + buf->len, data, len );
+	}
+	else {
+		try {
+			if( !core->spilled ) {
+				core->spill.assign( buf->len > 0 ? buf->out : "", buf->len );
+				core->spilled = true;
+			}
+			core->spill.append( data, len );
+		}
+		catch( const std::bad_alloc & ) {
+			return -1;
+		}
+	}
+	buf->len += len;
+	return 0;
+}
+
+int xsec_run(xsec_core *core, const xsec_profile *profile, const char *doc, size_t len,
+             char *out, size_t cap, size_t *out_len) {
+	if( core == nullptr || profile == nullptr || doc == nullptr || out_len == nullptr )
+		return XSEC_ERR_ARGUMENT;
+	if( out == nullptr && cap != 0 )
+		return XSEC_ERR_ARGUMENT;
+
+	return guarded( [&] {
+		std::string().swap( core->spill );
+		core->spilled = false;
+
+		BufferWrite buf = { core, out, cap, 0 };
+		Sink sink;
+		sink.write = buffer_write;
+		sink.ctx = &buf;
+
+		auto ret = run( core, profile, doc, len, sink );
+		*out_len = buf.len;
+		if( ret == XSEC_OK && core->spilled )
+			return XSEC_ERR_BUFFER;
+		if( ret != XSEC_OK ) {
+			std::string().swap( core->spill );
+			core->spilled = false;
+		}
+		return ret;
+	} );
+}
+
+int xsec_run_cb(xsec_core *core, const xsec_profile *profile, const char *doc, size_t len,
+                xsec_write_fn write, void *ctx) {
+	if( core == nullptr || profile == nullptr || doc == nullptr )
+		return XSEC_ERR_ARGUMENT;
+	if( write == nullptr && profile->op != XSEC_VERIFY )
+		return XSEC_ERR_ARGUMENT;
+
+	return guarded( [&] {
+		Sink sink;
+		sink.write = write;
+		sink.ctx = ctx;
+		return run( core, profile, doc, len, sink );
+	} );
+}
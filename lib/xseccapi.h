@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#ifndef XSEC_CAPI_H
+#define XSEC_CAPI_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* plain C interface to xseccore for other languages, it only passes pointers, lengths and ints,
+ * everything else lives behind opaque handles. Calls return one of the XSEC_OK ... codes below */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* bumped on incompatible changes (major) or additions (minor), see xsec_api_version() */
+#define XSEC_API_MAJOR 1
+#define XSEC_API_MINOR 3
+
+#define XSEC_OK             0
+#define XSEC_INVALID        1  /* verify only: the signature did not verify */
+#define XSEC_ERR_ARGUMENT  -1
+#define XSEC_ERR_BUFFER    -2  /* out too small, *out_len is the size needed, see xsec_core_take_result() */
+#define XSEC_ERR_FAILED    -3  /* the operation failed, see xsec_core_error() */
+#define XSEC_ERR_KEY       -4
+#define XSEC_ERR_MEMORY    -5
+#define XSEC_ERR_LIMIT     -6  /* the document went beyond a bound set by xsec_core_set_limit() (since 1.3) */
+
+typedef enum {
+	XSEC_SIGN = 0,
+	XSEC_VERIFY,
+	XSEC_ENCRYPT,
+	XSEC_DECRYPT
+} xsec_op;
+
+typedef enum {
+	XSEC_KEY_PEM = 0,
+	XSEC_KEY_DER,
+	XSEC_KEY_PKCS12,
+	XSEC_KEY_CERT_PEM,  /* public key of a certificate, the certificate comes with it */
+	XSEC_KEY_CERT_DER,
+	XSEC_KEY_HMAC,      /* raw shared secret */
+	XSEC_KEY_AES        /* raw key encryption key */
+} xsec_key_format;
+
+/* the fields of Limits in xseccore.hpp */
+typedef enum {
+	XSEC_LIMIT_DOCUMENT_BYTES = 0,
+	XSEC_LIMIT_DEPTH,
+	XSEC_LIMIT_NODES,
+	XSEC_LIMIT_ENTITY_BYTES,
+	XSEC_LIMIT_REFERENCES,
+	XSEC_LIMIT_TRANSFORMS,
+	XSEC_LIMIT_XPATH_OPS
+} xsec_limit;
+
+/* integer options of a profile, the values are those of the enums in xseccore.hpp,
+ * repeated here as XSEC_SF_*, XSEC_SA_* ... */
+typedef enum {
+	XSEC_OPT_FORMAT = 0,          /* sign: XSEC_SF_*, encrypt: XSEC_EF_* */
+	XSEC_OPT_C14N,                /* sign: XSEC_C14N_* */
+	XSEC_OPT_SIGN_ALGORITHM,      /* sign: XSEC_SA_* */
+	XSEC_OPT_HASH_ALGORITHM,      /* sign: XSEC_HA_* */
+	XSEC_OPT_ENC_ALGORITHM,       /* encrypt: XSEC_EA_* */
+	XSEC_OPT_KEY_TRANSPORT,       /* encrypt: XSEC_KT_* */
+	XSEC_OPT_OUTPUT_FORMAT,       /* decrypt: XSEC_OF_* */
+	XSEC_OPT_EMBED_CERTIFICATE,   /* sign, encrypt: 1 embeds the certificate of the key instead of its public key */
+	XSEC_OPT_TRUST_SELFSIGNED,    /* verify, encrypt, decrypt: 1 trusts self-signed certificates */
+	XSEC_OPT_PARSE_FLAGS,         /* all: XSEC_PARSE_* or'ed together, how documents are parsed (since 1.2) */
+	XSEC_OPT_DTD                  /* all: XSEC_PD_* (since 1.2) */
+} xsec_option;
+
+enum { XSEC_SF_UNSET = 0, XSEC_SF_ENVELOPED, XSEC_SF_ENVELOPING, XSEC_SF_DETACHED };
+enum { XSEC_EF_UNSET = 0, XSEC_EF_ELEMENT, XSEC_EF_CONTENT, XSEC_EF_ROOT };
+enum { XSEC_C14N_UNSET = 0, XSEC_C14N_11_INCLUSIVE, XSEC_C14N_INCLUSIVE, XSEC_C14N_EXCLUSIVE };
+enum { XSEC_SA_UNSET = 0, XSEC_SA_RSA_SHA1, XSEC_SA_RSA_SHA224, XSEC_SA_RSA_SHA256, XSEC_SA_RSA_SHA384,
+       XSEC_SA_RSA_SHA512, XSEC_SA_ECDSA_SHA1, XSEC_SA_ECDSA_SHA224, XSEC_SA_ECDSA_SHA256,
+       XSEC_SA_ECDSA_SHA384, XSEC_SA_ECDSA_SHA512, XSEC_SA_HMAC_SHA256, XSEC_SA_HMAC_SHA384,
+       XSEC_SA_HMAC_SHA512 };
+enum { XSEC_EA_UNSET = 0, XSEC_EA_AES128_CBC, XSEC_EA_AES192_CBC, XSEC_EA_AES256_CBC, XSEC_EA_3DES_CBC,
+       XSEC_EA_AES128_GCM, XSEC_EA_AES192_GCM, XSEC_EA_AES256_GCM };
+enum { XSEC_KT_UNSET = 0, XSEC_KT_RSA_PKCS1, XSEC_KT_RSA_OAEP, XSEC_KT_AES128_KW, XSEC_KT_AES192_KW,
+       XSEC_KT_AES256_KW };
+enum { XSEC_HA_UNSET = 0, XSEC_HA_SHA1, XSEC_HA_SHA224, XSEC_HA_SHA256, XSEC_HA_SHA384, XSEC_HA_SHA512 };
+enum { XSEC_OF_UNSET = 0, XSEC_OF_COMPACT, XSEC_OF_INDENTED };
+enum { XSEC_PD_UNSET = 0, XSEC_PD_IGNORE, XSEC_PD_LOAD };
+
+/* the fields of ParseProfile, XSEC_PARSE_SHARED_DICT keeps the names of documents in their core */
+enum { XSEC_PARSE_HUGE = 1, XSEC_PARSE_COMPACT = 2, XSEC_PARSE_NO_BLANKS = 4, XSEC_PARSE_SHARED_DICT = 8 };
+
+/* receives a result piece by piece, returns 0 to go on, anything else fails the call */
+typedef int (*xsec_write_fn)(void *ctx, const char *data, size_t len);
+
+/* a core runs the operations, one thread at a time, use one per thread.
+ * Profiles and keys may be shared between threads as long as nobody changes them */
+typedef struct xsec_core    xsec_core;
+typedef struct xsec_profile xsec_profile;
+typedef struct xsec_key     xsec_key;
+
+/* XSEC_API_MAJOR << 16 | XSEC_API_MINOR of the library, callers should check the major part */
+uint32_t xsec_api_version(void);
+
+int  xsec_core_new(xsec_core **core);
+void xsec_core_free(xsec_core *core);
+
+/* message and code of xseccore for the last failed call on core, "" and 0 if there is none */
+const char *xsec_core_error(const xsec_core *core);
+int         xsec_core_error_code(const xsec_core *core);
+
+/* trusts the certificates in dir too, a directory hashed by "openssl rehash" (since 1.1) */
+int xsec_core_set_ca_dir(xsec_core *core, const char *dir);
+
+/* bounds every call on core from now on, 0 (the default) is no bound (since 1.3) */
+int xsec_core_set_limit(xsec_core *core, xsec_limit limit, uint64_t value);
+
+/* copies the result kept after XSEC_ERR_BUFFER to out and releases it,
+ * XSEC_ERR_BUFFER again if cap is still too small */
+int xsec_core_take_result(xsec_core *core, char *out, size_t cap, size_t *out_len);
+
+/* password may be NULL. Raw secrets loaded from a file are named after the file,
+ * like the files given to the xsec tool, others have no name until xsec_key_set_name().
+ * The library stays initialized as long as the key exists, even without a core */
+int  xsec_key_load_file(xsec_core *core, const char *path, xsec_key_format format, const char *password,
+                        xsec_key **key);
+int  xsec_key_load_memory(xsec_core *core, const void *data, size_t len, xsec_key_format format,
+                          const char *password, xsec_key **key);
+/* the name used in KeyName, only change it while the key isn't used */
+int  xsec_key_set_name(xsec_key *key, const char *name);
+/* profiles using the key keep it alive */
+void xsec_key_free(xsec_key *key);
+
+int  xsec_profile_new(xsec_op op, xsec_profile **profile);
+void xsec_profile_free(xsec_profile *profile);
+
+int xsec_profile_set_int(xsec_profile *profile, xsec_option option, int value);
+/* base url to resolve relative references of the document against, NULL for none */
+int xsec_profile_set_base_url(xsec_profile *profile, const char *url);
+/* the signing, verifying or decrypting key, for encrypt the first recipient */
+int xsec_profile_set_key(xsec_profile *profile, xsec_key *key);
+/* encrypt: another recipient getting its own EncryptedKey */
+int xsec_profile_add_recipient(xsec_profile *profile, xsec_key *key);
+/* encrypt, decrypt: the key wrapping the session key for XSEC_KT_AES*_KW, it needs a name */
+int xsec_profile_set_kek(xsec_profile *profile, xsec_key *key);
+/* sign: a reference to uri ("" is the whole document), hash and transform may be XSEC_HA_UNSET / XSEC_C14N_UNSET */
+int xsec_profile_add_reference(xsec_profile *profile, const char *uri, int hash, int transform);
+/* encrypt: the nodes to encrypt instead of the root */
+int xsec_profile_add_xpath(xsec_profile *profile, const char *xpath);
+
+/* runs the operation of profile on len bytes of doc. The result is written to out, which has cap bytes,
+ * *out_len is set to its length. verify writes nothing, out may be NULL there */
+int xsec_run(xsec_core *core, const xsec_profile *profile, const char *doc, size_t len,
+             char *out, size_t cap, size_t *out_len);
+
+/* like xsec_run, but gives the result to write as it is produced */
+int xsec_run_cb(xsec_core *core, const xsec_profile *profile, const char *doc, size_t len,
+                xsec_write_fn write, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#include "xseccore.hpp"
+#include "xseccertcache.hpp"
+#include "xsecmetrics.hpp"
+
+namespace XSec {
+
+#include <openssl/evp.h>
+
+
+CertCache::CertCache(size_t max_entries)
+		: max_entries( max_entries ) {
+}
+
+CertCache::~CertCache() {
+	clear();
+}
+
+X509 *
+CertCache::get(const std::string &der) {
+	unsigned char md[EVP_MAX_MD_SIZE];
+	unsigned int md_len = 0;
+	if( der.empty() || !EVP_Digest( der.data(), der.size(), md, &md_len, EVP_sha256(), nullptr ))
+		return nullptr;
+	std::string digest( (const char *) md, md_len );
+
+	{
+		std::lock_guard<std::mutex> guard( lock );
+		auto it = index.find( digest );
+		if( it != index.end() && X509_up_ref( it->second->cert )) {
+			entries.splice( entries.begin(), entries, it->second );
+			metrics_cache( true );
+			return it->second->cert;
+		}
+	}
+	metrics_cache( false );
+
+	// parsed outside of the lock, another thread may do the same meanwhile, the first one is kept then
+	auto p = (const unsigned char *) der.data();
+	X509 *cert = d2i_X509( nullptr, &p, der.size() );
+	if( cert == nullptr || max_entries == 0 )
+		return cert;
+
+	std::lock_guard<std::mutex> guard( lock );
+	auto it = index.find( digest );
+	if( it != index.end() ) {
+		if( X509_up_ref( it->second->cert )) {
+			X509_free( cert );
+			return it->second->cert;
+		}
+		return cert;
+	}
+	if( !X509_up_ref( cert ))
+		return cert;
+
+	entries.push_front( Entry{ digest, cert } );
+	index[digest] = entries.begin();
+
+	while( entries.size() > max_entries ) {
+		index.erase( entries.back().digest );
+		X509_free( entries.back().cert );
+		entries.pop_back();
+	}
+	return cert;
+}
+
+void
+CertCache::clear() {
+	std::lock_guard<std::mutex> guard( lock );
+	for( auto &entry : entries )
+		X509_free( entry.cert );
+	index.clear();
+	entries.clear();
+}
+
+size_t
+CertCache::size() {
+	std::lock_guard<std::mutex> guard( lock );
+	return entries.size();
+}
+
+} // namespace XSec
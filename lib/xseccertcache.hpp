@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#ifndef XSEC_CERTCACHE_H
+#define XSEC_CERTCACHE_H
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+
+namespace XSec {
+
+#include <openssl/x509.h>
+
+/* certificates embedded into signatures, parsed once, given to a Core with set_cert_cache().
+ * Verifying another document that carries one of them takes it from here instead of decoding
+ * the certificate and importing its public key again, which is most of the cost of reading it.
+ * One cache may be shared by Cores on different threads, the certificates are only read.
+ *
+ * entries are keyed by the sha256 of the DER encoding, so they never go stale, the least recently
+ * used one is dropped when max_entries are held. Whether a certificate is to be trusted is
+ * decided on every call, see ChainCache to skip that as well. */
+class CertCache {
+public:
+	explicit CertCache(size_t max_entries = 64);
+	~CertCache();
+
+	CertCache(const CertCache &) = delete;
+	CertCache &operator=(const CertCache &) = delete;
+
+	/* the certificate with the DER encoding der, parsed the first time, nullptr if it doesn't parse.
+	 * The caller owns a reference and has to X509_free() it, counts a cache hit or miss in the metrics */
+	X509 *
+	get(const std::string &der);
+
+	void
+	clear();
+
+	size_t
+	size();
+
+private:
+	struct Entry {
+		std::string digest;
+		X509       *cert;
+	};
+
+	size_t     max_entries;
+	std::mutex lock;
+	std::list<Entry> entries; // most recently used first
+	std::unordered_map<std::string, std::list<Entry>::iterator> index;
+};
+
+} // namespace XSec
+#endif
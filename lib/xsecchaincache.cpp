@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#include <chrono>
+
+#include "xseccore.hpp"
+#include "xsecchaincache.hpp"
+#include "xsecmetrics.hpp"
+
+namespace XSec {
+
+
+static uint64_t now_ns() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ChainCache::ChainCache(size_t max_entries, unsigned ttl_seconds)
+		: max_entries( max_entries ), ttl_ns( ttl_seconds * 1000000000ull ) {
+}
+
+bool
+ChainCache::lookup(const std::vector<std::string> &fingerprints, const std::string &generation, std::string &validated) {
+	if( fingerprints.empty() )
+		return false;
+
+	std::lock_guard<std::mutex> guard( lock );
+	auto now = now_ns();
+	for( auto &fingerprint : fingerprints ) {
+		auto it = index.find( fingerprint + generation );
+		if( it == index.end() )
+			continue;
+		if( it->second->expires_ns <= now ) {
+			entries.erase( it->second );
+			index.erase( it );
+			continue;
+		}
+
+		entries.splice( entries.begin(), entries, it->second );
+		validated = fingerprint;
+		metrics_cache( true );
+		return true;
+	}
+
+	metrics_cache( false );
+	return false;
+}
+
+void
+ChainCache::store(const std::string &fingerprint, const std::string &generation, int64_t lifetime_seconds) {
+	if( max_entries == 0 || fingerprint.empty() || lifetime_seconds <= 0 )
+		return;
+
+	uint64_t lifetime_ns = ttl_ns;
+	if( (uint64_t) lifetime_seconds < ttl_ns / 1000000000ull )
+		lifetime_ns = lifetime_seconds * 1000000000ull;
+
+	// the fingerprint has a fixed size, the generation can simply follow it
+	auto key = fingerprint + generation;
+	std::lock_guard<std::mutex> guard( lock );
+	auto it = index.find( key );
+	if( it != index.end() ) {
+		entries.erase( it->second );
+		index.erase( it );
+	}
+
+	entries.push_front( Entry{ key, now_ns() + lifetime_ns } );
+	index[key] = entries.begin();
+
+	while( entries.size() > max_entries ) {
+		index.erase( entries.back().key );
+		entries.pop_back();
+	}
+}
+
+void
+ChainCache::clear() {
+	std::lock_guard<std::mutex> guard( lock );
+	index.clear();
+	entries.clear();
+}
+
+size_t
+ChainCache::size() {
+	std::lock_guard<std::mutex> guard( lock );
+	return entries.size();
+}
+
+} // namespace XSec
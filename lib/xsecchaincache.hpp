@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#ifndef XSEC_CHAINCACHE_H
+#define XSEC_CHAINCACHE_H
+
+#include <stdint.h>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace XSec {
+
+/* remembers certificates embedded into signatures whose chain a Core validated, given to a Core with
+ * set_chain_cache(). Verifying another document signed with one of them then takes its key without
+ * building the chain and checking the signatures on the certificates again.
+ * One cache may be shared by Cores on different threads.
+ *
+ * entries are keyed by the sha256 fingerprint of the certificate and the trust generation of the Core,
+ * which changes with every certificate or directory it is told to trust. They expire when the first
+ * certificate of the chain does or after ttl_seconds, whichever comes first, so revocations and changes
+ * to the files in a CA directory are noticed eventually. The least recently used one is dropped when
+ * max_entries are held. */
+class ChainCache {
+public:
+	explicit ChainCache(size_t max_entries = 256, unsigned ttl_seconds = 600);
+
+	ChainCache(const ChainCache &) = delete;
+	ChainCache &operator=(const ChainCache &) = delete;
+
+	/* true and validated set to the first of fingerprints whose chain was validated against
+	 * the trust generation before, counts a cache hit or miss in the metrics */
+	bool
+	lookup(const std::vector<std::string> &fingerprints, const std::string &generation, std::string &validated);
+
+	/* remembers a validated chain for at most lifetime_seconds, the time left until its first certificate expires */
+	void
+	store(const std::string &fingerprint, const std::string &generation, int64_t lifetime_seconds);
+
+	void
+	clear();
+
+	size_t
+	size();
+
+private:
+	struct Entry {
+		std::string key;
+		uint64_t    expires_ns; // steady clock
+	};
+
+	size_t   max_entries;
+	uint64_t ttl_ns;
+	std::mutex lock;
+	std::list<Entry> entries; // most recently used first
+	std::unordered_map<std::string, std::list<Entry>::iterator> index;
+};
+
+} // namespace XSec
+#endif
@@ -20,14 +20,33 @@
  * THE SOFTWARE.
 */
 
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
 #include "xseccore.hpp"
+#include "xsecbase64.hpp"
+#include "xsecc14n.hpp"
+#include "xsecwriter.hpp"
+#include "xseckey.hpp"
+#include "xseckeycache.hpp"
+#include "xsecverifycache.hpp"
+#include "xsecchaincache.hpp"
+#include "xseccertcache.hpp"
+#include "xseccrlstore.hpp"
+#include "xsectrace.hpp"
+#include "xsecmetrics.hpp"
 
 namespace XSec {
 
 #include <libxml/tree.h>
 #include <libxml/xmlmemory.h>
 #include <libxml/parser.h>
+#include <libxml/parserInternals.h>
 #include <libxml/uri.h>
 
 #include <libxslt/xslt.h>
@@ -43,21 +62,581 @@ namespace XSec {
 #include <xmlsec/errors.h>
 
 #include <openssl/evp.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+#include <xmlsec/openssl/evp.h>
+#include <xmlsec/openssl/x509.h>
+
+
+// name under which a key encryption key is stored, both sides must agree on it
+static std::string key_file_name(const std::string &path) {
+	auto pos = path.find_last_of("/\\");
+	if( pos == std::string::npos )
+		return path;
+	return path.substr( pos + 1 );
+}
+
+// registers every attribute below doc matching one of names (namespace uri, local name) as ID in one pass,
+// so Reference and RetrievalMethod URIs like "#key0" are looked up in the ID table without a DTD.
+// A value used more than once is taken out again and appended to duplicates, it may not point at either one
+static void register_ids(xmlDocPtr doc, const std::vector<std::pair<std::string, std::string>> &names,
+                         std::vector<std::string> &duplicates) {
+	std::vector<xmlAttrPtr> attrs;
+	auto root = xmlDocGetRootElement( doc );
+	for( auto cur = root; cur != nullptr; ) {
+		for( auto attr = cur->type == XML_ELEMENT_NODE ? cur->properties : nullptr; attr != nullptr; attr = attr->next ) {
+			if( attr->children == nullptr || attr->atype == XML_ATTRIBUTE_ID )
+				continue;
+			for( auto &name : names ) {
+				if( xmlStrEqual( attr->name, BAD_CAST name.second.c_str() )
+				    && ( attr->ns == nullptr ? name.first.empty() : xmlStrEqual( attr->ns->href, BAD_CAST name.first.c_str() ))) {
+					attrs.push_back( attr );
+					break;
+				}
+			}
+		}
+
+		// the next node in document order
+		if( cur->type == XML_ELEMENT_NODE && cur->children != nullptr ) {
+			cur = cur->children;
+			continue;
+		}
+		while( cur != root && cur->next == nullptr )
+			cur = cur->parent;
+		cur = cur != root ? cur->next : nullptr;
+	}
+	if( attrs.empty() )
+		return;
 
+	// libxml2 starts the table small and grows it late, long chains of values to compare with many IDs
+	if( doc->ids == nullptr )
+		doc->ids = xmlHashCreateDict( (int) std::min( attrs.size() * 2, (size_t) INT_MAX ), doc->dict );
+
+	for( auto attr : attrs ) {
+		// the value is copied only if it's made of entities and such
+		bool plain = attr->children->type == XML_TEXT_NODE && attr->children->next == nullptr;
+		auto value = plain ? attr->children->content : xmlNodeListGetString( doc, attr->children, 1 );
+		if( value == nullptr )
+			continue;
+
+		// adding fails for a value that is there already, it's looked up only then
+		bool seen = !duplicates.empty() && std::find( duplicates.begin(), duplicates.end(), (const char *) value ) != duplicates.end();
+		if( !seen && xmlAddID( nullptr, doc, value, attr ) == nullptr ) {
+			auto other = xmlGetID( doc, value );
+			if( other != nullptr ) {
+				xmlRemoveID( doc, (xmlAttrPtr) other );
+				duplicates.push_back( (const char *) value );
+			}
+		}
+		if( !plain )
+			xmlFree( value );
+	}
+}
 
+// hex encoded sha256 of the public key, the same for pem, certificate and p12 of one key pair
+static std::string key_fingerprint(xmlSecKeyPtr key) {
+	if( xmlSecKeyGetValue( key ) == nullptr )
+		return std::string();
+
+	auto evp = xmlSecOpenSSLEvpKeyDataGetEvp( xmlSecKeyGetValue( key ));
+	if( evp == nullptr )
+		return std::string();
+
+	unsigned char *der = nullptr;
+	int der_len = i2d_PUBKEY( evp, &der );
+	if( der_len <= 0 )
+		return std::string();
+
+	unsigned char md[EVP_MAX_MD_SIZE];
+	unsigned int md_len = 0;
+	int ok = EVP_Digest( der, der_len, md, &md_len, EVP_sha256(), nullptr );
+	OPENSSL_free( der );
+	if( !ok )
+		return std::string();
+
+	static const char hex[] = "0123456789abcdef";
+	std::string fp;
+	for( unsigned int i = 0; i < md_len; i++ ) {
+		fp += hex[md[i] >> 4];
+		fp += hex[md[i] & 0x0f];
+	}
+	return fp;
+}
 
-#define PEM_BOUNDARY_FORMAT "-----BEGIN CERTIFICATE-----\n%s\n-----END CERTIFICATE-----\n"
-#define PEM_BOUNDARY_SIZE sizeof(PEM_BOUNDARY_FORMAT)
+// the KeyName in the KeyInfo of encKey, empty if there's none
+static std::string encrypted_key_name(xmlNodePtr encKey) {
+	auto keyInfo = xmlSecFindChild( encKey, xmlSecNodeKeyInfo, xmlSecDSigNs );
+	auto keyName = keyInfo != nullptr ? xmlSecFindChild( keyInfo, xmlSecNodeKeyName, xmlSecDSigNs ) : nullptr;
+	auto value = keyName != nullptr ? xmlNodeGetContent( keyName ) : nullptr;
+	std::string name = value != nullptr ? (const char *) value : "";
+	xmlFree( value );
+	return name;
+}
 
-Core::Core() {
+// the EncryptedKey a RetrievalMethod points to by a same document URI like "#key0", nullptr if it's no such one
+static xmlNodePtr retrieved_encrypted_key(xmlNodePtr retrieval) {
+	auto uri = xmlGetProp( retrieval, xmlSecAttrURI );
+	auto attr = uri != nullptr && uri[0] == '#' ? xmlGetID( retrieval->doc, uri + 1 ) : nullptr;
+	xmlFree( uri );
+	auto target = attr != nullptr ? attr->parent : nullptr;
+	return target != nullptr && xmlSecCheckNodeName( target, xmlSecNodeEncryptedKey, xmlSecEncNs ) ? target : nullptr;
+}
+
+// xmlsec tries the key on every EncryptedKey in the KeyInfo of encData, in it or retrieved from elsewhere,
+// failing with errors on those of other recipients. If one carries name, the others and the RetrievalMethods
+// to them are removed, encData is replaced by what it holds anyway
+static void drop_other_recipients(xmlNodePtr encData, const std::string &name) {
+	auto keyInfo = xmlSecFindChild( encData, xmlSecNodeKeyInfo, xmlSecDSigNs );
+	std::vector<xmlNodePtr> others;
+	bool found = false;
+	for( auto cur = keyInfo != nullptr ? xmlSecGetNextElementNode( keyInfo->children ) : nullptr; cur != nullptr;
+	     cur = xmlSecGetNextElementNode( cur->next )) {
+		auto encKey = cur;
+		if( xmlSecCheckNodeName( cur, xmlSecNodeRetrievalMethod, xmlSecDSigNs ))
+			encKey = retrieved_encrypted_key( cur );
+		else if( !xmlSecCheckNodeName( cur, xmlSecNodeEncryptedKey, xmlSecEncNs ))
+			continue;
+		if( encKey == nullptr )
+			continue;
+		if( encrypted_key_name( encKey ) == name )
+			found = true;
+		else
+			others.push_back( cur );
+	}
+	if( !found )
+		return; // older documents name EncryptedKeys differently, all are tried then
+
+	for( auto cur : others ) {
+		xmlUnlinkNode( cur );
+		xmlFreeNode( cur );
+	}
+}
+
+// captures one of xmlsec's debug dumps for a TC_DUMP event
+template<typename Ctx>
+static std::string dump_to_string(void (*dump)(Ctx, FILE*), Ctx ctx) {
+	std::string out;
+	FILE *tmp = tmpfile();
+	if( tmp == nullptr )
+		return out;
+
+	dump( ctx, tmp );
+	long size = ftell( tmp );
+	if( size > 0 ) {
+		out.resize( size );
+		rewind( tmp );
+		out.resize( fread( &out[0], 1, size, tmp ) );
+	}
+	fclose( tmp );
+	return out;
+}
+
+// size of a document or result for the metrics, 0 if there is no such file
+static uint64_t file_size(const std::string &path) {
+	struct stat st;
+	return stat( path.c_str(), &st ) == 0 ? st.st_size : 0;
+}
+
+// path plus what changes with the file's content, empty if it can't be stat()ed
+static std::string file_identity(const std::string &path) {
+	struct stat st;
+	if( stat( path.c_str(), &st ) != 0 )
+		return std::string();
+	uint64_t mtime_ns = (uint64_t)st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec;
+	return path + '\n' + std::to_string( st.st_dev ) + ':' + std::to_string( st.st_ino ) + ':'
+	       + std::to_string( st.st_size ) + ':' + std::to_string( mtime_ns );
+}
+
+// whole file or stdin for "-", returns 0 or -1
+static int read_file(const char *path, std::string &out) {
+	bool is_stdin = strcmp( path, "-" ) == 0;
+	auto fp = is_stdin ? stdin : fopen( path, "rb" );
+	if( fp == nullptr )
+		return -1;
+
+	char buf[65536];
+	size_t n;
+	while(( n = fread( buf, 1, sizeof( buf ), fp )) > 0 )
+		out.append( buf, n );
+	bool failed = ferror( fp ) != 0;
+	if( !is_stdin )
+		fclose( fp );
+	return failed ? -1 : 0;
+}
+
+// a verify result only depends on the document itself if nothing in the signature points outside of it,
+// which covers Reference and RetrievalMethod
+static bool uris_internal(xmlNodePtr node) {
+	for( auto cur = node; cur != nullptr; cur = cur->next ) {
+		if( cur->type != XML_ELEMENT_NODE )
+			continue;
+		auto uri = xmlGetProp( cur, xmlSecAttrURI );
+		bool internal = uri == nullptr || uri[0] == '\0' || uri[0] == '#';
+		xmlFree( uri );
+		if( !internal || !uris_internal( cur->children ))
+			return false;
+	}
+	return true;
+}
+
+// the DER encoding of each certificate in the X509Data of the KeyInfo of signature, in order,
+// false if the KeyInfo holds anything else as well, like a KeyName or an X509CRL
+static bool embedded_certs(xmlNodePtr signature, std::vector<std::string> &ders) {
+	bool only_x509 = true;
+	auto key_info = xmlSecFindChild( signature, xmlSecNodeKeyInfo, xmlSecDSigNs );
+	for( auto data = key_info != nullptr ? key_info->children : nullptr; data != nullptr; data = data->next ) {
+		if( data->type != XML_ELEMENT_NODE )
+			continue;
+		if( !xmlSecCheckNodeName( data, xmlSecNodeX509Data, xmlSecDSigNs )) {
+			only_x509 = false;
+			continue;
+		}
 
+		for( auto cur = data->children; cur != nullptr; cur = cur->next ) {
+			if( cur->type != XML_ELEMENT_NODE )
+				continue;
+			if( !xmlSecCheckNodeName( cur, xmlSecNodeX509Certificate, xmlSecDSigNs )) {
+				only_x509 = false;
+				continue;
+			}
+
+			auto b64 = xmlNodeGetContent( cur );
+			if( b64 == nullptr )
+				continue;
+			auto b64_size = xmlStrlen( b64 );
+			std::string der( base64_decoded_size( b64_size ), '\0' );
+			auto der_size = base64_decode( (const char *) b64, b64_size, (unsigned char *) &der[0] );
+			xmlFree( b64 );
+			if( der_size > 0 ) {
+				der.resize( der_size );
+				ders.push_back( std::move( der ));
+			}
+		}
+	}
+	return only_x509;
+}
+
+// sha256 of each of the embedded certificates above, taken from the DER as it is,
+// parsing them is what xmlsec does once more afterwards
+static std::vector<std::string> cert_fingerprints(const std::vector<std::string> &ders) {
+	std::vector<std::string> fingerprints;
+	for( auto &der : ders ) {
+		unsigned char md[EVP_MAX_MD_SIZE];
+		unsigned int md_len = 0;
+		if( EVP_Digest( der.data(), der.size(), md, &md_len, EVP_sha256(), nullptr ))
+			fingerprints.emplace_back( (const char *) md, md_len );
+	}
+	return fingerprints;
+}
+
+// sha256 of the DER encoding of cert, the same as above
+static std::string cert_fingerprint(X509 *cert) {
+	unsigned char md[EVP_MAX_MD_SIZE];
+	unsigned int md_len = 0;
+	if( cert == nullptr || !X509_digest( cert, EVP_sha256(), md, &md_len ))
+		return std::string();
+	return std::string( (const char *) md, md_len );
+}
+
+// a key for the public key of cert, carrying cert and certs like one xmlsec read from X509Data
+static xmlSecKeyPtr cert_key(X509 *cert, STACK_OF(X509) *certs) {
+	auto key = xmlSecKeyCreate();
+	auto value = xmlSecOpenSSLX509CertGetKey( cert );
+	if( key == nullptr || value == nullptr || xmlSecKeySetValue( key, value ) < 0 ) {
+		if( value != nullptr )
+			xmlSecKeyDataDestroy( value );
+		if( key != nullptr )
+			xmlSecKeyDestroy( key );
+		return nullptr;
+	}
+
+	auto data = xmlSecKeyEnsureData( key, xmlSecOpenSSLKeyDataX509Id );
+	if( data == nullptr || !X509_up_ref( cert ) || xmlSecOpenSSLKeyDataX509AdoptKeyCert( data, cert ) < 0 ) {
+		xmlSecKeyDestroy( key );
+		return nullptr;
+	}
+	for( int i = 0; i < sk_X509_num( certs ); i++ ) {
+		auto other = sk_X509_value( certs, i );
+		if( X509_up_ref( other ) && xmlSecOpenSSLKeyDataX509AdoptCert( data, other ) < 0 )
+			X509_free( other );
+	}
+	return key;
+}
+
+// the certificates ders parsed, by cache if there is one, nullptr if one of them doesn't parse
+static STACK_OF(X509) *parse_certs(const std::vector<std::string> &ders, CertCache *cache) {
+	STACK_OF(X509) *certs = sk_X509_new_null();
+	for( size_t i = 0; certs != nullptr && i < ders.size(); i++ ) {
+		X509 *cert = nullptr;
+		if( cache != nullptr ) {
+			cert = cache->get( ders[i] );
+		} else {
+			auto p = (const unsigned char *) ders[i].data();
+			cert = d2i_X509( nullptr, &p, ders[i].size() );
+		}
+
+		if( cert == nullptr || !sk_X509_push( certs, cert )) {
+			X509_free( cert );
+			sk_X509_pop_free( certs, X509_free );
+			return nullptr; // xmlsec won't read the X509Data either
+		}
+	}
+	return certs;
+}
+
+// what xmlsec takes from X509Data holding the certificates ders, with them parsed by cache: the key of the first
+// leaf among them whose chain store validates, or of the one with the fingerprint validated if that was done before.
+// nullptr if there's none, xmlsec reads it once more then for its errors and last resort
+static xmlSecKeyPtr embedded_key(const std::vector<std::string> &ders, CertCache *cache, xmlSecKeyDataStorePtr store,
+                                 xmlSecKeyInfoCtxPtr ctx, const std::string &validated) {
+	auto certs = parse_certs( ders, cache );
+	if( certs == nullptr || store == nullptr ) {
+		sk_X509_pop_free( certs, X509_free );
+		return nullptr;
+	}
+
+	X509 *leaf = nullptr;
+	if( validated.empty() ) {
+		leaf = xmlSecOpenSSLX509StoreVerify( store, certs, nullptr, ctx );
+	}
+	else {
+		for( int i = 0; leaf == nullptr && i < sk_X509_num( certs ); i++ ) {
+			if( cert_fingerprint( sk_X509_value( certs, i )) == validated )
+				leaf = sk_X509_value( certs, i );
+		}
+	}
+
+	auto key = leaf != nullptr ? cert_key( leaf, certs ) : nullptr;
+	sk_X509_pop_free( certs, X509_free );
+	return key;
+}
+
+// what trusting a self-signed certificate means for embedded ones: the first of them is trusted,
+// but for this call only, in a store of its own instead of the keys manager that every later call shares.
+// Returns the key of the first leaf among them that chains up to it, like xmlsec picks the one it validates,
+// nullptr if there's none and the regular trust of the keys manager has to do
+static xmlSecKeyPtr embedded_trusted_key(xmlNodePtr signature, CertCache *cache) {
+	std::vector<std::string> ders;
+	xmlSecKeyPtr key = nullptr;
+	X509_STORE *anchor = X509_STORE_new();
+	STACK_OF(X509) *certs = nullptr;
+	X509_STORE_CTX *ctx = X509_STORE_CTX_new();
+
+	embedded_certs( signature, ders );
+	certs = parse_certs( ders, cache );
+	if( anchor == nullptr || certs == nullptr || ctx == nullptr || ders.empty() )
+		goto done;
+
+	if( !X509_STORE_add_cert( anchor, sk_X509_value( certs, 0 )))
+		goto done;
+
+	for( int i = 0; key == nullptr && i < sk_X509_num( certs ); i++ ) {
+		auto cert = sk_X509_value( certs, i );
+		bool leaf = true;
+		for( int j = 0; j < sk_X509_num( certs ); j++ ) {
+			if( j != i && X509_check_issued( cert, sk_X509_value( certs, j )) == X509_V_OK )
+				leaf = false;
+		}
+		if( !leaf || !X509_STORE_CTX_init( ctx, anchor, cert, certs ))
+			continue;
+		if( X509_verify_cert( ctx ) == 1 )
+			key = cert_key( cert, certs );
+		X509_STORE_CTX_cleanup( ctx );
+	}
+
+done:
+	X509_STORE_CTX_free( ctx );
+	sk_X509_pop_free( certs, X509_free );
+	X509_STORE_free( anchor );
+	return key;
+}
+
+// the certificate xmlsec took key from, it only does after validating its chain
+static X509 *key_cert(xmlSecKeyPtr key) {
+	auto data = key != nullptr ? xmlSecKeyGetData( key, xmlSecOpenSSLKeyDataX509Id ) : nullptr;
+	return data != nullptr ? xmlSecOpenSSLKeyDataX509GetKeyCert( data ) : nullptr;
+}
+
+// seconds until the key certificate of key or one of its issuers among the certificates read
+// along with it expires, as far as the chain can be followed in them
+static int64_t chain_lifetime(xmlSecKeyPtr key) {
+	auto data = xmlSecKeyGetData( key, xmlSecOpenSSLKeyDataX509Id );
+	auto cert = key_cert( key );
+	auto count = data != nullptr ? xmlSecOpenSSLKeyDataX509GetCertsSize( data ) : 0;
+
+	int64_t lifetime = INT64_MAX;
+	for( xmlSecSize n = 0; cert != nullptr && n <= count; n++ ) {
+		int days = 0, secs = 0;
+		if( !ASN1_TIME_diff( &days, &secs, nullptr, X509_get0_notAfter( cert )))
+			return 0;
+		lifetime = std::min( lifetime, (int64_t) days * 86400 + secs );
+		if( X509_check_issued( cert, cert ) == X509_V_OK )
+			break; // self-signed
+
+		X509 *issuer = nullptr;
+		for( xmlSecSize i = 0; i < count; i++ ) {
+			auto other = xmlSecOpenSSLKeyDataX509GetCert( data, i );
+			if( other != nullptr && X509_cmp( other, cert ) != 0 && X509_check_issued( other, cert ) == X509_V_OK )
+				issuer = other;
+		}
+		cert = issuer;
+	}
+	return lifetime;
+}
+
+// true if key was read from the KeyInfo of signature, a KeyValue or one of its certificates,
+// not one the keys manager had for a KeyName
+static bool key_from_document(xmlNodePtr signature, xmlSecKeyPtr key) {
+	if( key == nullptr )
+		return false;
+	if( xmlSecKeyGetName( key ) == nullptr )
+		return true;
+	std::vector<std::string> ders;
+	embedded_certs( signature, ders );
+	auto fps = cert_fingerprints( ders );
+	auto fp = cert_fingerprint( key_cert( key ));
+	return !fp.empty() && std::find( fps.begin(), fps.end(), fp ) != fps.end();
+}
+
+// the first of the certificates key came with which store lists as revoked
+static X509 *revoked_cert(CrlStore *store, xmlSecKeyPtr key) {
+	auto data = key != nullptr ? xmlSecKeyGetData( key, xmlSecOpenSSLKeyDataX509Id ) : nullptr;
+	if( store == nullptr || data == nullptr )
+		return nullptr;
+
+	if( store->revoked( xmlSecOpenSSLKeyDataX509GetKeyCert( data )))
+		return xmlSecOpenSSLKeyDataX509GetKeyCert( data );
+	for( xmlSecSize i = 0; i < xmlSecOpenSSLKeyDataX509GetCertsSize( data ); i++ ) {
+		if( store->revoked( xmlSecOpenSSLKeyDataX509GetCert( data, i )))
+			return xmlSecOpenSSLKeyDataX509GetCert( data, i );
+	}
+	return nullptr;
+}
+
+// one line subject of cert for messages
+static std::string cert_subject(X509 *cert) {
+	char buf[256];
+	if( X509_NAME_oneline( X509_get_subject_name( cert ), buf, sizeof( buf )) == nullptr )
+		return std::string();
+	return buf;
+}
+
+static uint64_t count_elements(xmlNodePtr node) {
+	uint64_t n = 0;
+	for( auto cur = node; cur != nullptr; cur = cur->next ) {
+		if( cur->type == XML_ELEMENT_NODE )
+			n += 1 + count_elements( cur->children );
+	}
+	return n;
+}
+
+// records what's left to know about a call once it's done, bytes_out is the size of its result
+static void metrics_finish(int result, xmlDocPtr doc, uint64_t bytes_out) {
+	if( !metrics_active() )
+		return;
+	if( doc != nullptr )
+		metrics_nodes( count_elements( doc->children ) );
+	if( result == 0 )
+		metrics_bytes_out( bytes_out );
+	metrics_end( result );
+}
+
+// name of a document or result for messages and traces
+static std::string source_name(const Source &src) {
+	return src.path != nullptr ? src.path : "(memory)";
+}
+
+static std::string sink_name(const Sink &sink) {
+	return sink.write != nullptr ? "(stream)" : sink.memory != nullptr ? "(memory)" : sink.path;
+}
+
+// counts what goes through the write function of a Sink
+typedef struct counted_write_t {
+	const Sink *sink;
+	uint64_t    bytes;
+} CountedWrite;
+
+static int counted_write(void *ctx, const char *data, size_t len) {
+	auto c = (CountedWrite *) ctx;
+	c->bytes += len;
+	return c->sink->write( c->sink->ctx, data, len );
+}
+
+// the start of xmlsec's xmlSecXPathData (xpath.c), a list of them follows the xmlSecTransform
+// of the XPath, XPath2 and XPointer transforms
+struct XPathData {
+	int                type;
+	xmlXPathContextPtr ctx;
+};
+
+// the XPathData list of transform, nullptr if it isn't one of those or not what it's expected to be in this xmlsec
+static xmlSecPtrListPtr xpath_data(xmlSecTransformPtr transform) {
+	if( transform->id != xmlSecTransformXPathId && transform->id != xmlSecTransformXPath2Id
+	    && transform->id != xmlSecTransformXPointerId )
+		return nullptr;
+	auto list = (xmlSecPtrListPtr)( (xmlSecByte *) transform + sizeof( xmlSecTransform ));
+	if( transform->id->objSize != sizeof( xmlSecTransform ) + sizeof( xmlSecPtrList )
+	    || !xmlStrEqual( xmlSecPtrListGetName( list ), BAD_CAST "xpath-data-list" ))
+		return nullptr;
+	return list;
+}
+
+// referencePreExecuteCallback, bounds the XPath transforms of a reference by the Limits in the userData of its signature
+static int limited_reference_transforms(xmlSecTransformCtxPtr ctx) {
+	auto refCtx = (xmlSecDSigReferenceCtxPtr)( (char *) ctx - offsetof( xmlSecDSigReferenceCtx, transformCtx ));
+	auto limits = (const Limits *) refCtx->dsigCtx->userData;
+
+	for( auto cur = ctx->first; limits != nullptr && limits->xpath_ops != 0 && cur != nullptr; cur = cur->next ) {
+		auto list = xpath_data( cur );
+		for( xmlSecSize i = 0; list != nullptr && i < xmlSecPtrListGetSize( list ); i++ ) {
+			auto data = (XPathData *) xmlSecPtrListGetItem( list, i );
+			if( data != nullptr && data->ctx != nullptr )
+				data->ctx->opLimit = limits->xpath_ops;
+		}
+	}
+	return c14n_replace_transforms( ctx );
+}
+
+// how the references of ctx are processed, limits has to outlive it
+static void prepare_references(xmlSecDSigCtxPtr ctx, const Limits &limits) {
+	ctx->referencePreExecuteCallback = limited_reference_transforms;
+	ctx->userData = (void *) &limits;
+}
+
+// if an XPath transform of the references of ctx ran out of Limits::xpath_ops, libxml2 only prints that.
+// The references stay with ctx until it is destroyed, their contexts are left with opCount at opLimit
+static bool xpath_ops_exceeded(xmlSecDSigCtxPtr ctx) {
+	auto refs = &ctx->signedInfoReferences;
+	for( xmlSecSize r = 0; r < xmlSecPtrListGetSize( refs ); r++ ) {
+		auto refCtx = (xmlSecDSigReferenceCtxPtr) xmlSecPtrListGetItem( refs, r );
+		for( auto cur = refCtx != nullptr ? refCtx->transformCtx.first : nullptr; cur != nullptr; cur = cur->next ) {
+			auto list = xpath_data( cur );
+			for( xmlSecSize i = 0; list != nullptr && i < xmlSecPtrListGetSize( list ); i++ ) {
+				auto data = (XPathData *) xmlSecPtrListGetItem( list, i );
+				if( data != nullptr && data->ctx != nullptr && data->ctx->opLimit != 0
+				    && data->ctx->opCount >= data->ctx->opLimit )
+					return true;
+			}
+		}
+	}
+	return false;
+}
+
+// libxml2, xslt, xmlsec and openssl are initialized once for all Cores of the process,
+// the first Core sets them up and the last one to go shuts them down again
+static std::mutex global_lock;
+static int        global_users = 0;
+static int        global_error = 0;
+static std::string global_error_msg;
+
+// set for the whole of a sign, verify, encrypt or decrypt on this thread, xmlsec's errors go to
+// serror_msg and the trace then instead of stderr
+static thread_local bool capture_errors = false;
+
+static int global_init(std::string &msg) {
 	xmlInitParser();
 	LIBXML_TEST_VERSION;
 
-	xmlLoadExtDtdDefaultValue = XML_DETECT_IDS | XML_COMPLETE_ATTRS;
-	xmlSubstituteEntitiesDefault( 1 );
-	xmlIndentTreeOutput = 1;
-
 	/* disable everything in xslt which might be harmful */
 	auto xsltSecPrefs = xsltNewSecurityPrefs();
 	xsltSetSecurityPrefs( xsltSecPrefs, XSLT_SECPREF_READ_FILE, xsltSecurityForbid );
@@ -68,62 +647,122 @@ Core::Core() {
 	xsltSetDefaultSecurityPrefs( xsltSecPrefs );
 
 	if( xmlSecInit() < 0 ) {
-		fprintf(stderr, "ERROR: xmlsec init failed!" );
-		return;
+		msg = "ERROR: xmlsec init failed!";
+		return -100;
 	}
 
 	if( xmlSecCheckVersion() != 1 ) {
-		fprintf(stderr, "ERROR: incompatible xmlsec library version" );
-		return;
+		msg = "ERROR: incompatible xmlsec library version";
+		return -100;
 	}
 
 #ifdef DISABLED
 	if( xmlSecCryptoDLLoadLibrary(BAD_CAST XMLSEC_CRYPTO) < 0 ){
-		fprintf(stderr, "Error: unable to load default xmlsec-crypto library. Make sure\n"
-										"that you have it installed and check shared libraries path\n"
-										"(LD_LIBRARY_PATH) envornment variable.\n");
-		return;
+		msg = "Error: unable to load default xmlsec-crypto library. Make sure\n"
+		      "that you have it installed and check shared libraries path\n"
+		      "(LD_LIBRARY_PATH) envornment variable.\n";
+		return -100;
 	}
 #endif
 
 	if( xmlSecCryptoAppInit( nullptr ) < 0 ) {
-		fprintf(stderr, "ERROR: crypto lib init failed!" );
-		return;
+		msg = "ERROR: crypto lib init failed!";
+		return -100;
 	}
 
 	if( xmlSecCryptoInit() < 0 ) {
-		fprintf(stderr, "ERROR: xmlsec-crypto init failed" );
-		return;
+		msg = "ERROR: xmlsec-crypto init failed";
+		return -100;
+	}
+
+	// the callback is process wide, which calls it captures for is decided per thread by capture_errors
+	xmlSecErrorsSetCallback( core_set_error );
+	return 0;
+}
+
+static void global_shutdown() {
+	xmlSecErrorsSetCallback( xmlSecErrorsDefaultCallback );
+	xmlSecCryptoShutdown();
+	xmlSecCryptoAppShutdown();
+	xmlSecShutdown();
+	xsltCleanupGlobals();
+	xmlCleanupParser();
+}
+
+Core::Core() {
+	error_code = 0;
+	mngr = nullptr;
+	trace_configure_env();
+
+	{
+		std::lock_guard<std::mutex> guard( global_lock );
+		if( global_users++ == 0 )
+			global_error = global_init( global_error_msg );
+		if( global_error != 0 ) {
+			xerror( global_error, global_error_msg );
+			return;
+		}
 	}
 
+	// these two are per thread in libxml2, so every Core sets them for the thread it is created on.
+	// Documents of calls are parsed by their ParseProfile, this is for what libxml2 and xmlsec parse themselves
+	xmlLoadExtDtdDefaultValue = XML_DETECT_IDS | XML_COMPLETE_ATTRS;
+	xmlSubstituteEntitiesDefault( 1 );
 
 	mngr = xmlSecKeysMngrCreate();
 	if( mngr == nullptr ) {
-		fprintf(stderr, "Error: failed to create keys manager.\n" );
+		xerror( -100, "Error: failed to create keys manager.\n" );
 		return;
 	}
 
 
-	// load default root certificates from system or bundled with crypto library
-	if( xmlSecCryptoAppDefaultKeysMngrInit( mngr ) < 0 ) {
-		fprintf(stderr, "Error: failed to initialize keys manager.\n" );
+	// just the store for named keys, reading the root certificates of the system takes longer than
+	// most calls, so load_trust_store() only does it for those that check certificates
+	auto keys_store = xmlSecKeyStoreCreate( xmlSecSimpleKeysStoreId );
+	if( keys_store == nullptr || xmlSecKeysMngrAdoptKeysStore( mngr, keys_store ) < 0 ) {
+		xerror( -100, "Error: failed to initialize keys manager.\n" );
+		if( keys_store != nullptr )
+			xmlSecKeyStoreDestroy( keys_store );
 		xmlSecKeysMngrDestroy( mngr );
+		mngr = nullptr;
 		return;
 	}
+	// what xmlSecCryptoAppDefaultKeysMngrInit() sets, looks keys up by KeyInfo and in the store
+	mngr->getKey = xmlSecKeysMngrGetKey;
 
 }
 
 Core::~Core() {
-	xmlSecKeysMngrDestroy( mngr );
-	xmlSecCryptoShutdown();
-	xmlSecCryptoAppShutdown();
-	xmlSecShutdown();
-	xsltCleanupGlobals();
-	xmlCleanupParser();
+	if( mngr != nullptr )
+		xmlSecKeysMngrDestroy( mngr );
+	if( dict != nullptr )
+		xmlDictFree( dict );
+
+	std::lock_guard<std::mutex> guard( global_lock );
+	if( --global_users == 0 ) {
+		global_shutdown();
+		global_error = 0;
+	}
 }
 
 int
 Core::sign(const std::string &document, std::string &result, const sign_options_t &options) {
+	Source src;
+	Sink   sink;
+	if( options.doc_in_memory ) {
+		src.data = document.data();
+		src.size = document.size();
+		sink.memory = &result;
+	}
+	else {
+		src.path = document.c_str();
+		sink.path = result.c_str();
+	}
+	return sign( src, sink, options );
+}
+
+int
+Core::sign(const Source &document, const Sink &result, const sign_options_t &options) {
 
 	xmlDocPtr doc = nullptr;
 	xmlNodePtr signNode = nullptr,
@@ -131,6 +770,10 @@ Core::sign(const std::string &document, std::string &result, const sign_options_
 
 	int format = options.format;
 	error_code = 0;
+	result_bytes = 0;
+	trace_category = TC_SIGN;
+	metrics_begin( MO_SIGN, options.metrics );
+	capture_errors = true;
 
 	if( format == SF_UNSET ) {
 		format = default_format;
@@ -147,6 +790,7 @@ Core::sign(const std::string &document, std::string &result, const sign_options_
 		sign_id = get_sign_id(options.sign_algorithm);
 	else
 		sign_id = get_sign_id(default_sign);
+	bool hmac = is_hmac( options.sign_algorithm != SA_UNSET ? options.sign_algorithm : default_sign );
 
 	xmlSecTransformId hash_id;
 	if( options.hash_algorithm != HA_UNSET)
@@ -161,26 +805,16 @@ Core::sign(const std::string &document, std::string &result, const sign_options_
 	}
 
 	if( format == SF_ENVELOPED ) { // SF_ENVELOPED
-		if( options.doc_in_memory ) {
-			doc = xmlReadMemory(
-					document.c_str(),
-					document.size(),
-					options.base_url.empty() ? "noname.xml" : options.base_url.c_str(),   /* base url */
-					nullptr, /* encoding */
-					0     /* parse options */
-			);
-
-			if(( doc == nullptr ) || ( xmlDocGetRootElement( doc ) == nullptr )) {
+		metrics_phase( MP_PARSE );
+		doc = parse_source( document, options.base_url, options.parse );
+		if( error_code == LIMIT_EXCEEDED )
+			goto done;
+		if(( doc == nullptr ) || ( xmlDocGetRootElement( doc ) == nullptr )) {
+			if( document.path == nullptr )
 				xerror( -1, "Error: unable to parse xml document.\n" );
-				goto done;
-			}
-		}
-		else {
-			doc = xmlParseFile( document.c_str());
-			if(( doc == nullptr ) || ( xmlDocGetRootElement( doc ) == nullptr )) {
-				xerror( -2, "Error: unable to parse file \"" + document + "\"\n" );
-				goto done;
-			}
+			else
+				xerror( -2, "Error: unable to parse file \"" + source_name( document ) + "\"\n" );
+			goto done;
 		}
 	} else {
 		// create new empty doc
@@ -192,6 +826,7 @@ Core::sign(const std::string &document, std::string &result, const sign_options_
 		}
 	}
 
+	metrics_phase( MP_TEMPLATE );
 	signNode = xmlSecTmplSignatureCreate( doc, c14n_id, sign_id, nullptr );
 	if( signNode == nullptr ) {
 		xerror( -3, "Error: failed to create signature template\n" );
@@ -210,9 +845,9 @@ Core::sign(const std::string &document, std::string &result, const sign_options_
 
 				auto refNode = xmlSecTmplSignatureAddReference(
 						signNode,
-						ref ? get_hash_id(ref->hash) : hash_id,
+						ref && ref->hash != HA_UNSET ? get_hash_id(ref->hash) : hash_id,
 						nullptr,
-						ref->uri.empty() ? BAD_CAST "" : BAD_CAST ref->uri.c_str(),
+						!ref || ref->uri.empty() ? BAD_CAST "" : BAD_CAST ref->uri.c_str(),
 						nullptr );
 				if( !refNode ) {
 					xerror(-4, "Adding Reference failed!" );
@@ -328,34 +963,40 @@ Core::sign(const std::string &document, std::string &result, const sign_options_
 				auto objNode = xmlSecTmplSignatureAddObject( signNode, BAD_CAST newid.c_str(), nullptr, nullptr);
 				if( !objNode ) {
 					if(default_ref)	delete default_ref;
-					xmlFreeNode(refNode);
 					xerror(-6, "Adding Object failed!");
 					goto done;
 				}
 
 				// load uri and create an object from it
-				auto refdoc = xmlParseFile( ref->uri.c_str() );
+				metrics_phase( MP_PARSE );
+				Source refsrc;
+				refsrc.path = ref->uri.c_str();
+				auto refdoc = parse_document( refsrc, std::string(), options.parse );
+				metrics_phase( MP_TEMPLATE );
+				// refNode and objNode are linked into signNode already, doc frees them in done
 				if( !refdoc ) {
 					if(default_ref)	delete default_ref;
-					xmlFreeNode(refNode);
-					xmlFreeNode(objNode);
-					xerror(-6, "Parsing Object " +ref->uri+ " failed!");
+					if( error_code != LIMIT_EXCEEDED )
+						xerror(-6, "Parsing Object " +ref->uri+ " failed!");
 					goto done;
 				}
 				auto refroot = xmlDocGetRootElement(refdoc);
-				if( !refdoc ) {
+				if( !refroot ) {
 					if(default_ref)	delete default_ref;
-					xmlFreeNode(refNode);
-					xmlFreeNode(objNode);
 					xmlFreeDoc(refdoc);
 					xerror(-6, "Unable to find root of Object " +ref->uri+ " failed!");
 					goto done;
 				}
 
-				xmlUnlinkNode( refroot );
-				xmlAddChild( objNode, refroot );
-
+				// copied, the names of refdoc may live in a dictionary doc doesn't have
+				auto objroot = xmlDocCopyNode( refroot, doc, 1 );
 				xmlFreeDoc(refdoc);
+				if( objroot == nullptr ) {
+					if(default_ref)	delete default_ref;
+					xerror(-6, "Copying Object " +ref->uri+ " failed!");
+					goto done;
+				}
+				xmlAddChild( objNode, objroot );
 
 				counter++;
 			}
@@ -426,25 +1067,49 @@ Core::sign(const std::string &document, std::string &result, const sign_options_
 		goto done;
 	}
 
-	if( options.private_key.empty()) {
+	if( options.key == nullptr && hmac && options.secret_key.empty()) {
+		xerror( -21, "Signing with HMAC requires a secret key! None given!" );
+		goto done;
+	}
+	else if( options.key == nullptr && !hmac && options.private_key.empty()) {
 		xerror( -20, "Signing requires a private key! None given!" );
 		goto done;
 	}
 
 
-	//FIXME: for DEBUG
-	dsigCtx->flags |= XMLSEC_DSIG_FLAGS_STORE_SIGNEDINFO_REFERENCES;
+	// c14n output is streamed through the digest of each reference in chunks,
+	// storing the references puts a buffer holding all of it in between, so only do it if asked to
+	if( options.store_references )
+		dsigCtx->flags |= XMLSEC_DSIG_FLAGS_STORE_SIGNEDINFO_REFERENCES;
 
-	if( !options.keys_in_p12 ) {
-		dsigCtx->signKey = xmlSecCryptoAppKeyLoad( options.private_key.c_str(), xmlSecKeyDataFormatPem,
-		                                           options.key_password.empty() ? nullptr : options.key_password.c_str(),
-		                                           nullptr, nullptr );
+	// libxml2 walks the whole document for every reference to a part of it otherwise
+	prepare_references( dsigCtx, limits );
+
+	metrics_phase( MP_KEYS );
+	if( options.key != nullptr ) {
+		dsigCtx->signKey = options.key->copy();
+		if( !dsigCtx->signKey ) {
+			xerror( -30, "Could not copy the given key\n" );
+			goto done;
+		}
+	}
+	else if( hmac ) {
+		dsigCtx->signKey = xmlSecKeyReadBinaryFile( xmlSecKeyDataHmacId, options.secret_key.c_str());
+		if( !dsigCtx->signKey ) {
+			xerror( -30, "Could not load secret key from \"" + options.secret_key + "\"\n" );
+			goto done;
+		}
+		if( xmlSecKeySetName( dsigCtx->signKey, BAD_CAST key_file_name( options.secret_key ).c_str()) < 0 ) {
+			xerror( -34, "Error: failed to set key name for secret key\n" );
+			goto done;
+		}
+	}
+	else if( !options.keys_in_p12 ) {
+		dsigCtx->signKey = load_key( options.private_key, xmlSecKeyDataFormatPem, options.key_password );
 
 	}
 	else {
-		dsigCtx->signKey = xmlSecCryptoAppKeyLoad( options.private_key.c_str(), xmlSecKeyDataFormatPkcs12,
-		                                           options.key_password.empty() ? nullptr : options.key_password.c_str(),
-		                                           nullptr, nullptr );
+		dsigCtx->signKey = load_key( options.private_key, xmlSecKeyDataFormatPkcs12, options.key_password );
 		// certificate is read automatically if one is inside the p12!
 	}
 	if( !dsigCtx->signKey ) {
@@ -452,7 +1117,14 @@ Core::sign(const std::string &document, std::string &result, const sign_options_
 		goto done;
 	}
 
-	if( options.public_key_is_cert && !options.public_key.empty()) {
+	if( hmac ) {
+		// the shared secret must never be embedded, the verifier looks it up by name
+		if( xmlSecTmplKeyInfoAddKeyName( keyInfoNode, nullptr ) == nullptr ) {
+			xerror( -35, "Error: failed to add KeyName node\n" );
+			goto done;
+		}
+	}
+	else if( options.public_key_is_cert && !options.public_key.empty()) {
 		/* load certificate and add to the key */
 		if( xmlSecCryptoAppKeyCertLoad( dsigCtx->signKey, options.public_key.c_str(), xmlSecKeyDataFormatPem ) < 0 ) {
 			xerror( -31, "Error: failed to load pem certificate \"" + options.public_key + "\"\n" );
@@ -465,7 +1137,7 @@ Core::sign(const std::string &document, std::string &result, const sign_options_
 			goto done;
 		}
 	}
-	else if( options.keys_in_p12 ){
+	else if( options.keys_in_p12 || (options.key != nullptr && options.public_key_is_cert) ){
 		// a certificate should have been loaded automatically in this case, so add it to the signature!
 
 		/* create X509Data in KeyInfo */
@@ -474,7 +1146,7 @@ Core::sign(const std::string &document, std::string &result, const sign_options_
 			goto done;
 		}
 	}
-	else if( !options.public_key.empty()) {
+	else if( !options.public_key.empty() || options.key != nullptr ) {
 		// embed the public key!
 		auto keyValueNode = xmlSecTmplKeyInfoAddKeyValue(keyInfoNode);
 		if(keyValueNode == nullptr) {
@@ -486,75 +1158,113 @@ Core::sign(const std::string &document, std::string &result, const sign_options_
 		//XTODO: public key empty, what now?
 	}
 
-	//TODO: DEBUG:
-	xmlDocDump(stderr, doc);
-
-	if( xmlSecDSigCtxSign( dsigCtx, signNode ) < 0 ) {
-		xerror( -90, "Error: signing failed\n" );
-		goto done;
+	if( XSEC_TRACE_ON( TL_DEBUG, TC_DUMP ) ) {
+		std::string dump;
+		save_document_memory( doc, OF_COMPACT, dump );
+		XSEC_TRACE( TL_DEBUG, TC_DUMP, "sign.template", { {"document", dump} } );
 	}
 
-	if( options.doc_in_memory ) {
-		xmlChar *xbuff;
-		int buffsize;
-
-		xmlDocDumpFormatMemory( doc, &xbuff, &buffsize, 1 );
-		result = std::string((char *) xbuff, buffsize );
+	if( check_signature_limits( signNode ) != 0 )
+		goto done;
 
-		xmlFree( xbuff );
+	metrics_phase( MP_CRYPTO );
+	if( xmlSecDSigCtxSign( dsigCtx, signNode ) < 0 ) {
+		if( limits.xpath_ops != 0 && xpath_ops_exceeded( dsigCtx ) )
+			xerror( LIMIT_EXCEEDED, "Error: a transform exceeds the limit xpath_ops\n" );
+		else
+			xerror( -90, "Error: signing failed\n" );
 		goto done;
 	}
-	else {
-		if( xmlSaveFile( result.c_str(), doc ) < 0 ) {
-			xerror( -80, "Error while writing file to " + result + "\n" );
-			goto done;
-		}
-
-		//FIXME DEBUG:
-		xmlSecDSigCtxDebugDump( dsigCtx, stdout);
 
-		goto done;
+	if( XSEC_TRACE_ON( TL_DEBUG, TC_DUMP ) ) {
+		XSEC_TRACE( TL_DEBUG, TC_DUMP, "sign.context", { {"context", dump_to_string( xmlSecDSigCtxDebugDump, dsigCtx )} } );
 	}
 
+	/* written compact, indenting would invalidate the signature */
+	metrics_phase( MP_SERIALIZE );
+	write_result( doc, OF_COMPACT, result );
+
 
 done:
+	XSEC_TRACE( TL_INFO, TC_SIGN, "sign", { {"document", source_name( document )},
+	                                        {"format", format}, {"result", error_code} } );
+	metrics_finish( error_code, doc, result_bytes );
+
 	if( dsigCtx )
 		xmlSecDSigCtxDestroy( dsigCtx );
 
 	if( doc )
 		xmlFreeDoc( doc );
 
+	capture_errors = false;
 	return error_code;
 }
 
 int Core::verify(const std::string &document, bool &result, const verify_options_t &options) {
+	Source src;
+	if( options.doc_in_memory ) {
+		src.data = document.data();
+		src.size = document.size();
+	}
+	else {
+		src.path = document.c_str();
+	}
+	return verify( src, result, options );
+}
+
+int Core::verify(const Source &document, bool &result, const verify_options_t &options) {
 
 	error_code = 0;
+	trace_category = TC_VERIFY;
+	metrics_begin( MO_VERIFY, options.metrics );
+	capture_errors = true;
 
 	xmlDocPtr doc = nullptr;
 	xmlNodePtr node = nullptr;
 	xmlSecDSigCtxPtr dsigCtx = nullptr;
 
-	if( options.doc_in_memory ) {
-		doc = xmlReadMemory(
-				document.c_str(),
-				document.size(),
-				options.base_url.empty() ? "noname.xml" : options.base_url.c_str(),   /* base url */
-				nullptr, /* encoding */
-				0     /* parse options */
-		);
+	Source src = document;
+	std::string file_data, cache_digest, base_url = options.base_url;
+	bool cached = false, cached_valid = false;
+	std::vector<std::string> cert_ders, cert_fps;
+	std::string leaf_fp;
+	bool chain_cached = false;
+	ParseProfile profile = options.parse;
+
+	metrics_phase( MP_PARSE );
+	if( verify_cache != nullptr ) {
+		// the cache is keyed by the bytes of the document, so a file is read first and parsed from memory
+		if( src.path != nullptr && read_file( src.path, file_data ) == 0 ) {
+			src.path = nullptr;
+			src.data = file_data.data();
+			src.size = file_data.size();
+			if( base_url.empty() )
+				base_url = document.path; // like xmlParseFile() would set it
+			if( profile.dtd == PD_UNSET )
+				profile.dtd = PD_LOAD; // and with the DTD of a file
+		}
 
-		if(( doc == nullptr ) || ( xmlDocGetRootElement( doc ) == nullptr )) {
-			xerror( -1, "Error: unable to parse xml document.\n" );
+		auto context = src.path == nullptr ? verify_context( options, profile ) : std::string();
+		if( !context.empty() )
+			cache_digest = VerifyCache::digest( src.data, src.size, context );
+		if( !cache_digest.empty() )
+			cached = verify_cache->lookup( cache_digest, cached_valid );
+		if( cached && verify_cache->mode() == VCM_USE ) {
+			metrics_bytes_in( src.size );
+			result = cached_valid;
 			goto done;
 		}
 	}
-	else {
-		doc = xmlParseFile( document.c_str());
-		if(( doc == nullptr ) || ( xmlDocGetRootElement( doc ) == nullptr )) {
-			xerror( -2, "Error: unable to parse file \"" + document + "\"\n" );
-			goto done;
-		}
+
+	doc = parse_source( src, base_url, profile );
+	if( error_code == LIMIT_EXCEEDED )
+		goto done;
+	if(( doc == nullptr ) || ( xmlDocGetRootElement( doc ) == nullptr )) {
+		if( document.path == nullptr )
+			xerror( -1, "Error: unable to parse xml document.\n" );
+		else
+			xerror( -2, "Error: unable to parse file \"" + source_name( document ) + "\"\n" );
+		goto done;
 	}
 
 	node = xmlSecFindNode(
@@ -565,14 +1275,39 @@ int Core::verify(const std::string &document, bool &result, const verify_options
 		xerror( -1, "ERROR: no signature found!" );
 		goto done;
 	}
+	if( check_signature_limits( node ) != 0 )
+		goto done;
+
+	metrics_phase( MP_KEYS );
+	if( options.key != nullptr ) {
+		dsigCtx = xmlSecDSigCtxCreate( nullptr );
+		if( dsigCtx )
+			dsigCtx->signKey = options.key->copy();
+		if( !dsigCtx || !dsigCtx->signKey ) {
+			xerror( -30, "Could not copy the given key\n" );
+			goto done;
+		}
+	}
+	else if( !options.secret_key.empty()) {
+		auto secret = xmlSecKeyReadBinaryFile( xmlSecKeyDataHmacId, options.secret_key.c_str());
+		if( !secret ) {
+			xerror( -30, "Could not load secret key from \"" + options.secret_key + "\"\n" );
+			goto done;
+		}
 
-	if( !options.public_key.empty()) {
+		// for this call only, a secret left in mngr would verify later calls that give none or another one
+		dsigCtx = xmlSecDSigCtxCreate( nullptr );
+		if( !dsigCtx ) {
+			xmlSecKeyDestroy( secret );
+			xerror( -10, "Verify Context creation failed!" );
+			goto done;
+		}
+		dsigCtx->signKey = secret;
+	}
+	else if( !options.public_key.empty()) {
 		if( !options.public_key_is_cert ) {
 			dsigCtx = xmlSecDSigCtxCreate( nullptr );
-			dsigCtx->signKey = xmlSecCryptoAppKeyLoad(
-					options.public_key.c_str(),
-					xmlSecKeyDataFormatPem,
-					nullptr, nullptr, nullptr );
+			dsigCtx->signKey = load_key( options.public_key, xmlSecKeyDataFormatPem, std::string() );
 			if( !dsigCtx->signKey ) {
 				xerror( -30, "Could not load public key from \"" + options.public_key + "\"\n" );
 				goto done;
@@ -580,65 +1315,102 @@ int Core::verify(const std::string &document, bool &result, const verify_options
 		}
 		else if( options.public_key_is_p12 ) {
 			//load public key from p12 somehow...
+			if( load_trust_store() != 0 )
+				goto done;
 			dsigCtx = xmlSecDSigCtxCreate( mngr );
 			if( options.trust_selfsigned_cert ) {
-				xmlSecCryptoAppKeysMngrCertLoad( mngr, options.public_key.c_str(), xmlSecKeyDataFormatPkcs12,
-				                                 xmlSecKeyDataTypeTrusted );
+				if( trust_changed( "trusted\n" + file_identity( options.public_key )))
+					xmlSecCryptoAppKeysMngrCertLoad( mngr, options.public_key.c_str(), xmlSecKeyDataFormatPkcs12,
+					                                 xmlSecKeyDataTypeTrusted );
 			} else {
-				xmlSecCryptoAppKeysMngrCertLoad( mngr, options.public_key.c_str(), xmlSecKeyDataFormatPkcs12,
-				                                 xmlSecKeyDataTypeUnknown );
+				if( trust_changed( "untrusted\n" + file_identity( options.public_key )))
+					xmlSecCryptoAppKeysMngrCertLoad( mngr, options.public_key.c_str(), xmlSecKeyDataFormatPkcs12,
+					                                 xmlSecKeyDataTypeUnknown );
 			}
 		}
 		else {
+			if( options.trust_selfsigned_cert && load_trust_store() != 0 )
+				goto done;
 			dsigCtx = xmlSecDSigCtxCreate( mngr );
 			if( options.trust_selfsigned_cert ) {
-				xmlSecCryptoAppKeysMngrCertLoad( mngr, options.public_key.c_str(), xmlSecKeyDataFormatCertPem,
-				                                 xmlSecKeyDataTypeTrusted );
+				if( trust_changed( "trusted\n" + file_identity( options.public_key )))
+					xmlSecCryptoAppKeysMngrCertLoad( mngr, options.public_key.c_str(), xmlSecKeyDataFormatCertPem,
+					                                 xmlSecKeyDataTypeTrusted );
 			}
 
-			dsigCtx->signKey = xmlSecCryptoAppKeyLoad(
-					options.public_key.c_str(),
-					xmlSecKeyDataFormatCertPem,
-					nullptr, nullptr, nullptr );
+			dsigCtx->signKey = load_key( options.public_key, xmlSecKeyDataFormatCertPem, std::string() );
 			xmlSecCryptoAppKeyCertLoad( dsigCtx->signKey, options.public_key.c_str(), xmlSecKeyDataFormatCertPem );
 		}
 	}
 	else {
+		// a key given as KeyValue or KeyName needs no trust store, embedded certificates do
+		if( options.trust_selfsigned_cert || xmlSecFindNode( node, xmlSecNodeX509Data, xmlSecDSigNs ) != nullptr ) {
+			if( load_trust_store() != 0 )
+				goto done;
+		}
 		dsigCtx = xmlSecDSigCtxCreate( mngr );
 		// when certificate is embedded, this works already.
-		// if certificate is self-signed, we need to add it as trusted to the key manager
+		// if certificate is self-signed, we need to trust it, for this document only
 		// do this only if explicitly wished!
-		if( options.trust_selfsigned_cert ){
-			auto keyInfo = xmlSecFindNode( node, xmlSecNodeKeyInfo, xmlSecDSigNs );
-			auto x509Data = xmlSecFindNode( keyInfo, xmlSecNodeKeyInfo, xmlSecDSigNs );
-			auto x509Cert = xmlSecFindNode( x509Data, xmlSecNodeX509Certificate, xmlSecDSigNs );
-			//auto x509Cert = xmlSecFindNode( node, xmlSecNodeX509Certificate, xmlSecDSigNs );
-
-			auto cert_raw = xmlNodeGetContent( x509Cert->children );
-			if(cert_raw == nullptr){
-				xerror(-120, "Could not allocate memory!!");
-				goto done;
-			}
-			// calc size, + nullbyte + size of PEM boundary
-			auto cert_pem_size = xmlStrlen(cert_raw) + PEM_BOUNDARY_SIZE;
-			auto cert_pem = (xmlChar *) xmlMalloc( cert_pem_size );
-			if(cert_pem == nullptr){
-				xerror(-120, "Could not allocate memory!!");
-				xmlFree(cert_raw);
-				goto done;
-			}
-			xmlStrPrintf(cert_pem, cert_pem_size, BAD_CAST PEM_BOUNDARY_FORMAT, cert_raw);
-			xmlFree(cert_raw); // free as soon as not needed anymore
+		if( options.trust_selfsigned_cert && dsigCtx != nullptr )
+			dsigCtx->signKey = embedded_trusted_key( node, cert_cache );
+	}
 
-			xmlSecCryptoAppKeysMngrCertLoadMemory( mngr, cert_pem, cert_pem_size, xmlSecKeyDataFormatCertPem, xmlSecKeyDataTypeTrusted );
+	if( dsigCtx == nullptr ) {
+		xerror( -120, "Could not allocate memory!!" );
+		goto done;
+	}
+	prepare_references( dsigCtx, limits );
 
-			xmlFree(cert_pem);
+	// an embedded certificate whose chain was validated before is taken as it is.
+	// None if the KeyInfo holds anything else, a key might be found by a KeyName without validating anything then
+	if( ( chain_cache != nullptr || cert_cache != nullptr ) && dsigCtx->signKey == nullptr
+	    && embedded_certs( node, cert_ders ) && !cert_ders.empty() ) {
+		if( chain_cache != nullptr ) {
+			cert_fps = cert_fingerprints( cert_ders );
+			chain_cached = chain_cache->lookup( cert_fps, trust_id, leaf_fp );
+		}
+		// the certificates parsed before are taken from the cert cache, xmlsec would parse them once more
+		if( cert_cache != nullptr ) {
+			dsigCtx->signKey = embedded_key( cert_ders, cert_cache, xmlSecKeysMngrGetDataStore( mngr, xmlSecOpenSSLX509StoreId ),
+			                                 &dsigCtx->keyInfoReadCtx, chain_cached ? leaf_fp : std::string() );
+			if( dsigCtx->signKey == nullptr )
+				chain_cached = false;
+		}
+		else if( chain_cached ) {
+			dsigCtx->keyInfoReadCtx.flags |= XMLSEC_KEYINFO_FLAGS_X509DATA_DONT_VERIFY_CERTS;
 		}
 	}
 
-	xmlSecErrorsSetCallback( core_set_error );
+	metrics_phase( MP_CRYPTO );
 	xmlSecDSigCtxVerify( dsigCtx, node );
-	xmlSecErrorsSetCallback( xmlSecErrorsDefaultCallback );
+	if( chain_cached && cert_fingerprint( key_cert( dsigCtx->signKey )) != leaf_fp ) {
+		// the key came from elsewhere, so nothing it depends on was validated, once more the regular way
+		chain_cached = false;
+		xmlSecDSigCtxDestroy( dsigCtx );
+		dsigCtx = xmlSecDSigCtxCreate( mngr );
+		if( dsigCtx != nullptr ) {
+			prepare_references( dsigCtx, limits );
+			xmlSecDSigCtxVerify( dsigCtx, node );
+		}
+	}
+
+	if( dsigCtx == nullptr ) {
+		xerror( -120, "Could not allocate memory!!" );
+		goto done;
+	}
+	// one that used up its ops exactly might have gone through
+	if( limits.xpath_ops != 0 && dsigCtx->status != xmlSecDSigStatusSucceeded && xpath_ops_exceeded( dsigCtx ) ) {
+		xerror( LIMIT_EXCEEDED, "Error: a transform exceeds the limit xpath_ops\n" );
+		goto done;
+	}
+	// remembered if the key is one of the embedded certificates, not one of the keys manager
+	// that had a KeyName or was the last resort
+	if( !chain_cached && !cert_fps.empty() && dsigCtx->signKey != nullptr && xmlSecKeyGetName( dsigCtx->signKey ) == nullptr ) {
+		leaf_fp = cert_fingerprint( key_cert( dsigCtx->signKey ));
+		if( std::find( cert_fps.begin(), cert_fps.end(), leaf_fp ) != cert_fps.end() )
+			chain_cache->store( leaf_fp, trust_id, chain_lifetime( dsigCtx->signKey ));
+	}
 
 	if( dsigCtx->status == xmlSecDSigStatusSucceeded ) {
 		result = true;
@@ -647,22 +1419,58 @@ int Core::verify(const std::string &document, bool &result, const verify_options
 		result = false;
 	}
 
+	if( result && crl_store != nullptr ) {
+		auto cert = revoked_cert( crl_store, dsigCtx->signKey );
+		if( cert != nullptr ) {
+			result = false;
+			XSEC_TRACE( TL_WARN, TC_VERIFY, "verify.revoked", { {"document", source_name( document )},
+			                                                    {"certificate", cert_subject( cert )} } );
+		}
+	}
+
+	if( XSEC_TRACE_ON( TL_DEBUG, TC_DUMP ) ) {
+		XSEC_TRACE( TL_DEBUG, TC_DUMP, "verify.context", { {"context", dump_to_string( xmlSecDSigCtxDebugDump, dsigCtx )} } );
+	}
+
+	if( !cache_digest.empty() ) {
+		if( cached && cached_valid != result )
+			XSEC_TRACE( TL_WARN, TC_VERIFY, "verify.cache_mismatch", { {"document", source_name( document )},
+			                                                           {"valid", result} } );
+		// without a key given the context can't tell which key the manager would have found
+		else if( !cached && uris_internal( node ) && ( options.key != nullptr || !options.secret_key.empty()
+		         || !options.public_key.empty() || key_from_document( node, dsigCtx->signKey )))
+			verify_cache->store( cache_digest, result );
+	}
+
 done:
+	XSEC_TRACE( TL_INFO, TC_VERIFY, "verify", { {"document", source_name( document )},
+	                                            {"valid", error_code == 0 && result},
+	                                            {"cached", cached && verify_cache->mode() == VCM_USE},
+	                                            {"result", error_code} } );
+	metrics_finish( error_code, doc, 0 );
+
 	if( dsigCtx )
 		xmlSecDSigCtxDestroy( dsigCtx );
 
 	if( doc )
 		xmlFreeDoc( doc );
 
+	capture_errors = false;
 	return error_code;
 }
 
 int Core::encrypt(const std::string &document, std::string &result, const encrypt_options_t &options) {
+	Source src;
+	Sink   sink;
+	src.path = document.c_str();
+	sink.path = result.c_str();
+	return encrypt( src, sink, options );
+}
+
+int Core::encrypt(const Source &document, const Sink &result, const encrypt_options_t &options) {
 	xmlDocPtr doc = nullptr, docTpl = nullptr;
 	xmlNodePtr encDataNode = nullptr;
-	xmlNodePtr encKeyNode = nullptr;
 	xmlNodePtr keyInfoNode = nullptr;
-	xmlNodePtr keyInfoNode2 = nullptr;
 	xmlNodePtr retrievalNode = nullptr;
 	xmlSecEncCtxPtr encCtx = nullptr;
 	xmlSecKeyPtr pubKey = nullptr;
@@ -671,6 +1479,10 @@ int Core::encrypt(const std::string &document, std::string &result, const encryp
 
 	int format = options.encryption_form;
 	error_code = 0;
+	result_bytes = 0;
+	trace_category = TC_ENCRYPT;
+	metrics_begin( MO_ENCRYPT, options.metrics );
+	capture_errors = true;
 
 	if( format == EF_UNSET ) {
 		format = default_enc_format;
@@ -694,48 +1506,108 @@ int Core::encrypt(const std::string &document, std::string &result, const encryp
 		key_size = get_key_size( default_enc );
 	}
 
-	doc = xmlParseFile( document.c_str());
+	int kt_algo = options.key_transport_algorithm;
+	if( kt_algo == KT_UNSET )
+		kt_algo = default_key_trans;
+	xmlSecTransformId kt_id = get_key_trans_id( kt_algo );
+	bool key_wrap = is_key_wrap( kt_algo );
+	std::vector<Recipient> recipients;
+	std::vector<std::string> key_names;
+
+	metrics_phase( MP_PARSE );
+	doc = parse_source( document, std::string(), options.parse );
+	if( error_code == LIMIT_EXCEEDED )
+		goto done;
 	if(( doc == nullptr ) || ( xmlDocGetRootElement( doc ) == nullptr )) {
-		xerror( -10, "Error: unable to parse file \"" + document + "\"\n" );
+		xerror( -10, "Error: unable to parse file \"" + source_name( document ) + "\"\n" );
 		goto done;
 	}
 
-	if( options.public_key.empty()) {
-		xerror( -20, "Encrypting the session key requires a public key! None given!" );
-		goto done;
-	}
+	metrics_phase( MP_KEYS );
 
-	if( !options.keys_in_p12 && !options.public_key_is_cert ){
-		pubKey = xmlSecCryptoAppKeyLoad( options.public_key.c_str(), xmlSecKeyDataFormatPem,
-		                                  options.key_password.empty() ? nullptr : options.key_password.c_str(),
-				                              nullptr, nullptr );
-	} else if( options.keys_in_p12 ){
-		pubKey = xmlSecCryptoAppKeyLoad( options.public_key.c_str(), xmlSecKeyDataFormatPkcs12,
-		                                  options.key_password.empty() ? nullptr : options.key_password.c_str(),
-		                                  nullptr, nullptr );
-		// certificate is read automatically if one is inside the p12!
-	} else{
-		pubKey = xmlSecCryptoAppKeyLoad( options.public_key.c_str(), xmlSecKeyDataFormatCertPem, nullptr, nullptr, nullptr );
-	}
-	if( pubKey == nullptr ) {
-		xerror(-25, "Error: failed to load rsa key from file \""+options.public_key+"\"");
-		goto done;
-	}
+	if( key_wrap ) {
+		if( options.kek == nullptr && options.key_encryption_key.empty()) {
+			xerror( -21, "Wrapping the session key requires a key encryption key! None given!" );
+			goto done;
+		}
+		if( !options.recipients.empty()) {
+			xerror( -22, "Wrapping the session key supports only a single recipient!" );
+			goto done;
+		}
 
-	/* set key name to some name */
-	if(xmlSecKeySetName(pubKey, BAD_CAST options.public_key.c_str()) < 0) {
-		xerror(-26, "Error: failed to set key name for key from \""+options.public_key+"\"");
-		xmlSecKeyDestroy(pubKey);
-		goto done;
+		// pre-shared raw aes key, looked up by name when decrypting
+		std::string name;
+		if( options.kek != nullptr ) {
+			name = options.kek->name();
+			if( name.empty()) {
+				xerror(-25, "Error: the given key encryption key has no name");
+				goto done;
+			}
+			pubKey = options.kek->copy();
+			if( pubKey == nullptr ) {
+				xerror(-25, "Error: failed to copy the given key encryption key");
+				goto done;
+			}
+		}
+		else {
+			pubKey = xmlSecKeyReadBinaryFile( xmlSecKeyDataAesId, options.key_encryption_key.c_str());
+			if( pubKey == nullptr ) {
+				xerror(-25, "Error: failed to load aes key from file \""+options.key_encryption_key+"\"");
+				goto done;
+			}
+			name = key_file_name( options.key_encryption_key );
+		}
+		if( adopt_key( pubKey, name ) != 0 )
+			goto done;
+		key_names.push_back( name );
 	}
+	else {
+		if( !options.public_key.empty() || options.key != nullptr ) {
+			Recipient first;
+			first.public_key_is_cert = options.public_key_is_cert;
+			first.keys_in_p12 = options.keys_in_p12;
+			first.public_key = options.public_key;
+			first.key_password = options.key_password;
+			first.key = options.key;
+			recipients.push_back( first );
+		}
+		recipients.insert( recipients.end(), options.recipients.begin(), options.recipients.end());
 
-	/* add key to keys manager, from now on keys manager is responsible
-	 * for destroying key
-	 */
-	if(xmlSecCryptoAppDefaultKeysMngrAdoptKey(mngr, pubKey) < 0) {
-		fprintf(stderr,"Error: failed to add private key to keys manager");
-		xmlSecKeyDestroy(pubKey);
-		goto done;
+		if( recipients.empty()) {
+			xerror( -20, "Encrypting the session key requires a public key! None given!" );
+			goto done;
+		}
+
+		for( auto &rcpt : recipients ) {
+			if( rcpt.key != nullptr ) {
+				pubKey = rcpt.key->copy();
+			} else if( !rcpt.keys_in_p12 && !rcpt.public_key_is_cert ){
+				pubKey = load_key( rcpt.public_key, xmlSecKeyDataFormatPem, rcpt.key_password );
+			} else if( rcpt.keys_in_p12 ){
+				pubKey = load_key( rcpt.public_key, xmlSecKeyDataFormatPkcs12, rcpt.key_password );
+				// certificate is read automatically if one is inside the p12!
+			} else{
+				pubKey = load_key( rcpt.public_key, xmlSecKeyDataFormatCertPem, std::string() );
+			}
+			if( pubKey == nullptr ) {
+				xerror(-25, "Error: failed to load rsa key from file \""+rcpt.public_key+"\"");
+				goto done;
+			}
+			if( auto cert = revoked_cert( crl_store, pubKey )) {
+				xerror(-28, "Error: the certificate \"" + cert_subject( cert ) + "\" of the recipient is revoked");
+				xmlSecKeyDestroy( pubKey );
+				goto done;
+			}
+
+			// named after the key itself, so decrypt can pick the matching EncryptedKey without trying all of them
+			auto name = key_fingerprint( pubKey );
+			if( name.empty())
+				name = rcpt.public_key;
+
+			if( adopt_key( pubKey, name ) != 0 )
+				goto done;
+			key_names.push_back( name );
+		}
 	}
 
 	/* create encryption context */
@@ -744,6 +1616,7 @@ int Core::encrypt(const std::string &document, std::string &result, const encryp
 		xerror(-40, "Error: failed to create encryption context\n" );
 		goto done;
 	}
+	encCtx->transformCtx.preExecCallback = base64_replace_transforms;
 
 	// generate session key
 	encCtx->encKey = xmlSecKeyGenerate(key_id, key_size, xmlSecKeyDataTypeSession);
@@ -758,6 +1631,8 @@ int Core::encrypt(const std::string &document, std::string &result, const encryp
 		goto done;
 	}
 
+	metrics_phase( MP_TEMPLATE );
+
 	if( !options.xpaths.empty() ){
 		xmlXPathContextPtr xpathCtx = nullptr;
 		xmlXPathObjectPtr xpathObject = nullptr;
@@ -823,67 +1698,30 @@ int Core::encrypt(const std::string &document, std::string &result, const encryp
 					}
 
 					if( first_key_data ){
-						encKeyNode = xmlSecTmplKeyInfoAddEncryptedKey(keyInfoNode,
-						                                              xmlSecTransformRsaPkcs1Id,
-						                                              BAD_CAST "key0", NULL, NULL);
-						if(encKeyNode == nullptr) {
-							xerror(-36, "Error: failed to add EncryptedKey to KeyInfo");
+						if( add_encrypted_keys( keyInfoNode, kt_id, recipients, key_names ) != 0 )
 							goto done;
-						}
-
-						if(xmlSecTmplEncDataEnsureCipherValue(encKeyNode) == NULL) {
-							xerror(-37, "Error: failed to add CipherValue to EncryptedKey");
-							goto done;
-						}
-
-						/* add <dsig:KeyInfo/> and <dsig:KeyName/> nodes to <enc:EncryptedKey/> */
-						keyInfoNode2 = xmlSecTmplEncDataEnsureKeyInfo(encKeyNode, nullptr);
-						if(keyInfoNode2 == nullptr) {
-							xerror(-38, "Error: failed to add KeyInfo to EncryptedKey");
-							goto done;
-						}
-
-						/* set key name so we can lookup key when needed */
-						if(xmlSecTmplKeyInfoAddKeyName(keyInfoNode2, BAD_CAST options.public_key.c_str()) == NULL) {
-							xerror(-39, "Error: failed to add KeyName to KeyInfo of EncryptedKey");
-							goto done;
-						}
-
-						// keyInfoNode2 exists now, so add certificate or public key data into it.
-						if( options.public_key_is_cert || options.keys_in_p12 ) {
-							/* create X509Data in KeyInfo */
-							if( xmlSecTmplKeyInfoAddX509Data( keyInfoNode2 ) == nullptr ) {
-								xerror( -32, "Error: failed to add X509Data node\n" );
-								goto done;
-							}
-						}
-						else if( !options.public_key.empty()) {
-							// embed the public key!
-							auto keyValueNode = xmlSecTmplKeyInfoAddKeyValue(keyInfoNode2);
-							if(keyValueNode == nullptr) {
-								xerror(-33,"Error: failed to add KeyValue node");
-								goto done;
-							}
-						}
 
 						first_key_data = false;
 					} else {
-						/*if( !dtd_added ){
-							dtd_added = true;
-						}*/
-						retrievalNode = xmlSecTmplKeyInfoAddRetrievalMethod( keyInfoNode, BAD_CAST "#key0",
-						                       BAD_CAST "http://www.w3.org/2001/04/xmlenc#EncryptedKey" );
-						if( retrievalNode == nullptr ) {
-							xerror( -37, "Error: Failed to add RetrievalMethod to KeyInfo" );
-							goto done;
+						// one RetrievalMethod per recipient, each receiver resolves the one it holds the key for
+						for( size_t k = 0; k < key_names.size(); k++ ) {
+							auto uri = "#key" + std::to_string(k);
+							retrievalNode = xmlSecTmplKeyInfoAddRetrievalMethod( keyInfoNode, BAD_CAST uri.c_str(),
+							                       BAD_CAST "http://www.w3.org/2001/04/xmlenc#EncryptedKey" );
+							if( retrievalNode == nullptr ) {
+								xerror( -37, "Error: Failed to add RetrievalMethod to KeyInfo" );
+								goto done;
+							}
 						}
 					}
 
 					/* encrypt the selected node */
+					metrics_phase( MP_CRYPTO );
 					if( xmlSecEncCtxXmlEncrypt( encCtx, encDataNode, nodes->nodeTab[i] ) < 0 ) {
 						xerror( -70, "Error: encryption failed\n" );
 						goto done;
 					}
+					metrics_phase( MP_TEMPLATE );
 
 					{ // reset the encryption context as per https://www.aleksey.com/pipermail/xmlsec/2009/008665.html
 						auto tmpkey = encCtx->encKey;
@@ -936,153 +1774,541 @@ int Core::encrypt(const std::string &document, std::string &result, const encryp
 			goto done;
 		}
 
-		encKeyNode = xmlSecTmplKeyInfoAddEncryptedKey(keyInfoNode,
-		                                              xmlSecTransformRsaPkcs1Id,
-		                                              BAD_CAST "key0", NULL, NULL);
-		if(encKeyNode == nullptr) {
-			xerror(-36, "Error: failed to add EncryptedKey to KeyInfo\n");
+		if( add_encrypted_keys( keyInfoNode, kt_id, recipients, key_names ) != 0 )
 			goto done;
-		}
 
-		if(xmlSecTmplEncDataEnsureCipherValue(encKeyNode) == NULL) {
-			xerror(-37, "Error: failed to add CipherValue to EncryptedKey");
+		metrics_phase( MP_CRYPTO );
+		if( xmlSecEncCtxXmlEncrypt( encCtx, encDataNode, xmlDocGetRootElement(doc) ) < 0 ) {
+			xerror( -70, "Error: encryption failed\n" );
 			goto done;
 		}
+		/* the template is inserted in the doc */
+		encDataNode = nullptr;
+		keyInfoNode = nullptr;
+		retrievalNode = nullptr;
+	}
+
+
+	metrics_phase( MP_SERIALIZE );
+	write_result( doc, OF_COMPACT, result );
+
+
+done:
+	XSEC_TRACE( TL_INFO, TC_ENCRYPT, "encrypt", { {"document", source_name( document )}, {"format", format}, {"result", error_code} } );
+	metrics_finish( error_code, doc, result_bytes );
+
+	/* cleanup */
+	if( encCtx != nullptr ) {
+		xmlSecEncCtxDestroy( encCtx );
+	}
+	drop_keys();
+
+	if( encDataNode != nullptr ) {
+		xmlFreeNode( encDataNode );
+	}
+
+	if( doc != nullptr ) {
+		xmlFreeDoc( doc );
+	}
+	capture_errors = false;
+	return error_code;
+}
+
+int Core::add_encrypted_keys(xmlNodePtr keyInfoNode, xmlSecTransformId kt_id,
+                             const std::vector<Recipient> &recipients, const std::vector<std::string> &key_names) {
+	// the session key is generated once and encrypted for every recipient
+	for( size_t i = 0; i < key_names.size(); i++ ) {
+		auto id = "key" + std::to_string(i);
+
+		auto encKeyNode = xmlSecTmplKeyInfoAddEncryptedKey(keyInfoNode, kt_id, BAD_CAST id.c_str(), nullptr, nullptr);
+		if(encKeyNode == nullptr) {
+			return xerror(-36, "Error: failed to add EncryptedKey to KeyInfo");
+		}
+
+		if(xmlSecTmplEncDataEnsureCipherValue(encKeyNode) == nullptr) {
+			return xerror(-37, "Error: failed to add CipherValue to EncryptedKey");
+		}
 
 		/* add <dsig:KeyInfo/> and <dsig:KeyName/> nodes to <enc:EncryptedKey/> */
-		keyInfoNode2 = xmlSecTmplEncDataEnsureKeyInfo(encKeyNode, nullptr);
+		auto keyInfoNode2 = xmlSecTmplEncDataEnsureKeyInfo(encKeyNode, nullptr);
 		if(keyInfoNode2 == nullptr) {
-			xerror(-38, "Error: failed to add KeyInfo to EncryptedKey");
-			goto done;
+			return xerror(-38, "Error: failed to add KeyInfo to EncryptedKey");
 		}
 
 		/* set key name so we can lookup key when needed */
-		if(xmlSecTmplKeyInfoAddKeyName(keyInfoNode2, BAD_CAST options.public_key.c_str()) == NULL) {
-			xerror(-39, "Error: failed to add KeyName to KeyInfo of EncryptedKey");
-			goto done;
+		if(xmlSecTmplKeyInfoAddKeyName(keyInfoNode2, BAD_CAST key_names[i].c_str()) == nullptr) {
+			return xerror(-39, "Error: failed to add KeyName to KeyInfo of EncryptedKey");
 		}
 
+		// a wrapping key is symmetric and must never be embedded, KeyName is all the receiver gets!
+		if( i >= recipients.size())
+			continue;
+
 		// keyInfoNode2 exists now, so add certificate or public key data into it.
-		if( options.public_key_is_cert || options.keys_in_p12) {
+		if( recipients[i].public_key_is_cert || recipients[i].keys_in_p12 ) {
 			/* create X509Data in KeyInfo */
 			if( xmlSecTmplKeyInfoAddX509Data( keyInfoNode2 ) == nullptr ) {
-				xerror( -32, "Error: failed to add X509Data node\n" );
-				goto done;
+				return xerror( -32, "Error: failed to add X509Data node\n" );
 			}
 		}
-		else if( !options.public_key.empty()) {
+		else {
 			// embed the public key!
-			auto keyValueNode = xmlSecTmplKeyInfoAddKeyValue(keyInfoNode2);
-			if(keyValueNode == nullptr) {
-				xerror(-33,"Error: failed to add KeyValue node");
-				goto done;
+			if( xmlSecTmplKeyInfoAddKeyValue( keyInfoNode2 ) == nullptr ) {
+				return xerror(-33,"Error: failed to add KeyValue node");
 			}
 		}
+	}
+	return 0;
+}
 
-		if( xmlSecEncCtxXmlEncrypt( encCtx, encDataNode, xmlDocGetRootElement(doc) ) < 0 ) {
-			xerror( -70, "Error: encryption failed\n" );
-			goto done;
+// what a parse has taken on so far, checked against the Limits of the Core by the SAX callbacks below
+struct ParseGuard {
+	const Limits *limits;
+	size_t        nodes = 0;
+	size_t        entity_bytes = 0;
+	/* text of the entities parsed before, whose trees are copied for every further reference */
+	std::unordered_map<xmlEntityPtr, size_t> entity_sizes;
+	/* the bound that stopped the parser */
+	const char   *exceeded = nullptr;
+};
+
+static void guard_stop(xmlParserCtxtPtr ctxt, const char *what) {
+	auto guard = (ParseGuard *) ctxt->_private;
+	if( guard->exceeded == nullptr )
+		guard->exceeded = what;
+	xmlStopParser( ctxt );
+}
+
+// bytes read of the document itself, for inputs whose size isn't known beforehand
+static size_t parsed_bytes(xmlParserCtxtPtr ctxt) {
+	auto in = ctxt->inputNr > 0 ? ctxt->inputTab[0] : nullptr;
+	return in == nullptr || in->base == nullptr ? 0 : in->consumed + (in->cur - in->base);
+}
+
+// length of the text in first up to last and their descendants
+static size_t text_size(xmlNodePtr first, xmlNodePtr last) {
+	size_t size = 0;
+	for( auto cur = first; cur != nullptr; cur = cur->next ) {
+		if( cur->type == XML_ELEMENT_NODE )
+			size += text_size( cur->children, nullptr );
+		else if( cur->content != nullptr )
+			size += xmlStrlen( cur->content );
+		if( cur == last )
+			break;
+	}
+	return size;
+}
+
+static void guarded_start_element(void *ctx, const xmlChar *localname, const xmlChar *prefix, const xmlChar *uri,
+                                  int nb_namespaces, const xmlChar **namespaces,
+                                  int nb_attributes, int nb_defaulted, const xmlChar **attributes) {
+	auto ctxt = (xmlParserCtxtPtr) ctx;
+	auto guard = (ParseGuard *) ctxt->_private;
+	auto &limits = *guard->limits;
+
+	guard->nodes += 1 + nb_attributes;
+	if( limits.nodes != 0 && guard->nodes > limits.nodes )
+		return guard_stop( ctxt, "nodes" );
+	// the element isn't on the stack yet
+	if( limits.depth != 0 && (unsigned) ctxt->nameNr + 1 > limits.depth )
+		return guard_stop( ctxt, "depth" );
+	if( limits.document_bytes != 0 && parsed_bytes( ctxt ) > limits.document_bytes )
+		return guard_stop( ctxt, "document_bytes" );
+
+	xmlSAX2StartElementNs( ctx, localname, prefix, uri, nb_namespaces, namespaces, nb_attributes, nb_defaulted, attributes );
+}
+
+// called for every entity reference, before its text or the tree parsed from it the first time is substituted
+static xmlEntityPtr guarded_get_entity(void *ctx, const xmlChar *name) {
+	auto ctxt = (xmlParserCtxtPtr) ctx;
+	auto guard = (ParseGuard *) ctxt->_private;
+	auto ent = xmlSAX2GetEntity( ctx, name );
+	if( ent == nullptr )
+		return ent;
+
+	size_t size = ent->length;
+	if( ent->children != nullptr ) {
+		auto it = guard->entity_sizes.find( ent );
+		if( it == guard->entity_sizes.end() )
+			it = guard->entity_sizes.emplace( ent, text_size( ent->children, ent->last )).first;
+		size = it->second;
+	}
+	guard->entity_bytes += size;
+	if( guard->entity_bytes > guard->limits->entity_bytes ) {
+		guard_stop( ctxt, "entity_bytes" );
+		return nullptr;
+	}
+	return ent;
+}
+
+// a shared dictionary is started over once it holds this many names, so odd documents can't grow it forever
+static const size_t max_dict_names = 1 << 17;
+
+xmlDocPtr Core::parse_document(const Source &document, const std::string &base_url, const ParseProfile &profile) {
+	int dtd = profile.dtd;
+	if( dtd == PD_UNSET )
+		dtd = document.path != nullptr ? PD_LOAD : PD_IGNORE; // what xmlParseFile() and xmlReadMemory() did
+
+	int flags = 0;
+	if( dtd == PD_LOAD )
+		flags |= XML_PARSE_DTDLOAD | XML_PARSE_DTDATTR | XML_PARSE_NOENT;
+	if( profile.huge )
+		flags |= XML_PARSE_HUGE;
+	if( profile.compact )
+		flags |= XML_PARSE_COMPACT;
+	if( profile.no_blanks )
+		flags |= XML_PARSE_NOBLANKS;
+
+	size_t size = document.path != nullptr ? file_size( document.path ) : document.size;
+	if( limits.document_bytes != 0 && size > limits.document_bytes ) {
+		xerror( LIMIT_EXCEEDED, "Error: \"" + source_name( document ) + "\" exceeds the limit document_bytes\n" );
+		return nullptr;
+	}
+
+	auto ctxt = xmlNewParserCtxt();
+	if( ctxt == nullptr )
+		return nullptr;
+
+	ParseGuard guard;
+	guard.limits = &limits;
+	ctxt->_private = &guard;
+	if( limits.nodes != 0 || limits.depth != 0 || limits.document_bytes != 0 )
+		ctxt->sax->startElementNs = guarded_start_element;
+	if( limits.entity_bytes != 0 )
+		ctxt->sax->getEntity = guarded_get_entity;
+
+	if( profile.shared_dict ) {
+		if( dict != nullptr && (size_t) xmlDictSize( dict ) > max_dict_names ) {
+			xmlDictFree( dict ); // documents still using it hold their own reference
+			dict = nullptr;
+		}
+		if( dict == nullptr )
+			dict = xmlDictCreate();
+		if( dict != nullptr ) {
+			// the limit a dictionary of its own would have, huge lifts it like for the context
+			xmlDictSetLimit( dict, profile.huge ? 0 : XML_MAX_DICTIONARY_LIMIT );
+			xmlDictFree( ctxt->dict );
+			ctxt->dict = dict;
+			xmlDictReference( dict ); // for ctxt, the document takes another one
 		}
-		/* the template is inserted in the doc */
-		encDataNode = nullptr;
-		keyInfoNode = nullptr;
-		retrievalNode = nullptr;
 	}
 
+	xmlDocPtr doc;
+	if( document.path != nullptr ) {
+		doc = xmlCtxtReadFile( ctxt, document.path, nullptr, flags );
+	}
+	else {
+		doc = xmlCtxtReadMemory( ctxt, document.data, document.size,
+		                         base_url.empty() ? "noname.xml" : base_url.c_str(), /* base url */
+		                         nullptr, /* encoding */
+		                         flags );
+	}
+	xmlFreeParserCtxt( ctxt );
 
-	if( xmlSaveFile( result.c_str(), doc ) < 0 ) {
-		xerror( -80, "Error while writing file to " + result + "\n" );
-		goto done;
+	if( guard.exceeded != nullptr ) {
+		xmlFreeDoc( doc ); // nullptr anyway unless libxml2 recovers
+		xerror( LIMIT_EXCEEDED, "Error: \"" + source_name( document ) + "\" exceeds the limit " + guard.exceeded + "\n" );
+		return nullptr;
 	}
+	return doc;
+}
 
+// parses the document of a call and registers its IDs
+xmlDocPtr Core::parse_source(const Source &document, const std::string &base_url, const ParseProfile &profile) {
+	metrics_bytes_in( document.path != nullptr ? file_size( document.path ) : document.size );
+	auto doc = parse_document( document, base_url, profile );
+	if( doc == nullptr || id_attributes.empty() )
+		return doc;
 
-done:
+	std::vector<std::string> duplicates;
+	register_ids( doc, id_attributes, duplicates );
+	for( auto &id : duplicates ) {
+		XSEC_TRACE( TL_WARN, trace_category, "parse.duplicate_id", { {"document", source_name( document )},
+		                                                             {"id", id} } );
+	}
+	return doc;
+}
 
-	/* cleanup */
-	if( encCtx != nullptr ) {
-		xmlSecEncCtxDestroy( encCtx );
+int Core::write_result(xmlDocPtr doc, int format, const Sink &result) {
+	int ret;
+	if( result.write != nullptr ) {
+		CountedWrite c = { &result, 0 };
+		ret = save_document_stream( doc, format, counted_write, &c );
+		result_bytes = c.bytes;
+	}
+	else if( result.memory != nullptr ) {
+		ret = save_document_memory( doc, format, *result.memory );
+		result_bytes = result.memory->size();
+	}
+	else {
+		ret = save_document_file( doc, format, result.path );
+		result_bytes = file_size( result.path );
 	}
 
-	if( encDataNode != nullptr ) {
-		xmlFreeNode( encDataNode );
+	if( ret < 0 )
+		xerror( -80, "Error while writing file to " + sink_name( result ) + "\n" );
+	return ret;
+}
+
+int Core::write_result(const char *data, size_t size, const Sink &result) {
+	bool written;
+	if( result.write != nullptr ) {
+		written = result.write( result.ctx, data, size ) == 0;
+	}
+	else if( result.memory != nullptr ) {
+		result.memory->assign( data, size );
+		written = true;
 	}
+	else {
+		// "-" is stdout, like save_document_file() has it
+		bool is_stdout = strcmp( result.path, "-" ) == 0;
+		auto binout = is_stdout ? stdout : fopen( result.path, "wb" );
+		written = binout != nullptr && fwrite( data, 1, size, binout ) == size;
+		if( binout != nullptr )
+			written = (is_stdout ? fflush( binout ) : fclose( binout )) == 0 && written;
+	}
+
+	if( !written )
+		return xerror( -80, "Error while writing file to " + sink_name( result ) + "\n" );
+	result_bytes = size;
+	return 0;
+}
 
-	if( doc != nullptr ) {
-		xmlFreeDoc( doc );
+// loads a key file through the key cache if there is one
+xmlSecKeyPtr Core::load_key(const std::string &path, xmlSecKeyDataFormat format, const std::string &password) {
+	if( key_cache != nullptr )
+		return key_cache->load( path, format, password );
+
+	return xmlSecCryptoAppKeyLoad( path.c_str(), format, password.empty() ? nullptr : password.c_str(), nullptr, nullptr );
+}
+
+int Core::set_ca_dir(const std::string &dir) {
+	ca_dir = dir;
+	trust_changed( "dir\n" + dir );
+	if( !trust_loaded )
+		return 0;
+
+	auto store = xmlSecKeysMngrGetDataStore( mngr, xmlSecOpenSSLX509StoreId );
+	if( store == nullptr || xmlSecOpenSSLX509StoreAddCertsPath( store, ca_dir.c_str()) < 0 )
+		return xerror( -101, "Error: failed to add CA directory \"" + ca_dir + "\"\n" );
+	return 0;
+}
+
+int Core::set_id_attributes(const std::vector<std::string> &names) {
+	std::vector<std::pair<std::string, std::string>> parsed;
+	for( auto &name : names ) {
+		auto end = name.find( '}' );
+		if( name.empty() || ( name[0] == '{' && ( end == std::string::npos || end + 1 == name.size() )))
+			return xerror( -102, "Error: invalid ID attribute name \"" + name + "\"\n" );
+
+		if( name[0] == '{' )
+			parsed.emplace_back( name.substr( 1, end - 1 ), name.substr( end + 1 ));
+		else
+			parsed.emplace_back( std::string(), name );
 	}
-	return error_code;
+	id_attributes = parsed;
+	return 0;
+}
+
+std::vector<std::string> Core::get_id_attributes() const {
+	std::vector<std::string> names;
+	for( auto &name : id_attributes )
+		names.push_back( name.first.empty() ? name.second : "{" + name.first + "}" + name.second );
+	return names;
+}
+
+bool Core::trust_changed(const std::string &what) {
+	if( !trust_seen.insert( what ).second )
+		return false;
+	trust_id = VerifyCache::digest( what.data(), what.size(), trust_id );
+	return true;
+}
+
+std::string Core::verify_context(const verify_options_t &options, const ParseProfile &profile) {
+	// mirrors how verify() picks its key
+	std::string key = "embedded";
+	if( options.key != nullptr ) {
+		key = "key\n" + std::to_string( options.key->serial() );
+	}
+	else if( !options.secret_key.empty() || !options.public_key.empty() ) {
+		bool secret = !options.secret_key.empty();
+		auto id = file_identity( secret ? options.secret_key : options.public_key );
+		if( id.empty() )
+			return std::string(); // verify() will fail to load it anyway
+		key = (secret ? "secret\n" : "public\n") + id;
+	}
+
+	return key + '\n' + (options.public_key_is_cert ? 'c' : '-') + (options.public_key_is_p12 ? 'p' : '-')
+	       + (options.trust_selfsigned_cert ? 't' : '-') + '\n' + options.base_url + '\n' + trust_id
+	       + '\n' + (crl_store != nullptr ? std::to_string( crl_store->generation() ) : std::string( "-" ))
+	       + '\n' + std::to_string( profile.dtd ) + (profile.no_blanks ? 'b' : '-') + (profile.huge ? 'h' : '-')
+	       + '\n' + std::to_string( limits.document_bytes ) + ',' + std::to_string( limits.depth )
+	       + ',' + std::to_string( limits.nodes ) + ',' + std::to_string( limits.entity_bytes )
+	       + ',' + std::to_string( limits.references ) + ',' + std::to_string( limits.transforms )
+	       + ',' + std::to_string( limits.xpath_ops );
+}
+
+int Core::check_signature_limits(xmlNodePtr signNode) {
+	if( limits.references == 0 && limits.transforms == 0 )
+		return 0;
+
+	auto signedInfo = xmlSecFindChild( signNode, xmlSecNodeSignedInfo, xmlSecDSigNs );
+	unsigned refs = 0;
+	for( auto ref = signedInfo ? xmlSecGetNextElementNode( signedInfo->children ) : nullptr; ref != nullptr;
+	     ref = xmlSecGetNextElementNode( ref->next )) {
+		if( !xmlSecCheckNodeName( ref, xmlSecNodeReference, xmlSecDSigNs ))
+			continue;
+		if( limits.references != 0 && ++refs > limits.references )
+			return xerror( LIMIT_EXCEEDED, "Error: signature exceeds the limit references\n" );
+
+		auto transforms = xmlSecFindChild( ref, xmlSecNodeTransforms, xmlSecDSigNs );
+		unsigned count = 0;
+		for( auto cur = transforms ? xmlSecGetNextElementNode( transforms->children ) : nullptr; cur != nullptr;
+		     cur = xmlSecGetNextElementNode( cur->next )) {
+			if( limits.transforms != 0 && ++count > limits.transforms )
+				return xerror( LIMIT_EXCEEDED, "Error: signature exceeds the limit transforms\n" );
+		}
+	}
+	return 0;
+}
+
+int Core::load_trust_store() {
+	if( trust_loaded )
+		return 0;
+	if( mngr == nullptr )
+		return xerror( -100, "Error: no keys manager.\n" );
+
+	// creates the x509 store, which reads the default root certificates of the crypto library
+	if( xmlSecCryptoKeysMngrInit( mngr ) < 0 )
+		return xerror( -101, "Error: failed to load the trust store.\n" );
+	trust_loaded = true;
+
+	if( ca_dir.empty())
+		return 0;
+	return set_ca_dir( ca_dir );
+}
+
+int Core::adopt_key(xmlSecKeyPtr key, const std::string &name) {
+	/* set key name to some name */
+	if(xmlSecKeySetName(key, BAD_CAST name.c_str()) < 0) {
+		xmlSecKeyDestroy(key);
+		return xerror(-26, "Error: failed to set key name for key \""+name+"\"");
+	}
+
+	/* add key to keys manager, from now on keys manager is responsible
+	 * for destroying key
+	 */
+	if(xmlSecCryptoAppDefaultKeysMngrAdoptKey(mngr, key) < 0) {
+		xmlSecKeyDestroy(key);
+		return xerror(-27, "Error: failed to add key \""+name+"\" to keys manager");
+	}
+	return 0;
+}
+
+void Core::drop_keys() {
+	// a Core serves many calls, keys of one must not decrypt or verify the next
+	auto store = mngr != nullptr ? xmlSecKeysMngrGetKeysStore( mngr ) : nullptr;
+	if( store != nullptr )
+		xmlSecPtrListEmpty( xmlSecSimpleKeysStoreGetKeys( store ));
 }
 
 int Core::decrypt(const std::string &document, std::string &result, const decrypt_options_t &options) {
+	Source src;
+	Sink   sink;
+	src.path = document.c_str();
+	sink.path = result.c_str();
+	return decrypt( src, sink, options );
+}
+
+int Core::decrypt(const Source &document, const Sink &result, const decrypt_options_t &options) {
 	xmlDocPtr doc = nullptr;
 	xmlNodePtr node = nullptr;
 	xmlSecEncCtxPtr encCtx = nullptr;
+	xmlSecKeyPtr privKey = nullptr;
+	std::string key_name;
 	error_code = 0;
-
-	doc = xmlParseFile( document.c_str());
+	result_bytes = 0;
+	trace_category = TC_DECRYPT;
+	metrics_begin( MO_DECRYPT, options.metrics );
+	capture_errors = true;
+
+	metrics_phase( MP_PARSE );
+	doc = parse_source( document, std::string(), options.parse );
+	if( error_code == LIMIT_EXCEEDED )
+		goto done;
 	if(( doc == nullptr ) || ( xmlDocGetRootElement( doc ) == nullptr )) {
-		xerror(-10, "Error: unable to parse file \""+document+"\"");
+		xerror(-10, "Error: unable to parse file \""+source_name( document )+"\"");
 		goto done;
 	}
 
-	if( !options.private_key.empty() ){
-		if( !options.private_key_is_p12 ){
-			auto privKey = xmlSecCryptoAppKeyLoad( options.private_key.c_str(), xmlSecKeyDataFormatPem,
-			                                  nullptr, nullptr, nullptr );
-			if( privKey == nullptr ) {
-				xerror(-25, "Error: failed to load rsa key from file \""+options.private_key+"\"");
-				goto done;
-			}
+	metrics_phase( MP_KEYS );
+	// EncryptedKeys for recipients with certificates carry them in X509Data, which can't be read without
+	if( options.trust_selfsigned_cert ||
+	    xmlSecFindNode( xmlDocGetRootElement( doc ), xmlSecNodeX509Data, xmlSecDSigNs ) != nullptr ) {
+		if( load_trust_store() != 0 )
+			goto done;
+	}
 
-			/* add key to keys manager, from now on keys manager is responsible
-			 * for destroying key
-			 */
-			if(xmlSecCryptoAppDefaultKeysMngrAdoptKey(mngr, privKey) < 0) {
-				fprintf(stderr,"Error: failed to add public key to keys manager");
-				xmlSecKeyDestroy(privKey);
-				goto done;
-			}
+	if( options.key != nullptr ) {
+		privKey = options.key->copy();
+		if( privKey == nullptr ) {
+			xerror(-25, "Error: failed to copy the given key");
+			goto done;
 		}
-		else if( options.private_key_is_p12 ){
-			if( options.trust_selfsigned_cert ) {
-				xmlSecCryptoAppKeysMngrCertLoad( mngr, options.private_key.c_str(), xmlSecKeyDataFormatPkcs12,
-				                                 xmlSecKeyDataTypeTrusted );
-			}
-			auto privKey = xmlSecCryptoAppKeyLoad( options.private_key.c_str(), xmlSecKeyDataFormatPkcs12,
-			                                       options.key_password.empty() ? nullptr : options.key_password.c_str(), nullptr, nullptr );
-			if( privKey == nullptr ) {
-				xerror(-25, "Error: failed to load rsa key from file \""+options.private_key+"\"");
-				goto done;
-			}
 
-			/* add key to keys manager, from now on keys manager is responsible
-			 * for destroying key
-			 */
-			if(xmlSecCryptoAppDefaultKeysMngrAdoptKey(mngr, privKey) < 0) {
-				fprintf(stderr,"Error: failed to add public key to keys manager");
-				xmlSecKeyDestroy(privKey);
-				goto done;
+		key_name = key_fingerprint( privKey );
+		if( key_name.empty())
+			key_name = options.key->name();
+
+		if( adopt_key( privKey, key_name ) != 0 )
+			goto done;
+	}
+	else if( !options.private_key.empty() ){
+		if( !options.private_key_is_p12 ){
+			privKey = load_key( options.private_key, xmlSecKeyDataFormatPem, std::string() );
+		}
+		else {
+			if( options.trust_selfsigned_cert ) {
+				if( trust_changed( "trusted\n" + file_identity( options.private_key )))
+					xmlSecCryptoAppKeysMngrCertLoad( mngr, options.private_key.c_str(), xmlSecKeyDataFormatPkcs12,
+					                                 xmlSecKeyDataTypeTrusted );
 			}
+			privKey = load_key( options.private_key, xmlSecKeyDataFormatPkcs12, options.key_password );
+		}
+		if( privKey == nullptr ) {
+			xerror(-25, "Error: failed to load rsa key from file \""+options.private_key+"\"");
+			goto done;
 		}
+
+		// encrypt names every recipients EncryptedKey after the fingerprint of its key, naming ours
+		// the same way lets drop_other_recipients() skip the EncryptedKeys of other recipients
+		key_name = key_fingerprint( privKey );
+		if( key_name.empty())
+			key_name = options.private_key;
+
+		if( adopt_key( privKey, key_name ) != 0 )
+			goto done;
 	}
 
-	// little hack to get Id of EncryptedKey working, alternatively one would need a short DTD like this:
-	// <!ATTLIST EncryptedKey Id ID #IMPLIED>
-	node = xmlSecFindNode( xmlDocGetRootElement( doc ), xmlSecNodeEncryptedKey, xmlSecEncNs );
-	if( node != nullptr){
-		auto attr = xmlHasProp(node, BAD_CAST "Id");
-		if((attr != nullptr) && (attr->children != nullptr)) {
-			/* get the attribute (id) value */
-			auto name = xmlNodeListGetString(doc, attr->children, 1);
-			if(name != nullptr) {
-				auto tmp = xmlGetID(doc, name);
-				if(tmp == nullptr) { // if not registered as ID, do it
-					xmlAddID(NULL, doc, name, attr);
-					fprintf(stderr,"added node");
-				}
-				xmlFree(name);
-			}
+	if( options.kek != nullptr ) {
+		auto kek = options.kek->copy();
+		if( kek == nullptr ) {
+			xerror(-26, "Error: failed to copy the given key encryption key");
+			goto done;
 		}
+		if( adopt_key( kek, options.kek->name()) != 0 )
+			goto done;
+	}
+	else if( !options.key_encryption_key.empty() ){
+		auto kek = xmlSecKeyReadBinaryFile( xmlSecKeyDataAesId, options.key_encryption_key.c_str());
+		if( kek == nullptr ) {
+			xerror(-26, "Error: failed to load aes key from file \""+options.key_encryption_key+"\"");
+			goto done;
+		}
+
+		// EncryptedKey only carries the KeyName, so it has to match the one used when encrypting
+		if( adopt_key( kek, key_file_name( options.key_encryption_key )) != 0 )
+			goto done;
 	}
 
 	encCtx = xmlSecEncCtxCreate( mngr );
@@ -1090,23 +2316,27 @@ int Core::decrypt(const std::string &document, std::string &result, const decryp
 		xerror(-30, "Error: failed to create encryption context" );
 		goto done;
 	}
+	encCtx->transformCtx.preExecCallback = base64_replace_transforms;
 
 	/* find start node */
 	node = xmlSecFindNode( xmlDocGetRootElement( doc ), xmlSecNodeEncryptedData, xmlSecEncNs );
 	if( node == nullptr ) {
-		xerror(-20, "Error: no EncryptedData found in \""+document+"\"");
+		xerror(-20, "Error: no EncryptedData found in \""+source_name( document )+"\"");
 		goto done;
 	}
 
+	metrics_phase( MP_CRYPTO );
 	do {
-		//xmlSecErrorsSetCallback( core_set_error );
+		if( !key_name.empty() )
+			drop_other_recipients( node, key_name );
 		/* decrypt the data */
 		if( xmlSecEncCtxDecrypt( encCtx, node ) < 0 ) {
-			//xmlSecEncCtxDebugDump( encCtx, stderr);
-			xerror( -50, "Error: decrypting failed." ); // error message set by callback
+			if( XSEC_TRACE_ON( TL_DEBUG, TC_DUMP ) ) {
+				XSEC_TRACE( TL_DEBUG, TC_DUMP, "decrypt.context", { {"context", dump_to_string( xmlSecEncCtxDebugDump, encCtx )} } );
+			}
+			xerror( -50, "Error: decrypting failed." ); // details in serror_msg, set by core_set_error()
 			goto done;
 		}
-		//xmlSecErrorsSetCallback( xmlSecErrorsDefaultCallback );
 
 		if( encCtx->result == nullptr ) {
 			xerror( -51, "Error: result is empty, nothing was decrypted." );
@@ -1114,12 +2344,8 @@ int Core::decrypt(const std::string &document, std::string &result, const decryp
 		}
 		if( encCtx->resultReplaced == 0) {
 			if( xmlSecBufferGetData( encCtx->result ) != nullptr ) {
-				auto binout = fopen(result.c_str(), "wb");
-				fwrite( xmlSecBufferGetData( encCtx->result ),
-				        1,
-				        xmlSecBufferGetSize( encCtx->result ),
-				        binout);
-				fclose(binout);
+				metrics_phase( MP_SERIALIZE );
+				write_result( (const char *) xmlSecBufferGetData( encCtx->result ), xmlSecBufferGetSize( encCtx->result ), result );
 				goto done;
 			}
 		}
@@ -1132,18 +2358,23 @@ int Core::decrypt(const std::string &document, std::string &result, const decryp
 		}
 	} while((node = xmlSecFindNode( xmlDocGetRootElement( doc ), xmlSecNodeEncryptedData, xmlSecEncNs )) != nullptr);
 
-	xmlSaveFile(result.c_str(), doc );
+	metrics_phase( MP_SERIALIZE );
+	write_result( doc, options.output_format != OF_UNSET ? options.output_format : default_output, result );
 
 
 done:
+	XSEC_TRACE( TL_INFO, TC_DECRYPT, "decrypt", { {"document", source_name( document )}, {"result", error_code} } );
+	metrics_finish( error_code, doc, result_bytes );
 	/* cleanup */
 	if( encCtx != nullptr ) {
 		xmlSecEncCtxDestroy( encCtx );
 	}
+	drop_keys();
 
 	if( doc != nullptr ) {
 		xmlFreeDoc( doc );
 	}
+	capture_errors = false;
 	return error_code;
 }
 
@@ -1204,6 +2435,12 @@ xmlSecTransformId get_sign_id(int sign_algo) {
 			return xmlSecTransformEcdsaSha384Id;
 		case SA_ECDSA_SHA512:
 			return xmlSecTransformEcdsaSha512Id;
+		case SA_HMAC_SHA256:
+			return xmlSecTransformHmacSha256Id;
+		case SA_HMAC_SHA384:
+			return xmlSecTransformHmacSha384Id;
+		case SA_HMAC_SHA512:
+			return xmlSecTransformHmacSha512Id;
 	}
 }
 xmlSecTransformId get_enc_id(int enc_algo){
@@ -1219,6 +2456,12 @@ xmlSecTransformId get_enc_id(int enc_algo){
 			return xmlSecTransformAes256CbcId;
 		case EA_3DES_CBC:
 			return xmlSecTransformDes3CbcId;
+		case EA_AES128_GCM:
+			return xmlSecTransformAes128GcmId;
+		case EA_AES192_GCM:
+			return xmlSecTransformAes192GcmId;
+		case EA_AES256_GCM:
+			return xmlSecTransformAes256GcmId;
 	}
 }
 
@@ -1230,6 +2473,9 @@ xmlSecKeyDataId get_key_id(int enc_algo){
 		case EA_AES128_CBC:
 		case EA_AES192_CBC:
 		case EA_AES256_CBC:
+		case EA_AES128_GCM:
+		case EA_AES192_GCM:
+		case EA_AES256_GCM:
 			return xmlSecKeyDataAesId;
 		case EA_3DES_CBC:
 			return xmlSecKeyDataDesId;
@@ -1242,16 +2488,45 @@ xmlSecSize get_key_size(int enc_algo) {
 		case EA_UNSET:
 			return 0;
 		case EA_AES128_CBC:
+		case EA_AES128_GCM:
 			return 128;
 		case EA_AES192_CBC:
+		case EA_AES192_GCM:
 			return 192;
 		case EA_AES256_CBC:
+		case EA_AES256_GCM:
 			return 256;
 		case EA_3DES_CBC:
 			return 192;
 	}
 }
 
+xmlSecTransformId get_key_trans_id(int kt_algo) {
+	switch(kt_algo) {
+		default:
+		case KT_UNSET:
+			return nullptr;
+		case KT_RSA_PKCS1:
+			return xmlSecTransformRsaPkcs1Id;
+		case KT_RSA_OAEP:
+			return xmlSecTransformRsaOaepId;
+		case KT_AES128_KW:
+			return xmlSecTransformKWAes128Id;
+		case KT_AES192_KW:
+			return xmlSecTransformKWAes192Id;
+		case KT_AES256_KW:
+			return xmlSecTransformKWAes256Id;
+	}
+}
+
+bool is_hmac(int sign_algo) {
+	return sign_algo == SA_HMAC_SHA256 || sign_algo == SA_HMAC_SHA384 || sign_algo == SA_HMAC_SHA512;
+}
+
+bool is_key_wrap(int kt_algo) {
+	return kt_algo == KT_AES128_KW || kt_algo == KT_AES192_KW || kt_algo == KT_AES256_KW;
+}
+
 bool Core::hasSignature(const std::string &file) {
 	bool ret = false;
 	xmlDocPtr doc = xmlParseFile( file.c_str() );
@@ -1303,9 +2578,15 @@ done:
 
 void core_set_error(const char *file, int line, const char *func, const char *errobj, const char *errsbj,
                           int reason, const char *msg) {
+	if( !capture_errors ) {
+		xmlSecErrorsDefaultCallback( file, line, func, errobj, errsbj, reason, msg );
+		return;
+	}
+	XSEC_TRACE( TL_ERROR, TC_XMLSEC, "xmlsec.error", { {"file", file}, {"line", line}, {"func", func},
+	                                                   {"object", errobj}, {"subject", errsbj},
+	                                                   {"reason", reason}, {"message", msg} } );
 	if( msg && strlen(msg) > 1 ) {
 		Core::serror_msg = msg;
-		fprintf(stderr, "'%s'\n", msg);
 	}
 }
 
@@ -1326,5 +2607,25 @@ bool is_ancestor_of(xmlNodePtr anc, xmlNodePtr node){
 	return false;
 }
 
-std::string Core::serror_msg;
+// puts a new transform of the given id in place of old, for use in preExecCallbacks
+xmlSecTransformPtr replace_transform(xmlSecTransformCtxPtr ctx, xmlSecTransformPtr old, xmlSecTransformId id) {
+	auto repl = xmlSecTransformCreate( id );
+	if( repl == nullptr )
+		return nullptr;
+	repl->operation = old->operation;
+	repl->hereNode  = old->hereNode;
+
+	repl->prev = old->prev;
+	repl->next = old->next;
+	if( old->prev != nullptr ) old->prev->next = repl;
+	else                       ctx->first = repl;
+	if( old->next != nullptr ) old->next->prev = repl;
+	else                       ctx->last = repl;
+
+	old->prev = old->next = nullptr;
+	xmlSecTransformDestroy( old );
+	return repl;
+}
+
+thread_local std::string Core::serror_msg;
 } // namespace
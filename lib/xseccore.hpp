@@ -31,15 +31,26 @@
 #define CTXE
 #endif
 
+#include <set>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "xsectrace.hpp"
+#include "xsecmetrics.hpp"
+
 
 namespace XSec {
 
 #include <xmlsec/keysmngr.h>
 
 class Core;
+class Key;
+class KeyCache;
+class VerifyCache;
+class ChainCache;
+class CertCache;
+class CrlStore;
 
 typedef struct _xsec_sign_options_t    sign_options_t;
 typedef struct _xsec_verify_options_t  verify_options_t;
@@ -55,6 +66,72 @@ typedef struct reference_t {
 	std::string xpath_union;
 } Reference;
 
+/* receives a result piece by piece, returns 0 to go on, anything else fails the call */
+typedef int (*WriteFn)(void *ctx, const char *data, size_t len);
+
+/* where a call takes its document from: the file at path ("-" is stdin)
+ * or, without a path, size bytes at data, which have to stay valid during the call */
+typedef struct source_t {
+	const char *path = nullptr;
+	const char *data = nullptr;
+	size_t      size = 0;
+} Source;
+
+/* where a call puts its result: the file at path ("-" is stdout), the string memory
+ * (its content is replaced) or write. If more than one is set, write comes first, then memory */
+typedef struct sink_t {
+	const char  *path   = nullptr;
+	std::string *memory = nullptr;
+	WriteFn      write  = nullptr;
+	void        *ctx    = nullptr;
+} Sink;
+
+typedef struct recipient_t {
+	bool public_key_is_cert = false;
+	bool keys_in_p12 = false;
+	std::string public_key;
+	std::string key_password;
+	/* used instead of public_key if set, the flags above still choose what is embedded */
+	const Key *key = nullptr;
+} Recipient;
+
+/* how the document of a call is parsed */
+typedef struct parse_profile_t {
+	/* lifts the limits of libxml2 on depth and size of text nodes, for trusted documents only */
+	bool huge = false;
+	/* stores short text inside the nodes, less allocations but the tree can't be changed as much */
+	bool compact = false;
+	/* drops whitespace-only text nodes, which changes what is signed */
+	bool no_blanks = false;
+	/* PD_*, by default the DTD of a file is loaded and its entities are substituted, that of a document in memory isn't */
+	int  dtd = 0;
+	/* interns names in a dictionary kept by the Core across its calls instead of one per document,
+	 * which saves memory and allocations for batches of similar documents */
+	bool shared_dict = false;
+} ParseProfile;
+
+/* bounds on what one call takes on, so broken or hostile documents fail fast with LIMIT_EXCEEDED
+ * instead of keeping a thread busy and growing without end. 0 is no bound, which is the default */
+typedef struct limits_t {
+	/* size of the document */
+	size_t        document_bytes = 0;
+	/* nesting of elements, libxml2 stops at 256 unless ParseProfile::huge is set */
+	unsigned      depth = 0;
+	/* elements and attributes of the document */
+	size_t        nodes = 0;
+	/* text entity references expand to, summed over all references */
+	size_t        entity_bytes = 0;
+	/* References of a signature */
+	unsigned      references = 0;
+	/* Transforms of one reference */
+	unsigned      transforms = 0;
+	/* steps of one XPath, XPath2 or XPointer transform as libxml2 counts them */
+	unsigned long xpath_ops = 0;
+} Limits;
+
+/* the error code of calls that exceeded one of their Limits */
+const int LIMIT_EXCEEDED = -130;
+
 enum C14NAlgo {
 	C14N_UNSET = 0,
 	C14N_11_INCLUSIVE,
@@ -87,7 +164,10 @@ enum SignAlgo {
 	SA_ECDSA_SHA224,
 	SA_ECDSA_SHA256,
 	SA_ECDSA_SHA384,
-	SA_ECDSA_SHA512
+	SA_ECDSA_SHA512,
+	SA_HMAC_SHA256,
+	SA_HMAC_SHA384,
+	SA_HMAC_SHA512
 };
 
 enum EncAlgo {
@@ -95,7 +175,19 @@ enum EncAlgo {
 	EA_AES128_CBC,
 	EA_AES192_CBC,
 	EA_AES256_CBC,
-	EA_3DES_CBC
+	EA_3DES_CBC,
+	EA_AES128_GCM,
+	EA_AES192_GCM,
+	EA_AES256_GCM
+};
+
+enum KeyTransAlgo {
+	KT_UNSET = 0,
+	KT_RSA_PKCS1,
+	KT_RSA_OAEP,
+	KT_AES128_KW,
+	KT_AES192_KW,
+	KT_AES256_KW
 };
 
 enum HashAlgo {
@@ -107,15 +199,33 @@ enum HashAlgo {
 	HA_SHA512
 };
 
+enum OutputFormat {
+	OF_UNSET = 0,
+	OF_COMPACT,
+	OF_INDENTED
+};
+
+enum ParseDtd {
+	PD_UNSET = 0,
+	PD_IGNORE,
+	PD_LOAD
+};
+
 xmlSecTransformId get_hash_id(int hash_algo);
 xmlSecTransformId get_sign_id(int sign_algo);
+bool is_hmac(int sign_algo);
 xmlSecTransformId get_c14n_id(int c14n_algo);
 xmlSecTransformId get_enc_id(int enc_algo);
 xmlSecKeyDataId get_key_id(int enc_algo);
 xmlSecSize get_key_size(int enc_algo);
+xmlSecTransformId get_key_trans_id(int kt_algo);
+bool is_key_wrap(int kt_algo);
 
 bool is_ancestor_of(xmlNodePtr anc, xmlNodePtr node);
+xmlSecTransformPtr replace_transform(xmlSecTransformCtxPtr ctx, xmlSecTransformPtr old, xmlSecTransformId id);
 
+/* one Core may only be used by one thread at a time, but every thread can have its own,
+ * the libraries below are set up by the first Core of the process and shut down with the last one */
 class Core {
 	static const int32_t core_version = 0x00000100;
 
@@ -140,6 +250,20 @@ public:
 	int
 	decrypt( const std::string &document, std::string &result, const decrypt_options_t &options );
 
+	/* the calls above with document and result given explicitly, doc_in_memory is not looked at.
+	 * Documents in memory are never copied, results given to a WriteFn aren't either */
+	int
+	sign( const Source &document, const Sink &result, const sign_options_t &options );
+
+	int
+	verify( const Source &document, bool &result, const verify_options_t &options );
+
+	int
+	encrypt( const Source &document, const Sink &result, const encrypt_options_t &options );
+
+	int
+	decrypt( const Source &document, const Sink &result, const decrypt_options_t &options );
+
 	/*void
 	setDefaultKeypair(const std::string &pubkey, const std::string &privkey );
 
@@ -149,6 +273,47 @@ public:
 	void
 	setDefaultC11nAlgorithm(const std::string &algo);*/
 
+	/* loads keys through cache from now on (nullptr to stop), the cache has to outlive the Core */
+	void
+	set_key_cache(KeyCache *cache) { key_cache = cache; }
+
+	/* answers verify calls for documents seen before from cache (nullptr to stop), see VerifyCache */
+	void
+	set_verify_cache(VerifyCache *cache) { verify_cache = cache; }
+
+	/* takes embedded certificates validated before without building their chain again (nullptr to stop), see ChainCache */
+	void
+	set_chain_cache(ChainCache *cache) { chain_cache = cache; }
+
+	/* takes embedded certificates parsed before from cache instead of decoding them again (nullptr to stop), see CertCache */
+	void
+	set_cert_cache(CertCache *cache) { cert_cache = cache; }
+
+	/* checks certificates against the revocation lists of store (nullptr to stop), see CrlStore */
+	void
+	set_crl_store(CrlStore *store) { crl_store = store; }
+
+	/* bounds every call from now on */
+	void
+	set_limits(const Limits &bounds) { limits = bounds; }
+
+	const Limits &
+	get_limits() const { return limits; }
+
+	/* trusts the certificates in dir too, a directory hashed by "openssl rehash", which are read
+	 * one by one as needed. The system trust store is read once a call first needs it */
+	int
+	set_ca_dir(const std::string &dir);
+
+	/* attributes registered as IDs when a document is parsed, which same document URIs like "#res0" refer to.
+	 * Either a plain name or "{namespace uri}name", by default Id, ID, id and the Id of WS-Security utility.
+	 * xml:id always is one, keep Id for the RetrievalMethods of encrypted documents */
+	int
+	set_id_attributes(const std::vector<std::string> &names);
+
+	std::vector<std::string>
+	get_id_attributes() const;
+
 	int32_t
 	version() const { return core_version; }
 
@@ -170,24 +335,81 @@ public:
 private:
 
 	int xerror(const int code, const std::string &msg){
-		//FIXME: DEBUG:
-		fprintf(stderr, msg.c_str());
+		XSEC_TRACE( TL_ERROR, trace_category, "error", { {"code", code}, {"message", msg} } );
 		error_msg = msg;
 		return error_code = code;
 	}
 
+	int add_encrypted_keys(xmlNodePtr keyInfoNode, xmlSecTransformId kt_id,
+	                       const std::vector<Recipient> &recipients, const std::vector<std::string> &key_names);
+
+	/* the store of mngr holds named keys for the current call only, drop_keys() empties it when the call is done */
+	int adopt_key(xmlSecKeyPtr key, const std::string &name);
+	void drop_keys();
+
+	/* adds the trust store to mngr the first time a certificate has to be checked */
+	int load_trust_store();
+
+	/* LIMIT_EXCEEDED if the Signature signNode has more references or transforms than limits allow */
+	int check_signature_limits(xmlNodePtr signNode);
+
+	/* to be called with whatever is added to the trust of mngr, a file identity or a directory,
+	 * false if it was told before and mngr has it already */
+	bool trust_changed(const std::string &what);
+
+	/* what a verify result depends on besides the document, for the verify cache, profile as parsed */
+	std::string verify_context(const verify_options_t &options, const ParseProfile &profile);
+
+	xmlSecKeyPtr load_key(const std::string &path, xmlSecKeyDataFormat format, const std::string &password);
+
+	/* parses document like profile says, memory is read with base_url as its url.
+	 * Fails with LIMIT_EXCEEDED set if the document exceeds limits */
+	xmlDocPtr parse_document(const Source &document, const std::string &base_url, const ParseProfile &profile);
+
+	/* parse_document() for the document of a call, registers its IDs too */
+	xmlDocPtr parse_source(const Source &document, const std::string &base_url, const ParseProfile &profile);
+
+	/* writes the resulting document or decrypted data to result and sets result_bytes, -80 on failure */
+	int write_result(xmlDocPtr doc, int format, const Sink &result);
+	int write_result(const char *data, size_t size, const Sink &result);
+
 	int default_format = SF_ENVELOPED,
 			default_c14n   = C14N_11_INCLUSIVE,
 	    default_hash   = HA_SHA256,
 	    default_sign   = SA_RSA_SHA256,
 	    default_enc_format = EF_ROOT,
-	    default_enc    = EA_AES256_CBC;
+	    default_enc    = EA_AES256_CBC,
+	    default_key_trans = KT_RSA_PKCS1,
+	    default_output = OF_COMPACT;
 
 	std::string error_msg;
-	static std::string serror_msg;
+	/* per thread, like the calls that set it */
+	static thread_local std::string serror_msg;
 	int         error_code;
+	/* size of the result of the running call, for the metrics */
+	uint64_t    result_bytes = 0;
+	/* TC_* of the running operation, for the events of xerror() */
+	unsigned    trace_category = TC_CORE;
 
 	xmlSecKeysMngrPtr mngr;
+	KeyCache         *key_cache = nullptr;
+	bool              trust_loaded = false;
+	std::string       ca_dir;
+	VerifyCache      *verify_cache = nullptr;
+	ChainCache       *chain_cache = nullptr;
+	CertCache        *cert_cache = nullptr;
+	CrlStore         *crl_store = nullptr;
+	Limits            limits;
+	/* for ParseProfile::shared_dict, only ever used by the thread of the Core as libxml2 doesn't lock its lookups */
+	xmlDictPtr        dict = nullptr;
+	/* namespace uri, empty for none, and local name of each attribute parse_source() registers as ID */
+	std::vector<std::pair<std::string, std::string>> id_attributes = {
+		{ "", "Id" }, { "", "ID" }, { "", "id" },
+		{ "http://docs.oasis-open.org/wss/2004/01/oasis-200401-wss-wssecurity-utility-1.0.xsd", "Id" }
+	};
+	/* digest over everything trust_changed() was told in order, Cores told the same have the same */
+	std::string           trust_id;
+	std::set<std::string> trust_seen;
 
 	friend void core_set_error(const char *file, int line, const char *func, const char *errobj, const char *errsbj, int reason, const char *msg);
 };
@@ -198,10 +420,18 @@ struct _xsec_verify_options_t {
 	bool doc_in_memory = false;
 	bool public_key_is_cert = false;
 	bool public_key_is_p12 = false;
+	/* trusts public_key, or without one the first certificate embedded into the signature for this call only */
 	bool trust_selfsigned_cert = false;
 	std::string base_url;
 	std::string public_key;
+	ParseProfile parse;
+	/* raw shared secret file for HMAC signatures, matched by KeyName */
+	std::string secret_key;
 	//std::string key_password;
+	/* used instead of public_key or secret_key if set, has to stay valid during the call */
+	const Key *key = nullptr;
+	/* if set, receives the timing and resource breakdown of the call */
+	Metrics *metrics = nullptr;
 };
 
 struct _xsec_sign_options_t {
@@ -211,6 +441,9 @@ struct _xsec_sign_options_t {
 	bool doc_in_memory = false;
 	bool public_key_is_cert = false;
 	bool keys_in_p12  = false;
+	/* keep the canonicalized data of every reference for inspection (debugging only),
+	 * this holds a full copy of everything that gets digested in memory */
+	bool store_references = false;
 	int  format        = 0;
 	int  c14n_algorithm= 0;
 	int  sign_algorithm= 0;
@@ -218,27 +451,58 @@ struct _xsec_sign_options_t {
 	std::string private_key;
 	std::string public_key;
 	std::string key_password;
+	/* raw shared secret file, used instead of private_key for SA_HMAC_* */
+	std::string secret_key;
+	/* used instead of private_key or secret_key if set. Its certificate is embedded if
+	 * public_key_is_cert or keys_in_p12 is set, its public key otherwise (not for SA_HMAC_*) */
+	const Key *key = nullptr;
 	std::string base_url;
+	/* for the document and the files of enveloping references */
+	ParseProfile parse;
 	std::vector<Reference*> references;
+	/* if set, receives the timing and resource breakdown of the call */
+	Metrics *metrics = nullptr;
 };
 
 struct _xsec_encrypt_options_t {
 	int  encryption_algorithm = 0;
 	int  encryption_form = 0;
+	int  key_transport_algorithm = 0;
 	bool public_key_is_cert = false;
 	bool keys_in_p12  = false;
 	bool trust_selfsigned_cert = false;
 
 	std::string public_key;
 	std::string key_password;
+	/* raw aes key file, used instead of public_key for KT_AES*_KW */
+	std::string key_encryption_key;
+	/* used instead of public_key or key_encryption_key if set, like them */
+	const Key *key = nullptr;
+	const Key *kek = nullptr;
+	/* further recipients besides public_key, each one gets its own EncryptedKey
+	 * for the same session key, the content itself is only encrypted once */
+	std::vector<Recipient> recipients;
 	std::vector<std::string> xpaths;
+	ParseProfile parse;
+	/* if set, receives the timing and resource breakdown of the call */
+	Metrics *metrics = nullptr;
 };
 
 struct _xsec_decrypt_options_t {
 	bool private_key_is_p12 = false;
 	bool trust_selfsigned_cert = false;
+	/* OF_INDENTED is only applied if the result carries no Signature or EncryptedData */
+	int  output_format = 0;
+	ParseProfile parse;
 	std::string private_key;
 	std::string key_password;
+	/* raw aes key file for session keys wrapped with KT_AES*_KW */
+	std::string key_encryption_key;
+	/* used instead of private_key or key_encryption_key if set */
+	const Key *key = nullptr;
+	const Key *kek = nullptr;
+	/* if set, receives the timing and resource breakdown of the call */
+	Metrics *metrics = nullptr;
 };
 
 } // namespace XSec
@@ -0,0 +1,530 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <chrono>
+
+#include "xseccore.hpp"
+#include "xseccrlstore.hpp"
+#include "xsecbase64.hpp"
+
+namespace XSec {
+
+#include <openssl/evp.h>
+
+
+/* layout of an index, in files of index_dir as well, followed by the DER of the issuer's name
+ * (padded to a multiple of 16 bytes) and the table */
+struct IndexHeader {
+	char     magic[8];
+	/* of the CRL file it was built from */
+	uint64_t device, inode, size, mtime_ns;
+	uint64_t entries;
+	uint64_t slots;       // a power of two
+	uint32_t issuer_size;
+	uint32_t reserved;
+};
+
+static const char index_magic[8] = { 'X', 'S', 'E', 'C', 'C', 'R', 'L', '1' };
+
+/* slots of the table are the first 16 bytes of the sha256 of a serial number's DER content,
+ * all zero if empty, lookups probe on from the one its first 8 bytes pick */
+static const size_t slot_size = 16;
+
+struct CrlStore::Index {
+	uint64_t device = 0, inode = 0, size = 0, mtime_ns = 0;
+	uint64_t entries = 0;
+	X509_NAME *issuer = nullptr;
+	void *map = MAP_FAILED;
+	size_t map_size = 0;
+	const unsigned char *table = nullptr;
+	uint64_t mask = 0;
+
+	~Index() {
+		X509_NAME_free( issuer );
+		if( map != MAP_FAILED )
+			munmap( map, map_size );
+	}
+
+	bool
+	contains(const unsigned char *key) const {
+		uint64_t pos;
+		memcpy( &pos, key, sizeof( pos ));
+		for( ;; pos++ ) {
+			auto slot = table + ( pos & mask ) * slot_size;
+			if( memcmp( slot, key, slot_size ) == 0 )
+				return true;
+			static const unsigned char empty[slot_size] = {};
+			if( memcmp( slot, empty, slot_size ) == 0 )
+				return false;
+		}
+	}
+};
+
+
+static uint64_t now_ns() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t mtime_ns(const struct stat &st) {
+	return (uint64_t)st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec;
+}
+
+static const EVP_MD *sha256() {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	// fetched once, an implicit fetch on every digest would cost more than the digest of a serial number
+	static EVP_MD *md = EVP_MD_fetch( nullptr, "SHA256", nullptr );
+	return md;
+#else
+	return EVP_sha256();
+#endif
+}
+
+static bool serial_key(const unsigned char *serial, size_t size, unsigned char *key) {
+	unsigned char md[EVP_MAX_MD_SIZE];
+	unsigned int md_len = 0;
+	if( !EVP_Digest( serial, size, md, &md_len, sha256(), nullptr ) || md_len < slot_size )
+		return false;
+	memcpy( key, md, slot_size );
+	static const unsigned char empty[slot_size] = {};
+	if( memcmp( key, empty, slot_size ) == 0 )
+		key[0] = 1; // never the empty slot, whatever the odds
+	return true;
+}
+
+// content of the DER element at p if it has tag, p is moved past the element then
+static const unsigned char *der_read(const unsigned char *&p, const unsigned char *end, unsigned char tag, size_t &len) {
+	if( end - p < 2 || p[0] != tag )
+		return nullptr;
+
+	auto q = p + 2;
+	len = p[1];
+	if( len & 0x80 ) {
+		size_t bytes = len & 0x7f;
+		if( bytes == 0 || bytes > sizeof( size_t ) || (size_t)( end - q ) < bytes )
+			return nullptr;
+		len = 0;
+		while( bytes-- > 0 )
+			len = ( len << 8 ) | *q++;
+	}
+	if( (size_t)( end - q ) < len )
+		return nullptr;
+
+	p = q + len;
+	return q;
+}
+
+/* the parts of a CertificateList an index is made of, see RFC 5280 5.1 */
+struct CrlParts {
+	const unsigned char *issuer = nullptr; // the whole Name element
+	size_t issuer_size = 0;
+	const unsigned char *revoked = nullptr, *revoked_end = nullptr;
+};
+
+static bool crl_parts(const unsigned char *p, const unsigned char *end, CrlParts &crl) {
+	size_t len;
+	auto list = der_read( p, end, 0x30, len );
+	auto tbs = list ? der_read( list, list + len, 0x30, len ) : nullptr;
+	if( tbs == nullptr )
+		return false;
+
+	auto tbs_end = tbs + len;
+	der_read( tbs, tbs_end, 0x02, len ); // version
+	if( !der_read( tbs, tbs_end, 0x30, len )) // signature
+		return false;
+
+	crl.issuer = tbs;
+	if( !der_read( tbs, tbs_end, 0x30, len ))
+		return false;
+	crl.issuer_size = tbs - crl.issuer;
+
+	// thisUpdate and nextUpdate, UTCTime or GeneralizedTime
+	if( !der_read( tbs, tbs_end, 0x17, len ) && !der_read( tbs, tbs_end, 0x18, len ))
+		return false;
+	if( !der_read( tbs, tbs_end, 0x17, len ))
+		der_read( tbs, tbs_end, 0x18, len );
+
+	crl.revoked = der_read( tbs, tbs_end, 0x30, len );
+	crl.revoked_end = crl.revoked ? crl.revoked + len : nullptr;
+	return true;
+}
+
+// calls f with the DER content of the serial number of every entry, false if they are malformed
+template<typename F>
+static bool crl_serials(const CrlParts &crl, F f) {
+	for( auto p = crl.revoked; p != nullptr && p < crl.revoked_end; ) {
+		size_t len, serial_len;
+		auto entry = der_read( p, crl.revoked_end, 0x30, len );
+		auto serial = entry ? der_read( entry, entry + len, 0x02, serial_len ) : nullptr;
+		if( serial == nullptr || !f( serial, serial_len ))
+			return false;
+	}
+	return true;
+}
+
+// an index file for path in dir, named after the path
+static std::string index_file(const std::string &dir, const std::string &path) {
+	unsigned char md[EVP_MAX_MD_SIZE];
+	unsigned int md_len = 0;
+	EVP_Digest( path.data(), path.size(), md, &md_len, sha256(), nullptr );
+
+	static const char hex[] = "0123456789abcdef";
+	std::string name = dir + "/";
+	for( unsigned int i = 0; i < 16 && i < md_len; i++ ) {
+		name += hex[md[i] >> 4];
+		name += hex[md[i] & 0x0f];
+	}
+	return name + ".crlidx";
+}
+
+
+CrlStore::CrlStore(const std::string &index_dir)
+		: index_dir( index_dir ), checked_ns( 0 ), changes( 0 ) {
+}
+
+CrlStore::~CrlStore() {
+}
+
+int
+CrlStore::add(const std::string &path) {
+	struct stat st;
+	if( stat( path.c_str(), &st ) != 0 ) {
+		last_error = "Error: can't read \"" + path + "\": " + strerror( errno ) + "\n";
+		return -1;
+	}
+
+	std::lock_guard<std::mutex> busy( refresh_lock );
+	if( S_ISREG( st.st_mode )) {
+		// read right away for the error
+		auto index = load( path, last_error );
+		if( !index )
+			return -1;
+
+		std::lock_guard<std::mutex> guard( lock );
+		indexes[path] = index;
+		changes++;
+	}
+	sources.push_back( path );
+	rescan();
+	return 0;
+}
+
+bool
+CrlStore::revoked(X509 *cert) {
+	if( cert == nullptr )
+		return false;
+	if( now_ns() - checked_ns >= 1000000000ull ) {
+		std::unique_lock<std::mutex> busy( refresh_lock, std::try_to_lock );
+		if( busy.owns_lock() )
+			rescan();
+	}
+
+	unsigned char *der = nullptr;
+	int der_len = i2d_ASN1_INTEGER( X509_get0_serialNumber( cert ), &der );
+	const unsigned char *p = der;
+	size_t serial_len;
+	auto serial = der_len > 0 ? der_read( p, der + der_len, 0x02, serial_len ) : nullptr;
+	unsigned char key[slot_size];
+	bool ok = serial != nullptr && serial_key( serial, serial_len, key );
+	OPENSSL_free( der );
+	if( !ok )
+		return false;
+
+	auto issuer = X509_get_issuer_name( cert );
+	std::lock_guard<std::mutex> guard( lock );
+	for( auto &index : indexes ) {
+		if( X509_NAME_cmp( index.second->issuer, issuer ) == 0 && index.second->contains( key ))
+			return true;
+	}
+	return false;
+}
+
+uint64_t
+CrlStore::generation() {
+	if( now_ns() - checked_ns >= 1000000000ull ) {
+		std::unique_lock<std::mutex> busy( refresh_lock, std::try_to_lock );
+		if( busy.owns_lock() )
+			rescan();
+	}
+	return changes;
+}
+
+void
+CrlStore::refresh() {
+	std::lock_guard<std::mutex> busy( refresh_lock );
+	rescan();
+}
+
+size_t
+CrlStore::size() {
+	size_t n = 0;
+	std::lock_guard<std::mutex> guard( lock );
+	for( auto &index : indexes )
+		n += index.second->entries;
+	return n;
+}
+
+// with refresh_lock held, builds the indexes of new and changed files and drops those of removed ones
+void
+CrlStore::rescan() {
+	checked_ns = now_ns();
+
+	std::vector<std::string> files;
+	for( auto &source : sources ) {
+		struct stat st;
+		if( stat( source.c_str(), &st ) != 0 )
+			continue;
+		if( !S_ISDIR( st.st_mode )) {
+			files.push_back( source );
+			continue;
+		}
+
+		auto dir = opendir( source.c_str() );
+		if( dir == nullptr )
+			continue;
+		while( auto entry = readdir( dir )) {
+			if( entry->d_name[0] != '.' )
+				files.push_back( source + "/" + entry->d_name );
+		}
+		closedir( dir );
+	}
+
+	std::map<std::string, std::shared_ptr<Index>> current, next;
+	{
+		std::lock_guard<std::mutex> guard( lock );
+		current = indexes;
+	}
+
+	bool changed = false;
+	for( auto &file : files ) {
+		struct stat st;
+		if( stat( file.c_str(), &st ) != 0 || !S_ISREG( st.st_mode ) || next.count( file ))
+			continue;
+
+		auto it = current.find( file );
+		if( it != current.end() && it->second->device == (uint64_t)st.st_dev && it->second->inode == (uint64_t)st.st_ino
+		    && it->second->size == (uint64_t)st.st_size && it->second->mtime_ns == mtime_ns( st )) {
+			next[file] = it->second;
+			continue;
+		}
+
+		auto identity = std::to_string( st.st_dev ) + ':' + std::to_string( st.st_ino ) + ':'
+		                + std::to_string( st.st_size ) + ':' + std::to_string( mtime_ns( st ));
+		auto skip = skipped.find( file );
+		if( skip != skipped.end() && skip->second == identity )
+			continue;
+
+		std::string error;
+		auto index = load( file, error );
+		if( index ) {
+			next[file] = index;
+			changed = true;
+			continue;
+		}
+
+		skipped[file] = identity; // not tried again until it changes
+		if( it != current.end() )
+			next[file] = it->second; // probably still being written, the old list stays until it's done
+	}
+	changed = changed || next.size() != current.size();
+
+	std::lock_guard<std::mutex> guard( lock );
+	indexes.swap( next );
+	if( changed )
+		changes++;
+}
+
+// the index of the CRL in path, from index_dir if it has a current one
+std::shared_ptr<CrlStore::Index>
+CrlStore::load(const std::string &path, std::string &error) {
+	if( index_dir.empty() )
+		return build( path, std::string(), error );
+
+	char *real = realpath( path.c_str(), nullptr );
+	auto index_path = index_file( index_dir, real != nullptr ? real : path );
+	free( real );
+
+	struct stat st, index_st;
+	int fd = open( index_path.c_str(), O_RDONLY | O_CLOEXEC );
+	if( fd < 0 || stat( path.c_str(), &st ) != 0 || fstat( fd, &index_st ) != 0
+	    || (size_t)index_st.st_size < sizeof( IndexHeader )) {
+		if( fd >= 0 )
+			close( fd );
+		return build( path, index_path, error );
+	}
+
+	auto index = std::make_shared<Index>();
+	index->map_size = index_st.st_size;
+	index->map = mmap( nullptr, index->map_size, PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+	if( index->map == MAP_FAILED )
+		return build( path, index_path, error );
+
+	IndexHeader header;
+	memcpy( &header, index->map, sizeof( header ));
+	size_t table_offset = sizeof( header ) + (( header.issuer_size + 15ull ) & ~15ull );
+	bool current = memcmp( header.magic, index_magic, sizeof( index_magic )) == 0
+	               && header.device == (uint64_t)st.st_dev && header.inode == (uint64_t)st.st_ino
+	               && header.size == (uint64_t)st.st_size && header.mtime_ns == mtime_ns( st )
+	               && header.slots != 0 && ( header.slots & ( header.slots - 1 )) == 0
+	               && header.slots <= ( index->map_size - sizeof( header )) / slot_size
+	               && table_offset + header.slots * slot_size == index->map_size;
+	if( !current )
+		return build( path, index_path, error );
+
+	auto issuer = (const unsigned char *)index->map + sizeof( header );
+	index->issuer = d2i_X509_NAME( nullptr, &issuer, header.issuer_size );
+	if( index->issuer == nullptr )
+		return build( path, index_path, error );
+
+	index->device = header.device;
+	index->inode = header.inode;
+	index->size = header.size;
+	index->mtime_ns = header.mtime_ns;
+	index->entries = header.entries;
+	index->table = (const unsigned char *)index->map + table_offset;
+	index->mask = header.slots - 1;
+	return index;
+}
+
+// reads the CRL in path into a new index, written to index_path unless that's empty
+std::shared_ptr<CrlStore::Index>
+CrlStore::build(const std::string &path, const std::string &index_path, std::string &error) {
+	int fd = open( path.c_str(), O_RDONLY | O_CLOEXEC );
+	struct stat st;
+	if( fd < 0 || fstat( fd, &st ) != 0 || st.st_size == 0 ) {
+		error = "Error: can't read \"" + path + "\"\n";
+		if( fd >= 0 )
+			close( fd );
+		return nullptr;
+	}
+	auto data = mmap( nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if( data == MAP_FAILED ) {
+		error = "Error: can't read \"" + path + "\"\n";
+		return nullptr;
+	}
+
+	auto begin = (const unsigned char *)data, end = begin + st.st_size;
+	std::string der;
+	static const char pem_begin[] = "-----BEGIN X509 CRL-----", pem_end[] = "-----END X509 CRL-----";
+	auto pem = memmem( begin, st.st_size, pem_begin, sizeof( pem_begin ) - 1 );
+	if( pem != nullptr ) {
+		auto b64 = (const char *)pem + sizeof( pem_begin ) - 1;
+		auto b64_end = (const char *)memmem( b64, (const char *)end - b64, pem_end, sizeof( pem_end ) - 1 );
+		der.resize( b64_end ? base64_decoded_size( b64_end - b64 ) : 0 );
+		auto size = b64_end ? base64_decode( b64, b64_end - b64, (unsigned char *) &der[0] ) : -1;
+		der.resize( size > 0 ? size : 0 );
+		begin = (const unsigned char *)der.data();
+		end = begin + der.size();
+	}
+
+	CrlParts crl;
+	uint64_t entries = 0;
+	if( !crl_parts( begin, end, crl ) || !crl_serials( crl, [&]( const unsigned char *, size_t ) { entries++; return true; } )) {
+		munmap( data, st.st_size );
+		error = "Error: \"" + path + "\" holds no CRL\n";
+		return nullptr;
+	}
+
+	auto index = std::make_shared<Index>();
+	auto issuer = crl.issuer;
+	index->issuer = d2i_X509_NAME( nullptr, &issuer, crl.issuer_size );
+
+	// at most three quarters of the slots are taken, lookups seldom probe more than one or two
+	uint64_t slots = 16;
+	while( slots - slots / 4 <= entries )
+		slots *= 2;
+	size_t table_offset = sizeof( IndexHeader ) + (( crl.issuer_size + 15 ) & ~(size_t)15 );
+	index->map_size = table_offset + slots * slot_size;
+
+	std::string tmp_path;
+	if( index->issuer != nullptr && !index_path.empty() ) {
+		tmp_path = index_path + ".XXXXXX";
+		int tmp_fd = mkstemp( &tmp_path[0] );
+		if( tmp_fd >= 0 && ftruncate( tmp_fd, index->map_size ) == 0 )
+			index->map = mmap( nullptr, index->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, tmp_fd, 0 );
+		if( tmp_fd >= 0 )
+			close( tmp_fd );
+		if( index->map == MAP_FAILED ) {
+			unlink( tmp_path.c_str() );
+			tmp_path.clear(); // kept in memory only then
+		}
+	}
+	if( index->issuer != nullptr && index->map == MAP_FAILED )
+		index->map = mmap( nullptr, index->map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+	if( index->map == MAP_FAILED ) {
+		munmap( data, st.st_size );
+		error = "Error: can't index \"" + path + "\"\n";
+		return nullptr;
+	}
+
+	auto out = (unsigned char *)index->map;
+	auto table = out + table_offset;
+	index->table = table;
+	index->mask = slots - 1;
+	index->entries = 0;
+	crl_serials( crl, [&]( const unsigned char *serial, size_t len ) {
+		unsigned char key[slot_size];
+		if( !serial_key( serial, len, key ))
+			return false;
+		if( index->contains( key ))
+			return true; // listed twice
+
+		uint64_t pos;
+		memcpy( &pos, key, sizeof( pos ));
+		static const unsigned char empty[slot_size] = {};
+		while( memcmp( table + ( pos & index->mask ) * slot_size, empty, slot_size ) != 0 )
+			pos++;
+		memcpy( table + ( pos & index->mask ) * slot_size, key, slot_size );
+		index->entries++;
+		return true;
+	});
+
+	IndexHeader header = {};
+	memcpy( header.magic, index_magic, sizeof( index_magic ));
+	header.device = index->device = st.st_dev;
+	header.inode = index->inode = st.st_ino;
+	header.size = index->size = st.st_size;
+	header.mtime_ns = index->mtime_ns = mtime_ns( st );
+	header.entries = index->entries;
+	header.slots = slots;
+	header.issuer_size = crl.issuer_size;
+	memcpy( out, &header, sizeof( header ));
+	memcpy( out + sizeof( header ), crl.issuer, crl.issuer_size );
+	munmap( data, st.st_size );
+
+	// complete, others may map it now
+	if( !tmp_path.empty() && rename( tmp_path.c_str(), index_path.c_str() ) != 0 )
+		unlink( tmp_path.c_str() );
+	return index;
+}
+
+} // namespace XSec
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#ifndef XSEC_CRLSTORE_H
+#define XSEC_CRLSTORE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+namespace XSec {
+
+#include <openssl/x509.h>
+
+/* revocation lists read from local files, given to a Core with set_crl_store(). verify() then takes the
+ * signature of a revoked certificate as invalid and encrypt() refuses to encrypt to one.
+ * One store may be shared by Cores on different threads.
+ *
+ * every CRL gets an index, a hash table of the serial numbers it lists, so looking up a certificate costs
+ * the same for a list of ten million entries as for one of ten. Given an index_dir the indexes are kept there
+ * as files mapped into memory, so starting again only reads the lists that changed in between.
+ * The files are stat()ed again at most once a second, changed ones are indexed anew and new ones in a
+ * directory picked up. The signatures of the lists are not checked, they are local configuration like the
+ * certificates of a CA directory; one CRL per file, indirect and delta CRLs are not supported. */
+class CrlStore {
+public:
+	explicit CrlStore(const std::string &index_dir = std::string());
+	~CrlStore();
+
+	CrlStore(const CrlStore &) = delete;
+	CrlStore &operator=(const CrlStore &) = delete;
+
+	/* reads the CRL in path, PEM or DER, or every one in the directory path (skipping other files),
+	 * returns 0 or -1 and error() tells why */
+	int
+	add(const std::string &path);
+
+	/* true if the list of the issuer of cert has it */
+	bool
+	revoked(X509 *cert);
+
+	/* changes whenever the lists do */
+	uint64_t
+	generation();
+
+	/* checks the files for changes now instead of once the second is over */
+	void
+	refresh();
+
+	/* entries of all lists */
+	size_t
+	size();
+
+	const std::string &
+	error() const { return last_error; }
+
+private:
+	struct Index;
+
+	void
+	rescan();
+
+	std::shared_ptr<Index>
+	load(const std::string &path, std::string &error);
+
+	std::shared_ptr<Index>
+	build(const std::string &path, const std::string &index_path, std::string &error);
+
+	std::string index_dir;
+	std::string last_error;
+	std::vector<std::string> sources; // what add() was given
+	std::mutex refresh_lock;          // held by whoever reads the files
+	std::atomic<uint64_t> checked_ns; // steady clock
+	std::atomic<uint64_t> changes;
+	std::mutex lock;                  // for indexes
+	std::map<std::string, std::shared_ptr<Index>> indexes; // by CRL file
+	std::map<std::string, std::string> skipped; // files holding no CRL, by what they were when tried
+};
+
+} // namespace XSec
+#endif
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#include <atomic>
+
+#include "xseccore.hpp"
+#include "xseckey.hpp"
+
+namespace XSec {
+
+#include <xmlsec/crypto.h>
+
+
+Key::Key(xmlSecKeyPtr key) : key( key ) {
+	static std::atomic<uint64_t> serials( 0 );
+	key_serial = ++serials;
+}
+
+Key *
+Key::load_file(const std::string &path, xmlSecKeyDataFormat format, const std::string &password) {
+	auto key = xmlSecCryptoAppKeyLoad( path.c_str(), format, password.empty() ? nullptr : password.c_str(),
+	                                   nullptr, nullptr );
+	return key != nullptr ? new Key( key ) : nullptr;
+}
+
+Key *
+Key::load_memory(const void *data, size_t size, xmlSecKeyDataFormat format, const std::string &password) {
+	auto key = xmlSecCryptoAppKeyLoadMemory( (const xmlSecByte *) data, size, format,
+	                                         password.empty() ? nullptr : password.c_str(), nullptr, nullptr );
+	return key != nullptr ? new Key( key ) : nullptr;
+}
+
+Key *
+Key::load_raw(xmlSecKeyDataId id, const void *data, size_t size) {
+	auto key = xmlSecKeyReadMemory( id, (const xmlSecByte *) data, size );
+	return key != nullptr ? new Key( key ) : nullptr;
+}
+
+Key *
+Key::load_raw_file(xmlSecKeyDataId id, const std::string &path) {
+	auto key = xmlSecKeyReadBinaryFile( id, path.c_str() );
+	if( key == nullptr )
+		return nullptr;
+
+	auto pos = path.find_last_of( "/\\" );
+	auto name = pos == std::string::npos ? path : path.substr( pos + 1 );
+	if( xmlSecKeySetName( key, BAD_CAST name.c_str() ) < 0 ) {
+		xmlSecKeyDestroy( key );
+		return nullptr;
+	}
+	return new Key( key );
+}
+
+Key::~Key() {
+	xmlSecKeyDestroy( key );
+}
+
+int
+Key::set_name(const std::string &name) {
+	return xmlSecKeySetName( key, BAD_CAST name.c_str() ) < 0 ? -1 : 0;
+}
+
+std::string
+Key::name() const {
+	auto name = xmlSecKeyGetName( key );
+	return name != nullptr ? std::string( (const char *) name ) : std::string();
+}
+
+bool
+Key::has_certificate() const {
+	return xmlSecKeyGetData( key, xmlSecKeyDataX509Id ) != nullptr;
+}
+
+xmlSecKeyPtr
+Key::copy() const {
+	return xmlSecKeyDuplicate( key );
+}
+
+} // namespace XSec
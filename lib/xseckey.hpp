@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#ifndef XSEC_KEY_H
+#define XSEC_KEY_H
+
+#include <stdint.h>
+#include <string>
+
+
+namespace XSec {
+
+#include <xmlsec/keys.h>
+
+/* a key loaded once and given to any number of calls through their options instead of a path.
+ * The calls work on copies of it, so Cores on different threads may use one Key at the same time,
+ * as long as nobody changes it meanwhile */
+class Key {
+public:
+	/* nullptr if the key can't be loaded, format is one of xmlsec's, password may be empty */
+	static Key *
+	load_file(const std::string &path, xmlSecKeyDataFormat format, const std::string &password);
+
+	static Key *
+	load_memory(const void *data, size_t size, xmlSecKeyDataFormat format, const std::string &password);
+
+	/* raw secret of type id, xmlSecKeyDataHmacId or xmlSecKeyDataAesId */
+	static Key *
+	load_raw(xmlSecKeyDataId id, const void *data, size_t size);
+
+	/* the same read from a file, named after the file like shared secrets given by path */
+	static Key *
+	load_raw_file(xmlSecKeyDataId id, const std::string &path);
+
+	~Key();
+
+	Key(const Key &) = delete;
+	Key &operator=(const Key &) = delete;
+
+	/* the name the other side looks the key up by, like the file name of shared secrets and key
+	 * encryption keys given as path. Returns 0 or -1 */
+	int
+	set_name(const std::string &name);
+
+	std::string
+	name() const;
+
+	/* true if a certificate came with the key, from a certificate file or a pkcs12 */
+	bool
+	has_certificate() const;
+
+	/* a copy for one call, owned by the caller, nullptr if out of memory */
+	xmlSecKeyPtr
+	copy() const;
+
+	/* tells keys apart for caches, unique in the process, unlike its address it's never reused */
+	uint64_t
+	serial() const { return key_serial; }
+
+private:
+	explicit Key(xmlSecKeyPtr key);
+
+	xmlSecKeyPtr key;
+	uint64_t     key_serial;
+};
+
+} // namespace XSec
+#endif
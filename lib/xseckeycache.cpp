@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#include <sys/stat.h>
+
+#include "xseccore.hpp"
+#include "xseckeycache.hpp"
+#include "xsecmetrics.hpp"
+
+namespace XSec {
+
+#include <xmlsec/crypto.h>
+
+#include <openssl/evp.h>
+
+
+// passwords are only kept as digest to tell entries apart
+static std::string password_digest(const std::string &password) {
+	unsigned char md[EVP_MAX_MD_SIZE];
+	unsigned int md_len = 0;
+	if( !EVP_Digest( password.data(), password.size(), md, &md_len, EVP_sha256(), nullptr ))
+		return std::string();
+	return std::string( (const char*)md, md_len );
+}
+
+KeyCache::KeyCache(size_t max_keys) : max_keys( max_keys ) {
+}
+
+KeyCache::~KeyCache() {
+	clear();
+}
+
+xmlSecKeyPtr
+KeyCache::load(const std::string &path, xmlSecKeyDataFormat format, const std::string &password) {
+	struct stat st;
+	if( stat( path.c_str(), &st ) != 0 )
+		return nullptr;
+
+	uint64_t mtime_ns = (uint64_t)st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec;
+	auto digest = password_digest( password );
+
+	{
+		std::lock_guard<std::mutex> guard( lock );
+		for( auto it = entries.begin(); it != entries.end(); ++it ) {
+			if( it->path != path || it->format != format || it->password_digest != digest )
+				continue;
+
+			if( it->device == (uint64_t)st.st_dev && it->inode == (uint64_t)st.st_ino
+			    && it->size == (uint64_t)st.st_size && it->mtime_ns == mtime_ns ) {
+				entries.splice( entries.begin(), entries, it );
+				metrics_cache( true );
+				return xmlSecKeyDuplicate( it->key );
+			}
+
+			// the file changed since, forget the old key
+			xmlSecKeyDestroy( it->key );
+			entries.erase( it );
+			break;
+		}
+	}
+
+	// loading may take a while (p12 are unlocked with thousands of iterations), other threads go on meanwhile
+	metrics_cache( false );
+	auto key = xmlSecCryptoAppKeyLoad( path.c_str(), format, password.empty() ? nullptr : password.c_str(),
+	                                   nullptr, nullptr );
+	if( key == nullptr )
+		return nullptr;
+
+	auto copy = xmlSecKeyDuplicate( key );
+	if( copy == nullptr ) {
+		xmlSecKeyDestroy( key );
+		return nullptr;
+	}
+
+	std::lock_guard<std::mutex> guard( lock );
+	entries.push_front( Entry{ path, format, digest, (uint64_t)st.st_dev, (uint64_t)st.st_ino,
+	                           (uint64_t)st.st_size, mtime_ns, key } );
+	while( entries.size() > max_keys ) {
+		xmlSecKeyDestroy( entries.back().key );
+		entries.pop_back();
+	}
+	return copy;
+}
+
+void
+KeyCache::clear() {
+	std::lock_guard<std::mutex> guard( lock );
+	for( auto &e : entries )
+		xmlSecKeyDestroy( e.key );
+	entries.clear();
+}
+
+size_t
+KeyCache::size() {
+	std::lock_guard<std::mutex> guard( lock );
+	return entries.size();
+}
+
+} // namespace XSec
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#ifndef XSEC_KEYCACHE_H
+#define XSEC_KEYCACHE_H
+
+#include <stdint.h>
+#include <list>
+#include <mutex>
+#include <string>
+
+
+namespace XSec {
+
+#include <xmlsec/keys.h>
+
+/* keeps the keys Core loads from files (pem, p12 and certificates), so repeated calls with the
+ * same key skip parsing and unlocking it, one cache may be shared by Cores on different threads
+ *
+ * entries are told apart by path, format and password and loaded again once the file changes,
+ * the least recently used one is dropped when max_keys are held. Keep in mind unlocked private
+ * keys stay in memory for as long as they're cached. */
+class KeyCache {
+public:
+	explicit KeyCache(size_t max_keys = 64);
+	~KeyCache();
+
+	KeyCache(const KeyCache &) = delete;
+	KeyCache &operator=(const KeyCache &) = delete;
+
+	/* a copy of the key owned by the caller, like xmlSecCryptoAppKeyLoad() would return it,
+	 * or nullptr if the file can't be loaded (failures are not cached) */
+	xmlSecKeyPtr
+	load(const std::string &path, xmlSecKeyDataFormat format, const std::string &password);
+
+	void
+	clear();
+
+	size_t
+	size();
+
+private:
+	struct Entry {
+		std::string path;
+		xmlSecKeyDataFormat format;
+		std::string password_digest;
+		/* identifies the version of the file the key was loaded from */
+		uint64_t device, inode, size, mtime_ns;
+		xmlSecKeyPtr key;
+	};
+
+	size_t max_keys;
+	std::mutex lock;
+	std::list<Entry> entries; // most recently used first
+};
+
+} // namespace XSec
+#endif
@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+#if defined(__GLIBC__)
+#define XSEC_METRICS_HEAP
+#include <malloc.h>
+#endif
+
+#include "xseccore.hpp"
+#include "xsecmetrics.hpp"
+
+namespace XSec {
+
+#include <libxml/xmlmemory.h>
+
+
+static const char *phase_names[MP_COUNT] = {
+	"other", "parse", "keys", "template", "c14n", "crypto", "base64", "serialize"
+};
+
+static const char *op_names[MO_COUNT] = { "sign", "verify", "encrypt", "decrypt" };
+
+/* upper bounds of the duration histogram in seconds */
+static const double duration_buckets[] = { 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10 };
+#define DURATION_BUCKETS (sizeof(duration_buckets) / sizeof(duration_buckets[0]))
+
+static struct {
+	std::mutex lock;
+	std::atomic<bool> enabled{ false };
+
+	struct {
+		uint64_t calls;
+		uint64_t errors;
+		uint64_t buckets[DURATION_BUCKETS];
+		double   seconds;
+		double   phase_seconds[MP_COUNT];
+		uint64_t bytes_in;
+		uint64_t bytes_out;
+		uint64_t nodes;
+		uint64_t heap_peak_max;
+		uint64_t allocations;
+		uint64_t cache_hits;
+		uint64_t cache_misses;
+	} op[MO_COUNT] = {};
+} aggregate;
+
+/* the call measured on this thread */
+static thread_local struct {
+	Metrics *m = nullptr;
+	Metrics  own;
+	int      phase = MP_OTHER;
+	uint64_t phase_start = 0;
+	int64_t  heap_base = 0;
+	uint64_t allocs_base = 0;
+} current;
+
+static thread_local int64_t heap_now = 0, heap_high = 0;
+static thread_local uint64_t heap_allocs = 0;
+static bool heap_tracked = false;
+
+
+static uint64_t
+now_ns() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+	         std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+const char *metrics_phase_name(int phase) {
+	return (phase >= 0 && phase < MP_COUNT) ? phase_names[phase] : "unknown";
+}
+
+const char *metrics_op_name(int op) {
+	return (op >= 0 && op < MO_COUNT) ? op_names[op] : "unknown";
+}
+
+#ifdef XSEC_METRICS_HEAP
+/* malloc_usable_size() keeps the hooks compatible with blocks allocated before they were installed */
+static void
+heap_add(void *p) {
+	if( p == nullptr )
+		return;
+	heap_allocs++;
+	heap_now += malloc_usable_size( p );
+	if( heap_now > heap_high )
+		heap_high = heap_now;
+}
+
+static void
+heap_free(void *p) {
+	if( p == nullptr )
+		return;
+	heap_now -= malloc_usable_size( p );
+	free( p );
+}
+
+static void *
+heap_malloc(size_t size) {
+	void *p = malloc( size );
+	heap_add( p );
+	return p;
+}
+
+static void *
+heap_realloc(void *p, size_t size) {
+	size_t old = p ? malloc_usable_size( p ) : 0;
+	void *np = realloc( p, size );
+	if( np != nullptr ) {
+		heap_now -= old;
+		heap_add( np );
+	}
+	return np;
+}
+
+static char *
+heap_strdup(const char *s) {
+	char *p = strdup( s );
+	heap_add( p );
+	return p;
+}
+#endif
+
+bool metrics_track_heap() {
+#ifdef XSEC_METRICS_HEAP
+	if( !heap_tracked )
+		heap_tracked = xmlMemSetup( heap_free, heap_malloc, heap_realloc, heap_strdup ) == 0;
+	return heap_tracked;
+#else
+	return false;
+#endif
+}
+
+void metrics_aggregate(bool enable) {
+	aggregate.enabled = enable;
+}
+
+void metrics_begin(int op, Metrics *m) {
+	if( m == nullptr ) {
+		if( !aggregate.enabled ) {
+			current.m = nullptr;
+			return;
+		}
+		m = &current.own;
+	}
+
+	*m = Metrics();
+	m->operation = op;
+	m->start_ns  = now_ns();
+
+	current.m = m;
+	current.phase = MP_OTHER;
+	current.phase_start = m->start_ns;
+	current.heap_base = heap_now;
+	current.allocs_base = heap_allocs;
+	heap_high = heap_now;
+}
+
+bool metrics_active() {
+	return current.m != nullptr;
+}
+
+int metrics_phase(int phase) {
+	int prev = current.phase;
+	if( current.m == nullptr )
+		return prev;
+
+	uint64_t now = now_ns();
+	current.m->phase_ns[prev] += now - current.phase_start;
+	current.phase = phase;
+	current.phase_start = now;
+	return prev;
+}
+
+void metrics_bytes_in(uint64_t bytes) {
+	if( current.m != nullptr )
+		current.m->bytes_in += bytes;
+}
+
+void metrics_bytes_out(uint64_t bytes) {
+	if( current.m != nullptr )
+		current.m->bytes_out += bytes;
+}
+
+void metrics_nodes(uint64_t nodes) {
+	if( current.m != nullptr )
+		current.m->nodes = nodes;
+}
+
+void metrics_cache(bool hit) {
+	if( current.m == nullptr )
+		return;
+	if( hit )
+		current.m->cache_hits++;
+	else
+		current.m->cache_misses++;
+}
+
+void metrics_end(int result) {
+	Metrics *m = current.m;
+	if( m == nullptr )
+		return;
+
+	metrics_phase( MP_OTHER );
+	m->end_ns = current.phase_start;
+	m->result = result;
+	if( heap_tracked && heap_high > current.heap_base )
+		m->heap_peak = heap_high - current.heap_base;
+	m->allocations = heap_allocs - current.allocs_base;
+	current.m = nullptr;
+
+	if( !aggregate.enabled || m->operation < 0 || m->operation >= MO_COUNT )
+		return;
+
+	std::lock_guard<std::mutex> guard( aggregate.lock );
+	auto &a = aggregate.op[m->operation];
+	double seconds = (m->end_ns - m->start_ns) / 1e9;
+	a.calls++;
+	if( result != 0 )
+		a.errors++;
+	for( size_t i = 0; i < DURATION_BUCKETS; i++ ) {
+		if( seconds <= duration_buckets[i] )
+			a.buckets[i]++;
+	}
+	a.seconds += seconds;
+	for( int p = 0; p < MP_COUNT; p++ )
+		a.phase_seconds[p] += m->phase_ns[p] / 1e9;
+	a.bytes_in  += m->bytes_in;
+	a.bytes_out += m->bytes_out;
+	a.nodes     += m->nodes;
+	if( m->heap_peak > a.heap_peak_max )
+		a.heap_peak_max = m->heap_peak;
+	a.allocations  += m->allocations;
+	a.cache_hits   += m->cache_hits;
+	a.cache_misses += m->cache_misses;
+}
+
+/* one counter per operation */
+#define WRITE_COUNTER(name, help, field) \
+	do { \
+		fprintf( fp, "# HELP " name " " help "\n# TYPE " name " counter\n" ); \
+		for( int op = 0; op < MO_COUNT; op++ ) \
+			fprintf( fp, name "{op=\"%s\"} %llu\n", op_names[op], (unsigned long long) snap[op].field ); \
+	} while(0)
+
+int metrics_write_prometheus(const std::string &path) {
+	decltype(aggregate.op) snap;
+	{
+		std::lock_guard<std::mutex> guard( aggregate.lock );
+		memcpy( &snap, &aggregate.op, sizeof(snap) );
+	}
+
+	// the scraper must never see a half written file
+	std::string tmp = path + ".tmp";
+	FILE *fp = fopen( tmp.c_str(), "w" );
+	if( fp == nullptr )
+		return -1;
+
+	fprintf( fp, "# HELP xsec_operation_duration_seconds Duration of Core operations.\n"
+	             "# TYPE xsec_operation_duration_seconds histogram\n" );
+	for( int op = 0; op < MO_COUNT; op++ ) {
+		for( size_t i = 0; i < DURATION_BUCKETS; i++ ) {
+			fprintf( fp, "xsec_operation_duration_seconds_bucket{op=\"%s\",le=\"%g\"} %llu\n",
+			         op_names[op], duration_buckets[i], (unsigned long long) snap[op].buckets[i] );
+		}
+		fprintf( fp, "xsec_operation_duration_seconds_bucket{op=\"%s\",le=\"+Inf\"} %llu\n",
+		         op_names[op], (unsigned long long) snap[op].calls );
+		fprintf( fp, "xsec_operation_duration_seconds_sum{op=\"%s\"} %.9f\n", op_names[op], snap[op].seconds );
+		fprintf( fp, "xsec_operation_duration_seconds_count{op=\"%s\"} %llu\n",
+		         op_names[op], (unsigned long long) snap[op].calls );
+	}
+
+	fprintf( fp, "# HELP xsec_phase_seconds_total Time spent per phase of Core operations.\n"
+	             "# TYPE xsec_phase_seconds_total counter\n" );
+	for( int op = 0; op < MO_COUNT; op++ ) {
+		for( int p = 0; p < MP_COUNT; p++ ) {
+			fprintf( fp, "xsec_phase_seconds_total{op=\"%s\",phase=\"%s\"} %.9f\n",
+			         op_names[op], phase_names[p], snap[op].phase_seconds[p] );
+		}
+	}
+
+	WRITE_COUNTER( "xsec_errors_total", "Core operations that failed.", errors );
+	WRITE_COUNTER( "xsec_bytes_in_total", "Bytes of documents read.", bytes_in );
+	WRITE_COUNTER( "xsec_bytes_out_total", "Bytes of results written.", bytes_out );
+	WRITE_COUNTER( "xsec_nodes_total", "Elements of processed documents.", nodes );
+	WRITE_COUNTER( "xsec_allocations_total", "libxml2 heap allocations during Core operations.", allocations );
+	WRITE_COUNTER( "xsec_cache_hits_total", "Cache hits during Core operations.", cache_hits );
+	WRITE_COUNTER( "xsec_cache_misses_total", "Cache misses during Core operations.", cache_misses );
+
+	fprintf( fp, "# HELP xsec_heap_peak_bytes_max Largest libxml2 heap high-water mark of a single operation.\n"
+	             "# TYPE xsec_heap_peak_bytes_max gauge\n" );
+	for( int op = 0; op < MO_COUNT; op++ ) {
+		fprintf( fp, "xsec_heap_peak_bytes_max{op=\"%s\"} %llu\n",
+		         op_names[op], (unsigned long long) snap[op].heap_peak_max );
+	}
+
+	bool ok = !ferror( fp );
+	ok = fclose( fp ) == 0 && ok;
+	if( !ok || rename( tmp.c_str(), path.c_str() ) != 0 ) {
+		remove( tmp.c_str() );
+		return -1;
+	}
+	return 0;
+}
+
+} // namespace XSec
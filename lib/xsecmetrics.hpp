@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+
+#ifndef XSEC_METRICS_H
+#define XSEC_METRICS_H
+
+#include <stdint.h>
+#include <string>
+
+
+namespace XSec {
+
+enum MetricOp {
+	MO_SIGN = 0,
+	MO_VERIFY,
+	MO_ENCRYPT,
+	MO_DECRYPT,
+	MO_COUNT
+};
+
+enum MetricPhase {
+	MP_OTHER = 0,  // everything not covered by one of the phases below
+	MP_PARSE,
+	MP_KEYS,       // loading keys and certificates
+	MP_TEMPLATE,   // building the signature or encryption template
+	MP_C14N,
+	MP_CRYPTO,     // digests, signature and cipher transforms of xmlsec, including reading external references
+	MP_BASE64,
+	MP_SERIALIZE,
+	MP_COUNT
+};
+
+/* breakdown of one call to Core::sign, verify, encrypt or decrypt */
+typedef struct metrics_t {
+	int      operation  = MO_SIGN;
+	int      result     = 0;
+	uint64_t start_ns   = 0;  // steady clock
+	uint64_t end_ns     = 0;
+	uint64_t phase_ns[MP_COUNT] = {}; // phases don't overlap and add up to end_ns - start_ns
+	uint64_t bytes_in   = 0;
+	uint64_t bytes_out  = 0;
+	uint64_t nodes      = 0;  // elements of the document at the end of the call
+	uint64_t heap_peak  = 0;  // libxml2 heap high-water mark above the start, 0 unless metrics_track_heap() was called
+	uint64_t allocations = 0; // libxml2 (and xmlsec) allocations, 0 unless metrics_track_heap() was called
+	uint64_t cache_hits   = 0;
+	uint64_t cache_misses = 0;
+} Metrics;
+
+/* counts libxml2's (and thereby xmlsec's) heap usage through xmlMemSetup(),
+ * has to be called before anything else uses libxml2, returns false if it's not supported here */
+bool metrics_track_heap();
+
+/* collects every call of this process, not just the ones given a Metrics, for metrics_write_prometheus() */
+void metrics_aggregate(bool enable);
+
+/* writes the collected histograms and counters in prometheus' text format,
+ * replacing path atomically, returns 0 on success or -1 */
+int metrics_write_prometheus(const std::string &path);
+
+const char *metrics_phase_name(int phase);
+const char *metrics_op_name(int op);
+
+/* used by Core and the transforms, metrics_begin() measures into m (or an internal one when aggregating),
+ * everything else is a no-op on a thread without a measured call */
+void metrics_begin(int op, Metrics *m);
+void metrics_end(int result);
+bool metrics_active();
+/* charges the time since the last switch to the current phase and makes phase current, returns the previous one */
+int  metrics_phase(int phase);
+void metrics_bytes_in(uint64_t bytes);
+void metrics_bytes_out(uint64_t bytes);
+void metrics_nodes(uint64_t nodes);
+void metrics_cache(bool hit);
+
+} // namespace XSec
+#endif
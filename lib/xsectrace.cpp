@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#include "xsectrace.hpp"
+
+namespace XSec {
+
+unsigned trace_mask[TL_DEBUG + 1] = { 0, 0, 0, 0, 0 };
+
+static FILE *trace_out = stderr;
+
+static const char *level_names[] = { "off", "error", "warn", "info", "debug" };
+
+static const struct {
+	const char *name;
+	unsigned    category;
+} category_names[] = {
+	{ "core",    TC_CORE },
+	{ "sign",    TC_SIGN },
+	{ "verify",  TC_VERIFY },
+	{ "encrypt", TC_ENCRYPT },
+	{ "decrypt", TC_DECRYPT },
+	{ "xmlsec",  TC_XMLSEC },
+	{ "dump",    TC_DUMP },
+	{ "all",     TC_ALL },
+};
+
+
+void trace_configure(int level, unsigned categories, FILE *out) {
+	for( int l = TL_OFF; l <= TL_DEBUG; l++ )
+		trace_mask[l] = (l != TL_OFF && l <= level) ? categories : 0;
+	trace_out = out ? out : stderr;
+}
+
+void trace_configure_env() {
+	const char *env = getenv( "XSEC_TRACE" );
+	if( env == nullptr || *env == '\0' )
+		return;
+
+	std::string spec( env );
+	size_t colon = spec.find( ':' );
+	std::string level = spec.substr( 0, colon );
+
+	int l = TL_OFF;
+	for( int i = TL_OFF; i <= TL_DEBUG; i++ ) {
+		if( level == level_names[i] )
+			l = i;
+	}
+
+	unsigned categories = 0;
+	if( colon == std::string::npos ) {
+		categories = TC_ALL;
+	}
+	else {
+		size_t pos = colon + 1;
+		while( pos <= spec.size() ) {
+			size_t end = spec.find( ',', pos );
+			if( end == std::string::npos )
+				end = spec.size();
+			std::string name = spec.substr( pos, end - pos );
+			for( auto &c : category_names ) {
+				if( name == c.name )
+					categories |= c.category;
+			}
+			pos = end + 1;
+		}
+	}
+
+	trace_configure( l, categories, stderr );
+}
+
+static void
+append_json(std::string &out, const char *s, size_t len) {
+	static const char hex[] = "0123456789abcdef";
+
+	out += '"';
+	const char *run = s;
+	for( const char *p = s; p < s + len; p++ ) {
+		unsigned char c = *p;
+		if( c >= 0x20 && c != '"' && c != '\\' )
+			continue;
+
+		out.append( run, p - run );
+		run = p + 1;
+		switch( c ) {
+			case '"':  out += "\\\""; break;
+			case '\\': out += "\\\\"; break;
+			case '\n': out += "\\n"; break;
+			case '\r': out += "\\r"; break;
+			case '\t': out += "\\t"; break;
+			default:
+				out += "\\u00";
+				out += hex[c >> 4];
+				out += hex[c & 0xf];
+		}
+	}
+	out.append( run, s + len - run );
+	out += '"';
+}
+
+static const char *
+category_name(unsigned category) {
+	for( auto &c : category_names ) {
+		if( c.category == category )
+			return c.name;
+	}
+	return "core";
+}
+
+void trace_event(int level, unsigned category, const char *event, std::initializer_list<TraceField> fields) {
+	char num[64];
+	std::string line;
+	line.reserve( 256 );
+
+	auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+	            std::chrono::system_clock::now().time_since_epoch() ).count();
+	snprintf( num, sizeof(num), "{\"ts\":%lld.%06lld", (long long) us / 1000000, (long long) us % 1000000 );
+	line += num;
+	line += ",\"level\":\"";
+	line += level_names[level];
+	line += "\",\"cat\":\"";
+	line += category_name( category );
+	line += "\",\"event\":";
+	append_json( line, event, strlen(event) );
+
+	for( auto &f : fields ) {
+		line += ',';
+		append_json( line, f.key, strlen(f.key) );
+		line += ':';
+		switch( f.type ) {
+			case TraceField::T_STR:
+				append_json( line, f.str, f.len );
+				break;
+			case TraceField::T_INT:
+				snprintf( num, sizeof(num), "%lld", f.num );
+				line += num;
+				break;
+			case TraceField::T_REAL:
+				snprintf( num, sizeof(num), "%.17g", f.real );
+				line += num;
+				break;
+			case TraceField::T_BOOL:
+				line += f.num ? "true" : "false";
+				break;
+			default:
+				line += "null";
+		}
+	}
+	line += "}\n";
+
+	// a single write keeps lines of concurrent events apart
+	fwrite( line.data(), 1, line.size(), trace_out );
+	fflush( trace_out );
+}
+
+} // namespace XSec
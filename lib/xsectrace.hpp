@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+
+#ifndef XSEC_TRACE_H
+#define XSEC_TRACE_H
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <initializer_list>
+
+
+namespace XSec {
+
+enum TraceLevel {
+	TL_OFF = 0,
+	TL_ERROR,
+	TL_WARN,
+	TL_INFO,
+	TL_DEBUG
+};
+
+enum TraceCategory {
+	TC_CORE    = 1 << 0,
+	TC_SIGN    = 1 << 1,
+	TC_VERIFY  = 1 << 2,
+	TC_ENCRYPT = 1 << 3,
+	TC_DECRYPT = 1 << 4,
+	TC_XMLSEC  = 1 << 5, // errors reported by xmlsec itself
+	TC_DUMP    = 1 << 6, // whole documents and contexts, huge, never part of TC_ALL
+	TC_ALL     = TC_CORE | TC_SIGN | TC_VERIFY | TC_ENCRYPT | TC_DECRYPT | TC_XMLSEC
+};
+
+/* one key/value pair of an event, only references the value, which has to outlive the event */
+struct TraceField {
+	enum { T_NULL, T_STR, T_INT, T_REAL, T_BOOL };
+
+	TraceField(const char *key, const char *value)
+		: key(key), type(value ? T_STR : T_NULL), str(value), len(value ? strlen(value) : 0) {}
+	TraceField(const char *key, const std::string &value)
+		: key(key), type(T_STR), str(value.data()), len(value.size()) {}
+	TraceField(const char *key, int value)       : key(key), type(T_INT), num(value) {}
+	TraceField(const char *key, long long value) : key(key), type(T_INT), num(value) {}
+	TraceField(const char *key, size_t value)    : key(key), type(T_INT), num((long long) value) {}
+	TraceField(const char *key, double value)    : key(key), type(T_REAL), real(value) {}
+	TraceField(const char *key, bool value)      : key(key), type(T_BOOL), num(value) {}
+
+	const char *key;
+	int         type;
+	const char *str = nullptr;
+	size_t      len = 0;
+	long long   num = 0;
+	double      real = 0;
+};
+
+/* categories enabled per level, tested by XSEC_TRACE before anything else happens */
+extern unsigned trace_mask[TL_DEBUG + 1];
+
+/* enables events up to level for categories, they're written to out as one json object per line */
+void trace_configure(int level, unsigned categories, FILE *out = stderr);
+
+/* configures tracing from the XSEC_TRACE environment variable, if it's set,
+ * like "info" or "debug:sign,verify,dump" */
+void trace_configure_env();
+
+void trace_event(int level, unsigned category, const char *event, std::initializer_list<TraceField> fields);
+
+/* building with XSEC_NO_TRACE removes all events, otherwise a disabled one costs a single branch */
+#ifdef XSEC_NO_TRACE
+#define XSEC_TRACE_ON(level, category) false
+#define XSEC_TRACE(level, category, event, ...) do {} while(0)
+#else
+#define XSEC_TRACE_ON(level, category) ((XSec::trace_mask[level] & (category)) != 0)
+#define XSEC_TRACE(level, category, event, ...) \
+	do { \
+		if( XSEC_TRACE_ON( level, category ) ) \
+			XSec::trace_event( level, category, event, __VA_ARGS__ ); \
+	} while(0)
+#endif
+
+} // namespace XSec
+#endif
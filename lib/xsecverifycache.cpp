@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#include <chrono>
+
+#include "xseccore.hpp"
+#include "xsecverifycache.hpp"
+#include "xsecmetrics.hpp"
+
+namespace XSec {
+
+#include <openssl/evp.h>
+
+
+static uint64_t now_ns() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+VerifyCache::VerifyCache(size_t max_entries, unsigned ttl_seconds, int mode)
+		: max_entries( max_entries ), ttl_ns( ttl_seconds * 1000000000ull ), cache_mode( mode ) {
+}
+
+// a cryptographic digest on purpose, with a weaker one a forged document colliding
+// with a valid one seen before would verify as well
+std::string
+VerifyCache::digest(const char *data, size_t size, const std::string &context) {
+	unsigned char md[EVP_MAX_MD_SIZE];
+	unsigned int md_len = 0;
+	auto ctx = EVP_MD_CTX_new();
+	bool ok = ctx != nullptr
+	          && EVP_DigestInit_ex( ctx, EVP_sha256(), nullptr )
+	          && EVP_DigestUpdate( ctx, context.data(), context.size() )
+	          && EVP_DigestUpdate( ctx, "\0", 1 )
+	          && EVP_DigestUpdate( ctx, data, size )
+	          && EVP_DigestFinal_ex( ctx, md, &md_len );
+	EVP_MD_CTX_free( ctx );
+	return ok ? std::string( (const char*)md, md_len ) : std::string();
+}
+
+bool
+VerifyCache::lookup(const std::string &digest, bool &valid) {
+	std::lock_guard<std::mutex> guard( lock );
+	auto it = index.find( digest );
+	if( it != index.end() && it->second->expires_ns <= now_ns() ) {
+		entries.erase( it->second );
+		index.erase( it );
+		it = index.end();
+	}
+	if( it == index.end() ) {
+		metrics_cache( false );
+		return false;
+	}
+
+	entries.splice( entries.begin(), entries, it->second );
+	valid = it->second->valid;
+	metrics_cache( true );
+	return true;
+}
+
+void
+VerifyCache::store(const std::string &digest, bool valid) {
+	if( max_entries == 0 || digest.empty() )
+		return;
+
+	std::lock_guard<std::mutex> guard( lock );
+	auto it = index.find( digest );
+	if( it != index.end() ) {
+		entries.erase( it->second );
+		index.erase( it );
+	}
+
+	entries.push_front( Entry{ digest, valid, now_ns() + ttl_ns } );
+	index[digest] = entries.begin();
+
+	while( entries.size() > max_entries ) {
+		index.erase( entries.back().digest );
+		entries.pop_back();
+	}
+}
+
+void
+VerifyCache::clear() {
+	std::lock_guard<std::mutex> guard( lock );
+	index.clear();
+	entries.clear();
+}
+
+size_t
+VerifyCache::size() {
+	std::lock_guard<std::mutex> guard( lock );
+	return entries.size();
+}
+
+} // namespace XSec
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#ifndef XSEC_VERIFYCACHE_H
+#define XSEC_VERIFYCACHE_H
+
+#include <stdint.h>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+
+namespace XSec {
+
+enum VerifyCacheMode {
+	VCM_USE = 0,  // a cached result is returned instead of verifying again
+	VCM_SHADOW    // every call still verifies, lookups only show up in the metrics (and a disagreeing result as warning)
+};
+
+/* remembers the results of Core::verify for documents seen before, given to a Core with set_verify_cache().
+ * One cache may be shared by Cores on different threads.
+ *
+ * entries are keyed by a sha256 of the document bytes and of what the result depends on besides them:
+ * the key or key file (by its identity, so changing the file invalidates them), the trust of the Core and
+ * the options. Results of signatures referencing anything outside of their document are never stored,
+ * nor those verified without a key given by one the keys manager had for a KeyName.
+ * Entries expire after ttl_seconds, so certificates expiring or being revoked are noticed eventually,
+ * the least recently used one is dropped when max_entries are held. */
+class VerifyCache {
+public:
+	explicit VerifyCache(size_t max_entries = 4096, unsigned ttl_seconds = 300, int mode = VCM_USE);
+
+	VerifyCache(const VerifyCache &) = delete;
+	VerifyCache &operator=(const VerifyCache &) = delete;
+
+	/* the key of size bytes of document verified in context */
+	static std::string
+	digest(const char *data, size_t size, const std::string &context);
+
+	/* true and valid set if there's a live result for digest, counts a cache hit or miss in the metrics */
+	bool
+	lookup(const std::string &digest, bool &valid);
+
+	void
+	store(const std::string &digest, bool valid);
+
+	int
+	mode() const { return cache_mode; }
+
+	void
+	clear();
+
+	size_t
+	size();
+
+private:
+	struct Entry {
+		std::string digest;
+		bool        valid;
+		uint64_t    expires_ns; // steady clock
+	};
+
+	size_t   max_entries;
+	uint64_t ttl_ns;
+	int      cache_mode;
+	std::mutex lock;
+	std::list<Entry> entries; // most recently used first
+	std::unordered_map<std::string, std::list<Entry>::iterator> index;
+};
+
+} // namespace XSec
+#endif
@@ -0,0 +1,473 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#define XSEC_WRITER_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "xseccore.hpp"
+#include "xsecwriter.hpp"
+
+namespace XSec {
+
+#include <libxml/tree.h>
+#include <libxml/xmlsave.h>
+#include <libxml/parserInternals.h>
+#include <xmlsec/xmltree.h>
+#include <xmlsec/strings.h>
+
+
+/* the file and stream sinks get at least this much at once */
+#define WRITER_CHUNK (1 << 20)
+
+enum {
+	ESC_TEXT = 1, // needs escaping in text nodes
+	ESC_ATTR = 2  // needs escaping in attribute values
+};
+
+static const struct esc_table_t {
+	unsigned char v[256];
+
+	esc_table_t() {
+		memset( v, 0, sizeof(v) );
+		v['<'] = v['>'] = v['&'] = v['\r'] = ESC_TEXT | ESC_ATTR;
+		v['"'] = v['\n'] = v['\t'] = ESC_ATTR;
+	}
+} esc_table;
+
+
+/* length of the prefix of s which can be copied as is,
+ * non-ascii chars need escaping too if ascii is set */
+static size_t
+clean_run(const unsigned char *s, size_t len, int what, bool ascii) {
+	size_t i = 0;
+
+#ifdef XSEC_WRITER_SSE2
+	const __m128i lt  = _mm_set1_epi8( '<' ),  gt = _mm_set1_epi8( '>' ),
+	              amp = _mm_set1_epi8( '&' ),  cr = _mm_set1_epi8( '\r' ),
+	              quot= _mm_set1_epi8( '"' ),  lf = _mm_set1_epi8( '\n' ),
+	              tab = _mm_set1_epi8( '\t' );
+
+	for( ; i + 16 <= len; i += 16 ) {
+		__m128i v = _mm_loadu_si128( (const __m128i*) (s + i) );
+		__m128i m = _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( v, lt ), _mm_cmpeq_epi8( v, gt ) ),
+		                          _mm_or_si128( _mm_cmpeq_epi8( v, amp ), _mm_cmpeq_epi8( v, cr ) ) );
+		if( what == ESC_ATTR ) {
+			m = _mm_or_si128( m, _mm_or_si128( _mm_cmpeq_epi8( v, quot ),
+			                     _mm_or_si128( _mm_cmpeq_epi8( v, lf ), _mm_cmpeq_epi8( v, tab ) ) ) );
+		}
+		int bits = _mm_movemask_epi8( m );
+		if( ascii )
+			bits |= _mm_movemask_epi8( v ); // the high bits
+		if( bits )
+			return i + __builtin_ctz( bits );
+	}
+#endif
+
+	for( ; i < len; i++ ) {
+		if( (esc_table.v[s[i]] & what) || (ascii && s[i] >= 0x80) )
+			return i;
+	}
+	return len;
+}
+
+/* decodes the utf-8 sequence at s, returns its length or 0 if it's not valid */
+static size_t
+utf8_char(const unsigned char *s, size_t len, unsigned int &c) {
+	size_t n;
+	if( s[0] >= 0xf0 && s[0] < 0xf8 ) { n = 4; c = s[0] & 0x07; }
+	else if( s[0] >= 0xe0 )           { n = 3; c = s[0] & 0x0f; }
+	else if( s[0] >= 0xc0 )           { n = 2; c = s[0] & 0x1f; }
+	else return 0;
+
+	if( s[0] >= 0xf8 || n > len )
+		return 0;
+	for( size_t i = 1; i < n; i++ ) {
+		if( (s[i] & 0xc0) != 0x80 )
+			return 0;
+		c = (c << 6) | (s[i] & 0x3f);
+	}
+	return n;
+}
+
+
+typedef int (*write_fn)(void *ctx, const char *data, size_t len);
+
+static int
+file_write(void *ctx, const char *data, size_t len) {
+	return fwrite( data, 1, len, (FILE*) ctx ) == len ? 0 : -1;
+}
+
+class Writer {
+public:
+	/* appends to out */
+	explicit Writer(std::string &out) : out(out) {}
+	/* buffers for write, call flush() when done */
+	Writer(write_fn write, void *ctx) : out(buffer), write(write), ctx(ctx) { buffer.reserve( WRITER_CHUNK + 4096 ); }
+
+	void put(const char *s, size_t len) {
+		if( write && len >= WRITER_CHUNK ) {
+			// large runs like a CipherValue go out directly
+			flush();
+			if( !failed && write( ctx, s, len ) != 0 )
+				failed = true;
+			return;
+		}
+		out.append( s, len );
+		if( write && out.size() >= WRITER_CHUNK )
+			flush();
+	}
+
+	void put(const char *s) { put( s, strlen(s) ); }
+	void put(const xmlChar *s) { put( (const char*) s, strlen( (const char*) s ) ); }
+
+	void put_name(xmlNsPtr ns, const xmlChar *name) {
+		if( ns != nullptr && ns->prefix != nullptr ) {
+			put( ns->prefix );
+			put( ":", 1 );
+		}
+		put( name );
+	}
+
+	/* writes s with the chars in what replaced by references, like libxml2 does */
+	void put_escaped(const xmlChar *s, int what) {
+		const unsigned char *p = s;
+		size_t len = strlen( (const char*) s );
+
+		while( len > 0 ) {
+			size_t n = clean_run( p, len, what, ascii );
+			put( (const char*) p, n );
+			p += n; len -= n;
+			if( len == 0 )
+				break;
+
+			n = 1;
+			switch( *p ) {
+				case '<':  put( "&lt;", 4 ); break;
+				case '>':  put( "&gt;", 4 ); break;
+				case '&':  put( "&amp;", 5 ); break;
+				case '"':  put( "&quot;", 6 ); break;
+				case '\n': put( "&#10;", 5 ); break;
+				case '\t': put( "&#9;", 4 ); break;
+				case '\r': put( (ascii && what == ESC_TEXT) ? "&#xD;" : "&#13;", 5 ); break;
+				default: {
+					char ref[16];
+					unsigned int c;
+					n = utf8_char( p, len, c );
+					if( n > 0 ) {
+						put( ref, snprintf( ref, sizeof(ref), "&#x%X;", c ) );
+					}
+					else {
+						n = 1;
+						put( ref, snprintf( ref, sizeof(ref), "&#%d;", *p ) );
+					}
+				}
+			}
+			p += n; len -= n;
+		}
+	}
+
+	bool flush() {
+		if( write && !out.empty() ) {
+			if( !failed && write( ctx, out.data(), out.size() ) != 0 )
+				failed = true;
+			out.clear();
+		}
+		return !failed;
+	}
+
+	bool ascii  = false; // escape everything but ascii, for documents without an encoding declaration
+	bool indent = false;
+
+private:
+	std::string  buffer;
+	std::string &out;
+	write_fn write = nullptr;
+	void    *ctx   = nullptr;
+	bool failed = false;
+};
+
+
+static bool
+element_only(xmlNodePtr node) {
+	for( xmlNodePtr cur = node->children; cur != nullptr; cur = cur->next ) {
+		if( cur->type == XML_TEXT_NODE || cur->type == XML_CDATA_SECTION_NODE
+		    || cur->type == XML_ENTITY_REF_NODE )
+			return false;
+	}
+	return xmlNodeGetSpacePreserve( node ) != 1;
+}
+
+static void
+write_indent(Writer &w, int level) {
+	static const char spaces[] = "                                        ";
+	for( int n = 2 * level; n > 0; n -= sizeof(spaces) - 1 )
+		w.put( spaces, n < (int) sizeof(spaces) - 1 ? n : sizeof(spaces) - 1 );
+}
+
+static void
+write_node(Writer &w, xmlDocPtr doc, xmlNodePtr cur, int level) {
+	switch( cur->type ) {
+		case XML_ELEMENT_NODE: {
+			w.put( "<", 1 );
+			w.put_name( cur->ns, cur->name );
+
+			for( xmlNsPtr ns = cur->nsDef; ns != nullptr; ns = ns->next ) {
+				if( ns->type != XML_NAMESPACE_DECL || ns->href == nullptr || xmlStrEqual( ns->prefix, BAD_CAST "xml" ) )
+					continue;
+				w.put( " xmlns", 6 );
+				if( ns->prefix != nullptr ) {
+					w.put( ":", 1 );
+					w.put( ns->prefix );
+				}
+				// libxml2 writes the uri unescaped, choosing the quotes
+				const char *q = xmlStrchr( ns->href, '"' ) ? "'" : "\"";
+				w.put( "=", 1 );
+				w.put( q, 1 );
+				w.put( ns->href );
+				w.put( q, 1 );
+			}
+
+			for( xmlAttrPtr attr = cur->properties; attr != nullptr; attr = attr->next ) {
+				w.put( " ", 1 );
+				w.put_name( attr->ns, attr->name );
+				w.put( "=\"", 2 );
+				for( xmlNodePtr val = attr->children; val != nullptr; val = val->next ) {
+					if( val->type == XML_TEXT_NODE && val->content != nullptr ) {
+						w.put_escaped( val->content, ESC_ATTR );
+					}
+					else if( val->type == XML_ENTITY_REF_NODE ) {
+						w.put( "&", 1 );
+						w.put( val->name );
+						w.put( ";", 1 );
+					}
+				}
+				w.put( "\"", 1 );
+			}
+
+			if( cur->children == nullptr ) {
+				w.put( "/>", 2 );
+				break;
+			}
+
+			bool format = w.indent && element_only( cur );
+			w.put( format ? ">\n" : ">", format ? 2 : 1 );
+
+			for( xmlNodePtr child = cur->children; child != nullptr; child = child->next ) {
+				if( format )
+					write_indent( w, level + 1 );
+				write_node( w, doc, child, level + 1 );
+				if( format )
+					w.put( "\n", 1 );
+			}
+
+			if( format )
+				write_indent( w, level );
+			w.put( "</", 2 );
+			w.put_name( cur->ns, cur->name );
+			w.put( ">", 1 );
+			break;
+		}
+
+		case XML_TEXT_NODE:
+			if( cur->content == nullptr )
+				break;
+			if( cur->name == xmlStringTextNoenc )
+				w.put( cur->content );
+			else
+				w.put_escaped( cur->content, ESC_TEXT );
+			break;
+
+		case XML_CDATA_SECTION_NODE: {
+			// a "]]>" inside is split into two sections
+			const xmlChar *start = cur->content, *end = cur->content;
+			if( start == nullptr || *start == '\0' ) {
+				w.put( "<![CDATA[]]>" );
+				break;
+			}
+			for( ; *end != '\0'; end++ ) {
+				if( end[0] == ']' && end[1] == ']' && end[2] == '>' ) {
+					end += 2;
+					w.put( "<![CDATA[", 9 );
+					w.put( (const char*) start, end - start );
+					w.put( "]]>", 3 );
+					start = end;
+				}
+			}
+			if( start != end ) {
+				w.put( "<![CDATA[", 9 );
+				w.put( (const char*) start, end - start );
+				w.put( "]]>", 3 );
+			}
+			break;
+		}
+
+		case XML_COMMENT_NODE:
+			if( cur->content != nullptr ) {
+				w.put( "<!--", 4 );
+				w.put( cur->content );
+				w.put( "-->", 3 );
+			}
+			break;
+
+		case XML_PI_NODE:
+			w.put( "<?", 2 );
+			w.put( cur->name );
+			if( cur->content != nullptr ) {
+				w.put( " ", 1 );
+				w.put( cur->content );
+			}
+			w.put( "?>", 2 );
+			break;
+
+		case XML_ENTITY_REF_NODE:
+			w.put( "&", 1 );
+			w.put( cur->name );
+			w.put( ";", 1 );
+			break;
+
+		default: {
+			// dtds and other rarities are left to libxml2
+			xmlBufferPtr buf = xmlBufferCreate();
+			if( buf == nullptr )
+				break;
+			xmlNodeDump( buf, doc, cur, level, 0 );
+			w.put( (const char*) xmlBufferContent( buf ), xmlBufferLength( buf ) );
+			xmlBufferFree( buf );
+		}
+	}
+}
+
+static bool
+may_indent(xmlDocPtr doc, int format) {
+	xmlNodePtr root = xmlDocGetRootElement( doc );
+	return format == OF_INDENTED && root != nullptr
+	       && xmlSecFindNode( root, xmlSecNodeSignature, xmlSecDSigNs ) == nullptr
+	       && xmlSecFindNode( root, xmlSecNodeEncryptedData, xmlSecEncNs ) == nullptr;
+}
+
+/* true if the fast path can produce the output, libxml2 has to transcode anything but utf-8 */
+static bool
+is_utf8(xmlDocPtr doc) {
+	return doc->encoding == nullptr
+	       || xmlStrcasecmp( doc->encoding, BAD_CAST "UTF-8" ) == 0
+	       || xmlStrcasecmp( doc->encoding, BAD_CAST "UTF8" ) == 0;
+}
+
+static void
+write_document(Writer &w, xmlDocPtr doc) {
+	w.ascii = doc->encoding == nullptr;
+
+	w.put( "<?xml version=\"", 15 );
+	w.put( doc->version ? (const char*) doc->version : "1.0" );
+	w.put( "\"", 1 );
+	if( doc->encoding != nullptr ) {
+		w.put( " encoding=\"", 11 );
+		w.put( doc->encoding );
+		w.put( "\"", 1 );
+	}
+	if( doc->standalone == 0 )
+		w.put( " standalone=\"no\"" );
+	else if( doc->standalone == 1 )
+		w.put( " standalone=\"yes\"" );
+	w.put( "?>\n", 3 );
+
+	for( xmlNodePtr cur = doc->children; cur != nullptr; cur = cur->next ) {
+		write_node( w, doc, cur, 0 );
+		w.put( "\n", 1 );
+	}
+}
+
+int save_document_file(xmlDocPtr doc, int format, const std::string &path) {
+	bool indent = may_indent( doc, format );
+
+	if( !is_utf8( doc ) )
+		return xmlSaveFormatFile( path.c_str(), doc, indent ) < 0 ? -1 : 0;
+
+	bool is_stdout = path == "-";
+	FILE *fp = is_stdout ? stdout : fopen( path.c_str(), "wb" );
+	if( fp == nullptr )
+		return -1;
+	if( !is_stdout )
+		setvbuf( fp, nullptr, _IONBF, 0 ); // Writer does the buffering
+
+	Writer w( file_write, fp );
+	w.indent = indent;
+	write_document( w, doc );
+
+	bool ok = w.flush();
+	if( is_stdout )
+		ok = fflush( fp ) == 0 && ok;
+	else
+		ok = fclose( fp ) == 0 && ok;
+	return ok ? 0 : -1;
+}
+
+int save_document_memory(xmlDocPtr doc, int format, std::string &out) {
+	bool indent = may_indent( doc, format );
+
+	out.clear();
+	if( !is_utf8( doc ) ) {
+		xmlChar *xbuff = nullptr;
+		int buffsize = 0;
+
+		xmlDocDumpFormatMemory( doc, &xbuff, &buffsize, indent );
+		if( xbuff == nullptr )
+			return -1;
+		out.assign( (char *) xbuff, buffsize );
+		xmlFree( xbuff );
+		return 0;
+	}
+
+	Writer w( out );
+	w.indent = indent;
+	write_document( w, doc );
+	return 0;
+}
+
+int save_document_stream(xmlDocPtr doc, int format, int (*write)(void *ctx, const char *data, size_t len), void *ctx) {
+	bool indent = may_indent( doc, format );
+
+	if( !is_utf8( doc ) ) {
+		xmlChar *xbuff = nullptr;
+		int buffsize = 0;
+
+		xmlDocDumpFormatMemory( doc, &xbuff, &buffsize, indent );
+		if( xbuff == nullptr )
+			return -1;
+		int ret = write( ctx, (const char *) xbuff, buffsize ) == 0 ? 0 : -1;
+		xmlFree( xbuff );
+		return ret;
+	}
+
+	Writer w( write, ctx );
+	w.indent = indent;
+	write_document( w, doc );
+	return w.flush() ? 0 : -1;
+}
+
+} // namespace XSec
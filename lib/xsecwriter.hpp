@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+
+#ifndef XSEC_WRITER_H
+#define XSEC_WRITER_H
+
+
+namespace XSec {
+
+#include <libxml/tree.h>
+
+/* serializes doc to the file at path ("-" is stdout), byte for byte what xmlSaveFile() would write
+ * for OF_COMPACT, returns 0 on success or -1 if the file could not be written
+ *
+ * OF_INDENTED puts the children of elements with element-only content on lines of their own,
+ * like xmlSaveFormatFile(). Documents holding a Signature or EncryptedData are written compact
+ * nevertheless, added whitespace would change signed content (maybe one not visible until decryption) */
+int save_document_file(xmlDocPtr doc, int format, const std::string &path);
+
+/* same as save_document_file(), but replaces the content of out */
+int save_document_memory(xmlDocPtr doc, int format, std::string &out);
+
+/* same as save_document_file(), but hands the output to write in chunks of about a megabyte,
+ * write returns 0 to go on, the call fails with -1 as soon as it returns anything else */
+int save_document_stream(xmlDocPtr doc, int format, int (*write)(void *ctx, const char *data, size_t len), void *ctx);
+
+} // namespace XSec
+#endif
@@ -43,9 +43,11 @@ XSDDecryptDialog::setupUi() {
 	publicLay = new QFormLayout();
 
 	keyLabel = new QLabel(QStringLiteral("Privater Schlüssel"));
+	kekLabel = new QLabel(QStringLiteral("Schlüssel (AES-KW)"));
 	passwdLine = new QLineEdit();
 
 	keyLine = new FileSelect();
+	kekLine = new FileSelect();
 	passwdBox = new QCheckBox(QStringLiteral("Kennwort"));
 	saveAsLabel = new QLabel(QStringLiteral("Speichern als:"));
 	saveAsLine = new FileSaveSelect();
@@ -61,6 +63,8 @@ XSDDecryptDialog::setupUi() {
 	publicLay->setWidget(0, QFormLayout::FieldRole, keyLine);
 	publicLay->setWidget(1, QFormLayout::LabelRole, passwdBox);
 	publicLay->setWidget(1, QFormLayout::FieldRole, passwdLine);
+	publicLay->setWidget(2, QFormLayout::LabelRole, kekLabel);
+	publicLay->setWidget(2, QFormLayout::FieldRole, kekLine);
 
 
 	mainLay->addLayout(publicLay);
@@ -90,6 +94,7 @@ void XSDDecryptDialog::slotDecrypt() {
 		dco.key_password = passwdLine->text().toStdString();
 	dco.private_key = keyLine->text().toStdString();
 	dco.private_key_is_p12 = (QFileInfo(keyLine->text()).suffix() == QStringLiteral("p12"));
+	dco.key_encryption_key = kekLine->text().toStdString();
 
 	auto ret = core.decrypt( _file.toStdString(), newfile, dco );
 	if( ret != 0 ) {
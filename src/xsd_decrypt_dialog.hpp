@@ -64,10 +64,10 @@ private:
 	XSec::Core core;
 	QString _file;
 
-	FileSelect *keyLine;
+	FileSelect *keyLine, *kekLine;
 	QCheckBox *trustCert;
 	QDialogButtonBox *buttons;
-	QLabel *keyLabel, *saveAsLabel;
+	QLabel *keyLabel, *kekLabel, *saveAsLabel;
 	QCheckBox *passwdBox;
 	QLineEdit *passwdLine;
 
@@ -45,8 +45,11 @@ XSDEncryptDialog::setupUi() {
 
 	typeLabel = new QLabel(QStringLiteral("Algorithmus"));
 	formLabel = new QLabel(QStringLiteral("Form"));
+	transLabel = new QLabel(QStringLiteral("Schlüsseltransport"));
+	kekLabel = new QLabel(QStringLiteral("Schlüssel (AES-KW)"));
 	saveAsLabel = new QLabel(QStringLiteral("Speichern als:"));
 	xpathLabel = new QLabel(QStringLiteral("Elemente die Verschlüsselt werden als XPath (einer pro Zeile):"));
+	recipientsLabel = new QLabel(QStringLiteral("Weitere Empfänger als Zertifikat oder P12 Datei (eine pro Zeile):"));
 	passwdBox = new QCheckBox(QStringLiteral("Kennwort"));
 	certRadio = new QRadioButton(QStringLiteral("Zertifikat"));
 	keyRadio = new QRadioButton(QStringLiteral("Öffentlicher Schlüssel"));
@@ -54,12 +57,15 @@ XSDEncryptDialog::setupUi() {
 	publicCLine = new FileSelect();
 	publicKLine = new FileSelect();
 	publicPLine = new FileSelect();
+	kekLine = new FileSelect();
 	passwdLine = new QLineEdit();
 	publicBox = new QGroupBox();
 	saveAsLine = new FileSaveSelect();
 	formBox = new QComboBox();
 	typeBox = new QComboBox();
+	transBox = new QComboBox();
 	xpathList = new QTextEdit();
+	recipientsList = new QTextEdit();
 	buttons = new QDialogButtonBox(this);
 
 	buttons->setStandardButtons(QDialogButtonBox::Ok|QDialogButtonBox::Abort);
@@ -74,6 +80,15 @@ XSDEncryptDialog::setupUi() {
 	typeBox->addItem(QStringLiteral("AES192-CBC"), XSec::EA_AES192_CBC );
 	typeBox->addItem(QStringLiteral("AES256-CBC"), XSec::EA_AES256_CBC );
 	typeBox->addItem(QStringLiteral("3DES-CBC"), XSec::EA_3DES_CBC );
+	typeBox->addItem(QStringLiteral("AES128-GCM"), XSec::EA_AES128_GCM );
+	typeBox->addItem(QStringLiteral("AES192-GCM"), XSec::EA_AES192_GCM );
+	typeBox->addItem(QStringLiteral("AES256-GCM"), XSec::EA_AES256_GCM );
+
+	transBox->addItem(QStringLiteral("RSA PKCS#1 v1.5"), XSec::KT_RSA_PKCS1 );
+	transBox->addItem(QStringLiteral("RSA-OAEP"), XSec::KT_RSA_OAEP );
+	transBox->addItem(QStringLiteral("AES128-KW"), XSec::KT_AES128_KW );
+	transBox->addItem(QStringLiteral("AES192-KW"), XSec::KT_AES192_KW );
+	transBox->addItem(QStringLiteral("AES256-KW"), XSec::KT_AES256_KW );
 
 	upperLay->setFieldGrowthPolicy( QFormLayout::AllNonFixedFieldsGrow );
 	upperLay->setLabelAlignment(Qt::AlignLeft);
@@ -81,6 +96,10 @@ XSDEncryptDialog::setupUi() {
 	upperLay->setWidget(0, QFormLayout::FieldRole, formBox);
 	upperLay->setWidget(1, QFormLayout::LabelRole, typeLabel);
 	upperLay->setWidget(1, QFormLayout::FieldRole, typeBox);
+	upperLay->setWidget(2, QFormLayout::LabelRole, transLabel);
+	upperLay->setWidget(2, QFormLayout::FieldRole, transBox);
+	upperLay->setWidget(3, QFormLayout::LabelRole, kekLabel);
+	upperLay->setWidget(3, QFormLayout::FieldRole, kekLine);
 
 	publicLay->setLabelAlignment(Qt::AlignLeft);
 	publicLay->setWidget(0, QFormLayout::LabelRole, certRadio);
@@ -96,6 +115,8 @@ XSDEncryptDialog::setupUi() {
 	mainLay->addLayout(publicLay);
 	mainLay->addWidget(xpathLabel);
 	mainLay->addWidget(xpathList);
+	mainLay->addWidget(recipientsLabel);
+	mainLay->addWidget(recipientsList);
 	mainLay->addWidget(saveAsLabel);
 	mainLay->addWidget(saveAsLine);
 	mainLay->addWidget(buttons);
@@ -104,12 +125,14 @@ XSDEncryptDialog::setupUi() {
 	connect(certRadio, SIGNAL(toggled(bool)), this, SLOT(slotCertToggled(bool)));
 	connect(keyRadio,  SIGNAL(toggled(bool)), this, SLOT(slotKeyToggled(bool)));
 	connect(p12Radio,  SIGNAL(toggled(bool)), this, SLOT(slotP12Toggled(bool)));
+	connect(transBox,  SIGNAL(currentIndexChanged(int)), this, SLOT(slotTransChanged(int)));
 	connect(buttons, SIGNAL(accepted()), this, SLOT(slotEncrypt()));
 	connect(buttons, SIGNAL(rejected()), this, SLOT(reject()));
 
 	certRadio->setChecked(true);
 	publicKLine->setEnabled(false);
 	publicPLine->setEnabled(false);
+	slotTransChanged(transBox->currentIndex());
 
 	if(_file.isEmpty()){
 		saveAsLine->setText(QStringLiteral("unbenannt-encrypted.xml"));
@@ -120,6 +143,19 @@ XSDEncryptDialog::setupUi() {
 	}
 }
 
+void XSDEncryptDialog::slotTransChanged(int) {
+	// key wrapping uses a shared aes key instead of the recipients public key
+	bool kw = XSec::is_key_wrap( transBox->currentData().toInt() );
+	kekLine->setEnabled( kw );
+	certRadio->setEnabled( !kw );
+	keyRadio->setEnabled( !kw );
+	p12Radio->setEnabled( !kw );
+	recipientsList->setEnabled( !kw );
+	publicCLine->setEnabled( !kw && certRadio->isChecked() );
+	publicKLine->setEnabled( !kw && keyRadio->isChecked() );
+	publicPLine->setEnabled( !kw && p12Radio->isChecked() );
+}
+
 void XSDEncryptDialog::slotEncrypt() {
 	XSec::encrypt_options_t eo;
 
@@ -127,6 +163,10 @@ void XSDEncryptDialog::slotEncrypt() {
 
 	eo.encryption_form = formBox->currentData().toInt();
 	eo.encryption_algorithm = typeBox->currentData().toInt();
+	eo.key_transport_algorithm = transBox->currentData().toInt();
+
+	if( XSec::is_key_wrap( eo.key_transport_algorithm ))
+		eo.key_encryption_key = kekLine->text().toStdString();
 
 	if( passwdBox->isChecked() )
 		eo.key_password = passwdLine->text().toStdString();
@@ -146,6 +186,18 @@ void XSDEncryptDialog::slotEncrypt() {
 		eo.xpaths.push_back( xp.toStdString());
 	}
 
+	if( !XSec::is_key_wrap( eo.key_transport_algorithm )) {
+		for( auto &rc : recipientsList->toPlainText().split("\n", QString::SkipEmptyParts)) {
+			XSec::Recipient r;
+			r.keys_in_p12 = (QFileInfo(rc).suffix() == QStringLiteral("p12"));
+			r.public_key_is_cert = !r.keys_in_p12;
+			r.public_key = rc.toStdString();
+			if( r.keys_in_p12 && passwdBox->isChecked() )
+				r.key_password = passwdLine->text().toStdString();
+			eo.recipients.push_back( r );
+		}
+	}
+
 	auto ret = core.encrypt( _file.toStdString(), newfile, eo );
 	if( ret != 0 ) {
 		QMessageBox box;
@@ -57,6 +57,7 @@ public slots:
 	void slotCertToggled(bool c) { publicCLine->setEnabled(c); }
 	void slotKeyToggled(bool c) { publicKLine->setEnabled(c); }
 	void slotP12Toggled(bool c) { publicPLine->setEnabled(c); }
+	void slotTransChanged(int);
 
 	void slotEncrypt();
 
@@ -66,11 +67,11 @@ private:
 	XSec::Core core;
 	QString _file;
 
-	QComboBox *typeBox, *formBox;
-	QLabel *typeLabel, *formLabel, *xpathLabel, *saveAsLabel;
-	FileSelect *publicKLine, *publicCLine, *publicPLine;
+	QComboBox *typeBox, *formBox, *transBox;
+	QLabel *typeLabel, *formLabel, *transLabel, *kekLabel, *xpathLabel, *recipientsLabel, *saveAsLabel;
+	FileSelect *publicKLine, *publicCLine, *publicPLine, *kekLine;
 	FileSaveSelect *saveAsLine;
-	QTextEdit *xpathList;
+	QTextEdit *xpathList, *recipientsList;
 	QDialogButtonBox *buttons;
 	QCheckBox *passwdBox;
 	QLineEdit *passwdLine;
@@ -51,7 +51,7 @@ void XSDSignDialog::setupUi() {
 	signLabel = new QLabel(QStringLiteral("Signiermethode"));
 	canonLabel = new QLabel(QStringLiteral("Kanonisierung"));
 	refsLabel = new QLabel(QStringLiteral("Referenzen"));
-	privateLabel = new QLabel(QStringLiteral("Privater Schlüssel"));
+	privateLabel = new QLabel(QStringLiteral("Privater / Geheimer Schlüssel"));
 	saveAsLabel = new QLabel(QStringLiteral("Speichern als:"));
 	passwdBox = new QCheckBox(QStringLiteral("Kennwort"));
 	certRadio = new QRadioButton(QStringLiteral("Zertifikat"));
@@ -87,6 +87,9 @@ void XSDSignDialog::setupUi() {
 	signBox->addItem(QStringLiteral("ECDSA-SHA256"), XSec::SA_ECDSA_SHA256 );
 	signBox->addItem(QStringLiteral("ECDSA-SHA384"), XSec::SA_ECDSA_SHA384 );
 	signBox->addItem(QStringLiteral("ECDSA-SHA512"), XSec::SA_ECDSA_SHA512 );
+	signBox->addItem(QStringLiteral("HMAC-SHA256"), XSec::SA_HMAC_SHA256 );
+	signBox->addItem(QStringLiteral("HMAC-SHA384"), XSec::SA_HMAC_SHA384 );
+	signBox->addItem(QStringLiteral("HMAC-SHA512"), XSec::SA_HMAC_SHA512 );
 
 	canonBox->addItem(QStringLiteral("Kanonisierung inklusiv 1.1"), XSec::C14N_11_INCLUSIVE);
 	canonBox->addItem(QStringLiteral("Kanonisierung inklusiv"), XSec::C14N_INCLUSIVE);
@@ -204,10 +207,16 @@ void XSDSignDialog::slotSign() {
 
 	so.sign_algorithm = signBox->currentData().toInt();
 	so.c14n_algorithm = canonBox->currentData().toInt();
-	so.private_key = privateLine->text().toStdString();
 
-	if( QFileInfo(privateLine->text()).suffix() == QStringLiteral("p12")){
-		so.keys_in_p12 = true;
+	if( XSec::is_hmac( so.sign_algorithm )) {
+		// HMAC takes the raw shared secret instead of a key pair
+		so.secret_key = privateLine->text().toStdString();
+	} else {
+		so.private_key = privateLine->text().toStdString();
+
+		if( QFileInfo(privateLine->text()).suffix() == QStringLiteral("p12")){
+			so.keys_in_p12 = true;
+		}
 	}
 
 	if( passwdBox->isChecked() )
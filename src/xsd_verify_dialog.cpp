@@ -41,9 +41,11 @@ void XSDVerifyDialog::setupUi() {
 
 	certRadio = new QRadioButton(QStringLiteral("Zertifikat*"));
 	keyRadio = new QRadioButton(QStringLiteral("Öffentlicher Schlüssel"));
+	secretRadio = new QRadioButton(QStringLiteral("Geheimer Schlüssel (HMAC)"));
 	noneRadio = new QRadioButton(QStringLiteral("Eingebettet"));
 	publicCLine = new FileSelect();
 	publicKLine = new FileSelect();
+	secretLine = new FileSelect();
 	noteLabel = new QLabel(QStringLiteral("* Achtung: Zertifikatskette wird in diesem Modus nicht geprüft!"));
 	trustCert = new QCheckBox(QStringLiteral("Vertraue eingebettetem Zertifikat (für Selbst-Signierte)"));
 	//publicNLine = new QLineEdit();
@@ -57,8 +59,10 @@ void XSDVerifyDialog::setupUi() {
 	publicLay->setWidget(0, QFormLayout::FieldRole, publicCLine);
 	publicLay->setWidget(1, QFormLayout::LabelRole, keyRadio);
 	publicLay->setWidget(1, QFormLayout::FieldRole, publicKLine);
-	publicLay->setWidget(2, QFormLayout::LabelRole, noneRadio);
-	//publicLay->setWidget(2, QFormLayout::FieldRole, publicNLine);
+	publicLay->setWidget(2, QFormLayout::LabelRole, secretRadio);
+	publicLay->setWidget(2, QFormLayout::FieldRole, secretLine);
+	publicLay->setWidget(3, QFormLayout::LabelRole, noneRadio);
+	//publicLay->setWidget(3, QFormLayout::FieldRole, publicNLine);
 
 	mainLay->addLayout(publicLay);
 	mainLay->addWidget(noteLabel);
@@ -68,12 +72,14 @@ void XSDVerifyDialog::setupUi() {
 	//connect(noneRadio, SIGNAL(toggled(bool)), this, SLOT(slotNoneToggled(bool)));
 	connect(certRadio, SIGNAL(toggled(bool)), this, SLOT(slotCertToggled(bool)));
 	connect(keyRadio,  SIGNAL(toggled(bool)), this, SLOT(slotKeyToggled(bool)));
+	connect(secretRadio, SIGNAL(toggled(bool)), this, SLOT(slotSecretToggled(bool)));
 	connect(buttons, SIGNAL(accepted()), this, SLOT(slotVerify()));
 	connect(buttons, SIGNAL(rejected()), this, SLOT(reject()));
 
 	noneRadio->setChecked(true);
 	publicKLine->setEnabled(false);
 	publicCLine->setEnabled(false);
+	secretLine->setEnabled(false);
 }
 
 void XSDVerifyDialog::slotVerify() {
@@ -88,6 +94,8 @@ void XSDVerifyDialog::slotVerify() {
 	} else if(keyRadio->isChecked()) {
 		so.public_key_is_cert = false;
 		so.public_key = publicKLine->text().toStdString();
+	} else if(secretRadio->isChecked()) {
+		so.secret_key = secretLine->text().toStdString();
 	} else {
 		so.trust_selfsigned_cert = trustCert->isChecked();
 	}
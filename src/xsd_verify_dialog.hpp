@@ -59,6 +59,7 @@ public slots:
 	QSize sizeHint() const;
 	void slotCertToggled(bool c) { publicCLine->setEnabled(c); trustCert->setEnabled(!c); }
 	void slotKeyToggled(bool c)  { publicKLine->setEnabled(c); trustCert->setEnabled(!c); }
+	void slotSecretToggled(bool c)  { secretLine->setEnabled(c); trustCert->setEnabled(!c); }
 
 	void slotVerify();
 
@@ -70,8 +71,8 @@ private:
 	QString _file;
 
 	QGroupBox *publicBox;
-	QRadioButton *certRadio, *keyRadio, *noneRadio;
-	FileSelect *publicKLine, *publicCLine;
+	QRadioButton *certRadio, *keyRadio, *secretRadio, *noneRadio;
+	FileSelect *publicKLine, *publicCLine, *secretLine;
 	QCheckBox *trustCert;
 	QDialogButtonBox *buttons;
 	QLabel *noteLabel;
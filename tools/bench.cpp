@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <chrono>
+
+#include "bench.hpp"
+
+namespace XSecTools {
+
+static double now_s() {
+	return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+double percentile(const std::vector<double> &sorted, double q) {
+	if( sorted.empty() )
+		return 0;
+	size_t i = (size_t) (q * sorted.size());
+	return sorted[std::min( i, sorted.size() - 1 )];
+}
+
+BenchResult run_bench(const std::string &name, uint64_t bytes, const BenchConfig &config, const BenchOp &op) {
+	BenchResult r;
+	r.name  = name;
+	r.bytes = bytes;
+
+	XSec::Metrics m;
+	r.error = op( &m ); // warm-up, fills caches and page cache
+	if( r.error != 0 )
+		return r;
+
+	std::vector<double> samples;
+	double allocs = 0, heap = 0;
+	double start = now_s();
+	while( samples.size() < config.max_iterations
+	       && ( samples.size() < config.min_iterations || now_s() - start < config.min_time )) {
+		r.error = op( &m );
+		if( r.error != 0 )
+			return r;
+		samples.push_back( (m.end_ns - m.start_ns) / 1e6 );
+		allocs += m.allocations;
+		heap   += m.heap_peak;
+	}
+
+	std::sort( samples.begin(), samples.end() );
+	r.iterations = samples.size();
+	r.min_ms  = samples.front();
+	r.p50_ms  = percentile( samples, 0.50 );
+	r.p90_ms  = percentile( samples, 0.90 );
+	r.p99_ms  = percentile( samples, 0.99 );
+	double sum = 0;
+	for( double s : samples )
+		sum += s;
+	r.mean_ms = sum / samples.size();
+	r.mb_per_s  = r.p50_ms > 0 ? bytes / (r.p50_ms / 1e3) / (1 << 20) : 0;
+	r.allocs    = allocs / samples.size();
+	r.heap_peak = heap / samples.size();
+	return r;
+}
+
+void print_header(FILE *fp) {
+	fprintf( fp, "%-44s %7s %10s %10s %10s %10s %10s %10s\n",
+	         "case", "iters", "p50 ms", "p90 ms", "p99 ms", "MB/s", "allocs/op", "heap KB" );
+}
+
+void print_result(FILE *fp, const BenchResult &r) {
+	if( r.error != 0 ) {
+		fprintf( fp, "%-44s FAILED (%d)\n", r.name.c_str(), r.error );
+		return;
+	}
+	fprintf( fp, "%-44s %7zu %10.3f %10.3f %10.3f %10.1f %10.0f %10.0f\n",
+	         r.name.c_str(), r.iterations, r.p50_ms, r.p90_ms, r.p99_ms, r.mb_per_s, r.allocs, r.heap_peak / 1024 );
+	fflush( fp );
+}
+
+int write_json(const std::string &path, const std::vector<BenchResult> &results) {
+	FILE *fp = fopen( path.c_str(), "w" );
+	if( fp == nullptr )
+		return -1;
+
+	fprintf( fp, "[\n" );
+	for( size_t i = 0; i < results.size(); i++ ) {
+		auto &r = results[i];
+		// case names are built from fixed words, nothing to escape
+		fprintf( fp, "  {\"name\": \"%s\", \"error\": %d, \"iterations\": %zu, \"bytes\": %llu, "
+		             "\"min_ms\": %.6f, \"p50_ms\": %.6f, \"p90_ms\": %.6f, \"p99_ms\": %.6f, \"mean_ms\": %.6f, "
+		             "\"mb_per_s\": %.3f, \"allocs\": %.1f, \"heap_peak\": %.0f}%s\n",
+		         r.name.c_str(), r.error, r.iterations, (unsigned long long) r.bytes,
+		         r.min_ms, r.p50_ms, r.p90_ms, r.p99_ms, r.mean_ms, r.mb_per_s, r.allocs, r.heap_peak,
+		         i + 1 < results.size() ? "," : "" );
+	}
+	fprintf( fp, "]\n" );
+	return fclose( fp ) == 0 ? 0 : -1;
+}
+
+} // namespace XSecTools
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#ifndef XSEC_TOOLS_BENCH_H
+#define XSEC_TOOLS_BENCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "xseccore.hpp"
+
+
+namespace XSecTools {
+
+struct BenchConfig {
+	double min_time       = 0.5;    // seconds per case, after one warm-up run
+	size_t min_iterations = 5;
+	size_t max_iterations = 100000;
+};
+
+struct BenchResult {
+	std::string name;
+	size_t   iterations = 0;
+	uint64_t bytes      = 0;   // processed by one operation
+	double   min_ms  = 0, p50_ms = 0, p90_ms = 0, p99_ms = 0, mean_ms = 0;
+	double   mb_per_s  = 0;    // bytes / p50
+	double   allocs    = 0;    // libxml2 allocations per operation
+	double   heap_peak = 0;    // mean libxml2 heap high-water mark, bytes
+	int      error = 0;        // result of the first failed operation
+};
+
+/* an operation returns the result of the Core call it measures */
+typedef std::function<int(XSec::Metrics *)> BenchOp;
+
+/* runs op repeatedly, needs metrics_track_heap() to have been called for allocs and heap_peak */
+BenchResult run_bench(const std::string &name, uint64_t bytes, const BenchConfig &config, const BenchOp &op);
+
+/* q in [0,1] of sorted samples */
+double percentile(const std::vector<double> &sorted, double q);
+
+void print_header(FILE *fp);
+void print_result(FILE *fp, const BenchResult &r);
+int  write_json(const std::string &path, const std::vector<BenchResult> &results);
+
+} // namespace XSecTools
+#endif
@@ -0,0 +1,383 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "commands.hpp"
+#include "names.hpp"
+
+using namespace XSec;
+
+namespace XSecTools {
+
+static const struct { const char *name; int op; } command_names[] = {
+	{ "sign",    MO_SIGN },
+	{ "verify",  MO_VERIFY },
+	{ "encrypt", MO_ENCRYPT },
+	{ "decrypt", MO_DECRYPT },
+};
+
+static const char *path_options[] = {
+	"--key", "--public-key", "--secret", "--kek", "--recipient", "--ref"
+};
+
+
+/* walks the arguments of one command */
+class ArgReader {
+public:
+	ArgReader(const Args &args, std::string &error) : args(args), error(error) {}
+
+	bool next() {
+		if( ++pos >= args.size() )
+			return false;
+		cur = args[pos];
+		return true;
+	}
+
+	const std::string &arg() const { return cur; }
+	bool is(const char *name) const { return cur == name; }
+
+	/* the value of the current option, sets error if there is none */
+	std::string value() {
+		if( pos + 1 >= args.size() ) {
+			fail( "missing value" );
+			return std::string();
+		}
+		return args[++pos];
+	}
+
+	/* the value of the current option looked up in table */
+	int value(const Name *table) {
+		std::string v = value();
+		int n = value_of( table, v );
+		if( !failed && n < 0 )
+			fail( "unknown value \"" + v + "\", one of " + names_of( table ));
+		return n;
+	}
+
+	void fail(const std::string &msg) {
+		if( !failed )
+			error = cur + ": " + msg;
+		failed = true;
+	}
+
+	/* like fail(), for errors that aren't about a single argument */
+	void fail_command(const std::string &msg) {
+		if( !failed )
+			error = msg;
+		failed = true;
+	}
+
+	/* takes arguments that are no options as the input file, only one */
+	void input(std::string &file) {
+		if( cur.size() > 1 && cur[0] == '-' )
+			fail( "unknown option" );
+		else if( have_input )
+			fail( "only one input file" );
+		file = cur;
+		have_input = true;
+	}
+
+	bool failed = false;
+
+private:
+	const Args &args;
+	std::string &error;
+	size_t pos = 0;
+	std::string cur;
+	bool have_input = false;
+};
+
+/* FILE;key;key=value, the part before the first ';' goes to head */
+static std::vector<std::pair<std::string, std::string>> split_spec(const std::string &spec, std::string &head) {
+	std::vector<std::pair<std::string, std::string>> out;
+	size_t pos = spec.find( ';' );
+	head = spec.substr( 0, pos );
+	while( pos != std::string::npos ) {
+		size_t end = spec.find( ';', pos + 1 );
+		std::string item = spec.substr( pos + 1, end == std::string::npos ? std::string::npos : end - pos - 1 );
+		size_t eq = item.find( '=' );
+		if( eq == std::string::npos )
+			out.emplace_back( item, std::string() );
+		else
+			out.emplace_back( item.substr( 0, eq ), item.substr( eq + 1 ));
+		pos = end;
+	}
+	return out;
+}
+
+/* the options of all commands that tell how the document is parsed, false if the current one isn't */
+static bool parse_profile_option(ArgReader &r, ParseProfile &profile) {
+	if( r.is( "--huge" ))                   profile.huge = true;
+	else if( r.is( "--compact" ))           profile.compact = true;
+	else if( r.is( "--no-blanks" ))         profile.no_blanks = true;
+	else if( r.is( "--dtd" ))               profile.dtd = r.value( dtd_names );
+	else                                    return false;
+	return true;
+}
+
+
+static void parse_sign(ArgReader &r, Command &cmd) {
+	sign_options_t &opt = cmd.sign;
+	opt.format = SF_ENVELOPED;
+	opt.c14n_algorithm = C14N_11_INCLUSIVE;
+	opt.sign_algorithm = SA_RSA_SHA256;
+	opt.hash_algorithm = HA_SHA256;
+
+	std::vector<std::string> ref_specs;
+	while( !r.failed && r.next() ) {
+		if( r.is( "-o" ))                       cmd.output = r.value();
+		else if( r.is( "--format" ))            opt.format = r.value( sign_format_names );
+		else if( r.is( "--c14n" ))              opt.c14n_algorithm = r.value( c14n_names );
+		else if( r.is( "--algorithm" ))         opt.sign_algorithm = r.value( sign_algo_names );
+		else if( r.is( "--hash" ))              opt.hash_algorithm = r.value( hash_names );
+		else if( r.is( "--key" ))               opt.private_key = r.value();
+		else if( r.is( "--public-key" ))        opt.public_key = r.value();
+		else if( r.is( "--cert" ))              opt.public_key_is_cert = true;
+		else if( r.is( "--p12" ))               opt.keys_in_p12 = true;
+		else if( r.is( "--password" ))          opt.key_password = r.value();
+		else if( r.is( "--secret" ))            opt.secret_key = r.value();
+		else if( r.is( "--base-url" ))          opt.base_url = r.value();
+		else if( r.is( "--store-references" ))  opt.store_references = true;
+		else if( r.is( "--ref" ))               ref_specs.push_back( r.value() );
+		else if( r.is( "--metrics" ))           cmd.metrics = true;
+		else if( !parse_profile_option( r, opt.parse ))  r.input( cmd.input );
+	}
+
+	if( ref_specs.empty() && opt.format == SF_ENVELOPED )
+		ref_specs.push_back( "" );
+	if( ref_specs.empty() && !r.failed )
+		r.fail_command( "enveloping and detached signatures need at least one --ref" );
+
+	cmd.refs.resize( ref_specs.size() );
+	for( size_t i = 0; i < ref_specs.size() && !r.failed; i++ ) {
+		Reference &ref = cmd.refs[i];
+		ref.hash = opt.hash_algorithm;
+		ref.transform = opt.c14n_algorithm;
+		for( auto &kv : split_spec( ref_specs[i], ref.uri )) {
+			if( kv.first == "hash" && value_of( hash_names, kv.second ) >= 0 )
+				ref.hash = value_of( hash_names, kv.second );
+			else if( kv.first == "transform" && value_of( c14n_names, kv.second ) >= 0 )
+				ref.transform = value_of( c14n_names, kv.second );
+			else if( kv.first == "transform" && kv.second == "none" )
+				ref.transform = C14N_UNSET;
+			else if( kv.first == "intersect" )
+				ref.xpath_intersect = kv.second;
+			else if( kv.first == "subtract" )
+				ref.xpath_subtract = kv.second;
+			else if( kv.first == "union" )
+				ref.xpath_union = kv.second;
+			else
+				r.fail( "bad reference attribute \"" + kv.first + "\"" );
+		}
+		opt.references.push_back( &ref );
+	}
+}
+
+static void parse_verify(ArgReader &r, Command &cmd) {
+	verify_options_t &opt = cmd.verify;
+	while( !r.failed && r.next() ) {
+		if( r.is( "--public-key" ))             opt.public_key = r.value();
+		else if( r.is( "--cert" ))              opt.public_key_is_cert = true;
+		else if( r.is( "--p12" ))               opt.public_key_is_p12 = opt.public_key_is_cert = true;
+		else if( r.is( "--trust-selfsigned" ))  opt.trust_selfsigned_cert = true;
+		else if( r.is( "--secret" ))            opt.secret_key = r.value();
+		else if( r.is( "--base-url" ))          opt.base_url = r.value();
+		else if( r.is( "-q" ))                  cmd.quiet = true;
+		else if( r.is( "--metrics" ))           cmd.metrics = true;
+		else if( !parse_profile_option( r, opt.parse ))  r.input( cmd.input );
+	}
+}
+
+static void parse_encrypt(ArgReader &r, Command &cmd) {
+	encrypt_options_t &opt = cmd.encrypt;
+	opt.encryption_algorithm = EA_AES256_CBC;
+	opt.encryption_form = EF_ROOT;
+	opt.key_transport_algorithm = KT_RSA_PKCS1;
+
+	while( !r.failed && r.next() ) {
+		if( r.is( "-o" ))                       cmd.output = r.value();
+		else if( r.is( "--algorithm" ))         opt.encryption_algorithm = r.value( enc_algo_names );
+		else if( r.is( "--form" ))              opt.encryption_form = r.value( enc_form_names );
+		else if( r.is( "--transport" ))         opt.key_transport_algorithm = r.value( key_trans_names );
+		else if( r.is( "--public-key" ))        opt.public_key = r.value();
+		else if( r.is( "--cert" ))              opt.public_key_is_cert = true;
+		else if( r.is( "--p12" ))               opt.keys_in_p12 = true;
+		else if( r.is( "--password" ))          opt.key_password = r.value();
+		else if( r.is( "--kek" ))               opt.key_encryption_key = r.value();
+		else if( r.is( "--trust-selfsigned" ))  opt.trust_selfsigned_cert = true;
+		else if( r.is( "--xpath" ))             opt.xpaths.push_back( r.value() );
+		else if( r.is( "--metrics" ))           cmd.metrics = true;
+		else if( r.is( "--recipient" )) {
+			Recipient rcpt;
+			for( auto &kv : split_spec( r.value(), rcpt.public_key )) {
+				if( kv.first == "cert" )
+					rcpt.public_key_is_cert = true;
+				else if( kv.first == "p12" )
+					rcpt.keys_in_p12 = true;
+				else if( kv.first == "password" )
+					rcpt.key_password = kv.second;
+				else
+					r.fail( "bad recipient attribute \"" + kv.first + "\"" );
+			}
+			opt.recipients.push_back( rcpt );
+		}
+		else if( !parse_profile_option( r, opt.parse ))  r.input( cmd.input );
+	}
+}
+
+static void parse_decrypt(ArgReader &r, Command &cmd) {
+	decrypt_options_t &opt = cmd.decrypt;
+	while( !r.failed && r.next() ) {
+		if( r.is( "-o" ))                       cmd.output = r.value();
+		else if( r.is( "--key" ))               opt.private_key = r.value();
+		else if( r.is( "--p12" ))               opt.private_key_is_p12 = true;
+		else if( r.is( "--password" ))          opt.key_password = r.value();
+		else if( r.is( "--kek" ))               opt.key_encryption_key = r.value();
+		else if( r.is( "--trust-selfsigned" ))  opt.trust_selfsigned_cert = true;
+		else if( r.is( "--indent" ))            opt.output_format = OF_INDENTED;
+		else if( r.is( "--metrics" ))           cmd.metrics = true;
+		else if( !parse_profile_option( r, opt.parse ))  r.input( cmd.input );
+	}
+}
+
+
+int command_op(const std::string &name) {
+	for( auto &c : command_names ) {
+		if( name == c.name )
+			return c.op;
+	}
+	return -1;
+}
+
+bool parse_command(const Args &args, Command &cmd, std::string &error) {
+	cmd.op = args.empty() ? -1 : command_op( args[0] );
+	if( cmd.op < 0 ) {
+		error = "unknown command \"" + (args.empty() ? std::string() : args[0]) + "\"";
+		return false;
+	}
+
+	// batch and xsecd run many commands on one Core, which keeps the names of their documents
+	cmd.sign.parse.shared_dict = cmd.verify.parse.shared_dict = true;
+	cmd.encrypt.parse.shared_dict = cmd.decrypt.parse.shared_dict = true;
+
+	ArgReader r( args, error );
+	switch( cmd.op ) {
+	case MO_SIGN:    parse_sign( r, cmd ); break;
+	case MO_VERIFY:  parse_verify( r, cmd ); break;
+	case MO_ENCRYPT: parse_encrypt( r, cmd ); break;
+	case MO_DECRYPT: parse_decrypt( r, cmd ); break;
+	}
+	return !r.failed;
+}
+
+int run_command(Core &core, Command &cmd) {
+	Metrics *m = cmd.metrics ? &cmd.measured : nullptr;
+	bool valid = false;
+	int ret = -1;
+
+	switch( cmd.op ) {
+	case MO_SIGN:
+		cmd.sign.metrics = m;
+		ret = core.sign( cmd.input, cmd.output, cmd.sign );
+		break;
+	case MO_VERIFY:
+		cmd.verify.metrics = m;
+		ret = core.verify( cmd.input, valid, cmd.verify );
+		if( ret == 0 && !valid )
+			return EXIT_INVALID;
+		break;
+	case MO_ENCRYPT:
+		cmd.encrypt.metrics = m;
+		ret = core.encrypt( cmd.input, cmd.output, cmd.encrypt );
+		break;
+	case MO_DECRYPT:
+		cmd.decrypt.metrics = m;
+		ret = core.decrypt( cmd.input, cmd.output, cmd.decrypt );
+		break;
+	}
+	return ret == 0 ? EXIT_OK : EXIT_ERROR;
+}
+
+static const char *limit_fields[] = {
+	"document-bytes", "depth", "nodes", "entity-bytes", "references", "transforms", "xpath-ops", nullptr
+};
+
+bool parse_limit(const std::string &spec, Limits &limits) {
+	size_t eq = spec.find( '=' );
+	if( eq == std::string::npos || eq + 1 >= spec.size() || spec[eq + 1] == '-' )
+		return false;
+	std::string name = spec.substr( 0, eq );
+	const char *value = spec.c_str() + eq + 1;
+	char *end;
+	errno = 0;
+	unsigned long long n = strtoull( value, &end, 10 );
+	if( errno != 0 || *end != '\0' )
+		return false;
+
+	bool small = n <= UINT_MAX; // for the unsigned ones
+	if( name == "document-bytes" )               limits.document_bytes = n;
+	else if( name == "depth" && small )          limits.depth = n;
+	else if( name == "nodes" )                   limits.nodes = n;
+	else if( name == "entity-bytes" )            limits.entity_bytes = n;
+	else if( name == "references" && small )     limits.references = n;
+	else if( name == "transforms" && small )     limits.transforms = n;
+	else if( name == "xpath-ops" )               limits.xpath_ops = n;
+	else                                         return false;
+	return true;
+}
+
+std::string limit_names() {
+	std::string out;
+	for( auto name = limit_fields; *name != nullptr; name++ )
+		out += (out.empty() ? "" : ", ") + std::string( *name );
+	return out;
+}
+
+bool is_path_option(const std::string &option) {
+	for( auto name : path_options ) {
+		if( option == name )
+			return true;
+	}
+	return false;
+}
+
+std::string metrics_json(const char *command, const Metrics &m) {
+	char buf[128];
+	snprintf( buf, sizeof(buf), "{\"command\": \"%s\", \"result\": %d, \"total_ms\": %.3f", command, m.result,
+	          (m.end_ns - m.start_ns) / 1e6 );
+	std::string out = buf;
+	for( int p = 0; p < MP_COUNT; p++ ) {
+		if( m.phase_ns[p] > 0 ) {
+			snprintf( buf, sizeof(buf), ", \"%s_ms\": %.3f", metrics_phase_name( p ), m.phase_ns[p] / 1e6 );
+			out += buf;
+		}
+	}
+	snprintf( buf, sizeof(buf), ", \"bytes_in\": %llu, \"bytes_out\": %llu, \"nodes\": %llu}",
+	          (unsigned long long) m.bytes_in, (unsigned long long) m.bytes_out, (unsigned long long) m.nodes );
+	return out + buf;
+}
+
+} // namespace XSecTools
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#ifndef XSEC_TOOLS_COMMANDS_H
+#define XSEC_TOOLS_COMMANDS_H
+
+#include <string>
+#include <vector>
+
+#include "xseccore.hpp"
+
+
+namespace XSecTools {
+
+enum ExitStatus {
+	EXIT_OK = 0,
+	EXIT_INVALID = 1,   // verify: the signature is invalid, batch: a line failed
+	EXIT_ERROR = 2
+};
+
+typedef std::vector<std::string> Args;
+
+/* one sign, verify, encrypt or decrypt command of xsec with its arguments parsed,
+ * xsec and xsecd share it so both understand the same options */
+struct Command {
+	int op = -1;   // MO_SIGN, MO_VERIFY, MO_ENCRYPT or MO_DECRYPT
+	/* paths, or the documents themselves for sign and verify with doc_in_memory */
+	std::string input = "-", output = "-";
+	bool quiet = false;
+	bool metrics = false;
+
+	XSec::sign_options_t    sign;
+	XSec::verify_options_t  verify;
+	XSec::encrypt_options_t encrypt;
+	XSec::decrypt_options_t decrypt;
+	std::vector<XSec::Reference> refs;  // sign.references point in here
+	XSec::Metrics measured;             // filled by run_command() if metrics is set
+
+	Command() = default;
+	Command(const Command &) = delete;
+	Command &operator=(const Command &) = delete;
+};
+
+/* MO_* of a command name, -1 if it's none of the four */
+int command_op(const std::string &name);
+
+/* parses args, args[0] being the command name, into cmd. Returns false if they're wrong,
+ * error then says why, prefixed by the offending argument if there is one */
+bool parse_command(const Args &args, Command &cmd, std::string &error);
+
+/* runs cmd on core, returns EXIT_OK, EXIT_INVALID for a bad signature or EXIT_ERROR,
+ * core.error_message() tells about the latter */
+int run_command(XSec::Core &core, Command &cmd);
+
+/* takes NAME=N into limits, NAME being a field of XSec::Limits with '-' for '_', false if spec is none */
+bool parse_limit(const std::string &spec, XSec::Limits &limits);
+
+/* "a, b, c", the names parse_limit() takes */
+std::string limit_names();
+
+/* true for the options taking a file, the one before the first ';' for --recipient and --ref */
+bool is_path_option(const std::string &option);
+
+/* the timing of a call as one line of json, without the line break */
+std::string metrics_json(const char *command, const XSec::Metrics &m);
+
+} // namespace XSecTools
+#endif
@@ -0,0 +1,435 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+// RAND_METHOD is deprecated but still consulted by RAND_bytes, it is the only way to seed keygen
+#define OPENSSL_SUPPRESS_DEPRECATED
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rand.h>
+#include <openssl/x509.h>
+#include <openssl/pkcs12.h>
+
+#include "corpus.hpp"
+
+namespace XSecTools {
+
+const char *p12_password = "secret";
+
+int write_file(const std::string &path, const std::string &data) {
+	FILE *fp = fopen( path.c_str(), "wb" );
+	if( fp == nullptr )
+		return -1;
+	bool ok = fwrite( data.data(), 1, data.size(), fp ) == data.size();
+	ok = fclose( fp ) == 0 && ok;
+	return ok ? 0 : -1;
+}
+
+static int write_pem(const std::string &path, EVP_PKEY *key, bool priv) {
+	FILE *fp = fopen( path.c_str(), "wb" );
+	if( fp == nullptr )
+		return -1;
+	int ok = priv ? PEM_write_PrivateKey( fp, key, nullptr, nullptr, 0, nullptr, nullptr )
+	              : PEM_write_PUBKEY( fp, key );
+	fclose( fp );
+	return ok ? 0 : -1;
+}
+
+/* counter mode sha256 over the seed, replaces openssl's random source in make_keys() */
+static struct {
+	uint64_t seed;
+	uint64_t counter;
+	unsigned char block[32];
+	unsigned used;
+} seeded;
+
+static int seeded_bytes(unsigned char *buf, int num) {
+	while( num > 0 ) {
+		if( seeded.used == sizeof(seeded.block) ) {
+			unsigned char in[16];
+			memcpy( in, &seeded.seed, 8 );
+			memcpy( in + 8, &seeded.counter, 8 );
+			seeded.counter++;
+			if( EVP_Digest( in, sizeof(in), seeded.block, nullptr, EVP_sha256(), nullptr ) != 1 )
+				return 0;
+			seeded.used = 0;
+		}
+		int n = std::min( num, (int) (sizeof(seeded.block) - seeded.used) );
+		memcpy( buf, seeded.block + seeded.used, n );
+		seeded.used += n;
+		buf += n;
+		num -= n;
+	}
+	return 1;
+}
+
+static int seeded_status() {
+	return 1;
+}
+
+static RAND_METHOD seeded_method = {
+	nullptr, seeded_bytes, nullptr, nullptr, seeded_bytes, seeded_status
+};
+
+static X509 *self_signed(EVP_PKEY *key, const char *cn) {
+	X509 *cert = X509_new();
+	if( cert == nullptr )
+		return nullptr;
+
+	X509_set_version( cert, 2 );
+	ASN1_INTEGER_set( X509_get_serialNumber( cert ), 1 );
+	// fixed validity, the certificate must not depend on the day it was made
+	ASN1_TIME_set_string( X509_getm_notBefore( cert ), "20200101000000Z" );
+	ASN1_TIME_set_string( X509_getm_notAfter( cert ), "20500101000000Z" );
+	X509_set_pubkey( cert, key );
+
+	X509_NAME *name = X509_get_subject_name( cert );
+	X509_NAME_add_entry_by_txt( name, "CN", MBSTRING_ASC, (const unsigned char *) cn, -1, -1, 0 );
+	X509_set_issuer_name( cert, name );
+
+	if( X509_sign( cert, key, EVP_sha256() ) == 0 ) {
+		X509_free( cert );
+		return nullptr;
+	}
+	return cert;
+}
+
+static int write_random(const std::string &path, int len) {
+	unsigned char buf[64];
+	if( len > (int) sizeof(buf) || RAND_bytes( buf, len ) != 1 )
+		return -1;
+	return write_file( path, std::string( (char *) buf, len ));
+}
+
+int make_keys(const std::string &dir, KeySet &keys, uint64_t seed) {
+	keys.rsa_key  = dir + "/rsa.pem";
+	keys.rsa_pub  = dir + "/rsapub.pem";
+	keys.rsa_cert = dir + "/cert.pem";
+	keys.rsa_p12  = dir + "/key.p12";
+	keys.ec_key   = dir + "/ec.pem";
+	keys.ec_pub   = dir + "/ecpub.pem";
+	keys.ec_cert  = dir + "/eccert.pem";
+	keys.hmac     = dir + "/hmac.key";
+	keys.kek128   = dir + "/kek128.bin";
+	keys.kek192   = dir + "/kek192.bin";
+	keys.kek256   = dir + "/kek256.bin";
+
+	int ret = -1;
+	X509 *cert = nullptr, *eccert = nullptr;
+	PKCS12 *p12 = nullptr;
+	FILE *fp = nullptr;
+	EVP_PKEY *ec = nullptr, *rsa = nullptr;
+
+	const RAND_METHOD *previous = RAND_get_rand_method();
+	seeded.seed = seed;
+	seeded.counter = 0;
+	seeded.used = sizeof(seeded.block);
+	RAND_set_rand_method( &seeded_method );
+
+	rsa = EVP_RSA_gen( 2048 );
+	if( rsa == nullptr )
+		goto done;
+	ec = EVP_EC_gen( "P-256" );
+	if( ec == nullptr )
+		goto done;
+
+	if( write_pem( keys.rsa_key, rsa, true ) || write_pem( keys.rsa_pub, rsa, false )
+	    || write_pem( keys.ec_key, ec, true ) || write_pem( keys.ec_pub, ec, false ))
+		goto done;
+
+	cert = self_signed( rsa, "xsec test" );
+	if( cert == nullptr )
+		goto done;
+	fp = fopen( keys.rsa_cert.c_str(), "wb" );
+	if( fp == nullptr || !PEM_write_X509( fp, cert ))
+		goto done;
+	fclose( fp );
+	fp = nullptr;
+
+	eccert = self_signed( ec, "xsec test ec" );
+	if( eccert == nullptr )
+		goto done;
+	fp = fopen( keys.ec_cert.c_str(), "wb" );
+	if( fp == nullptr || !PEM_write_X509( fp, eccert ))
+		goto done;
+	fclose( fp );
+
+	p12 = PKCS12_create( p12_password, "xsec test", rsa, cert, nullptr, 0, 0, 0, 0, 0 );
+	if( p12 == nullptr )
+		goto done;
+	fp = fopen( keys.rsa_p12.c_str(), "wb" );
+	if( fp == nullptr || !i2d_PKCS12_fp( fp, p12 ))
+		goto done;
+	fclose( fp );
+	fp = nullptr;
+
+	if( write_random( keys.hmac, 32 ) || write_random( keys.kek128, 16 )
+	    || write_random( keys.kek192, 24 ) || write_random( keys.kek256, 32 ))
+		goto done;
+
+	ret = 0;
+
+done:
+	RAND_set_rand_method( previous );
+	if( fp )
+		fclose( fp );
+	PKCS12_free( p12 );
+	X509_free( eccert );
+	X509_free( cert );
+	EVP_PKEY_free( ec );
+	EVP_PKEY_free( rsa );
+	return ret;
+}
+
+static uint64_t next(uint64_t &state) {
+	// xorshift64*, plenty for filler text
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+	return state * 0x2545F4914F6CDD1DULL;
+}
+
+static double unit(uint64_t &state) {
+	return (next(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+const char *match_xpath = "//*[local-name()='target']";
+
+static const char *words[] = { "lorem", "ipsum", "dolor", "sit", "amet", "consectetur",
+                               "adipiscing", "elit", "sed", "do", "eiusmod", "tempor" };
+static const char *containers[] = { "section", "group", "record", "entry", "block", "part" };
+
+static void append_base64(std::string &out, uint64_t &state, size_t len) {
+	std::vector<unsigned char> raw( len );
+	for( auto &c : raw )
+		c = next(state) >> 56;
+	std::vector<unsigned char> b64( 4 * ((len + 2) / 3) + 1 );
+	int n = EVP_EncodeBlock( b64.data(), raw.data(), len );
+	out.append( (const char *) b64.data(), n );
+}
+
+/* builds the document, place[i] is the number of match, signature and encrypted elements
+ * put before the i-th payload element */
+class DocBuilder {
+public:
+	DocBuilder(const DocShape &shape) : shape(shape), state( shape.seed * 2 + 1 ) {}
+
+	std::string build(const std::vector<unsigned> *place, DocStats &stats) {
+		static const char end[] = "</doc>\n";
+		const unsigned depth = std::max( shape.depth, 1u );
+		const unsigned fanout = std::max( shape.fanout, 1u );
+
+		doc.clear();
+		doc.reserve( shape.size + 256 );
+		doc += "<?xml version=\"1.0\"?>\n<doc xmlns=\"urn:xsec:bench\"";
+		for( unsigned i = 0; i < shape.namespaces; i++ )
+			doc += " xmlns:n" + std::to_string(i) + "=\"urn:xsec:bench:n" + std::to_string(i) + "\"";
+		doc += ">";
+		stats = DocStats();
+		stats.elements = 1;
+
+		// open containers, with the number of children each has got so far
+		std::vector<std::pair<std::string, unsigned>> open;
+		size_t leaf = 0;
+		do {
+			while( open.size() + 1 < depth ) {
+				std::string name = element_name( containers[next(state) % 6] );
+				doc += "<" + name + ">";
+				open.emplace_back( name, 0 );
+				stats.elements++;
+			}
+			stats.max_depth = std::max( stats.max_depth, (unsigned) open.size() + 1 );
+
+			if( place != nullptr && leaf < place->size() ) {
+				for( unsigned k = 0; k < (*place)[leaf]; k++ )
+					special( stats );
+			}
+			payload( leaf++ );
+			stats.elements++;
+			stats.payload++;
+
+			if( !open.empty() )
+				open.back().second++;
+			while( !open.empty() && open.back().second == fanout ) {
+				doc += "</" + open.back().first + ">";
+				open.pop_back();
+				if( !open.empty() )
+					open.back().second++;
+			}
+		} while( doc.size() + sizeof(end) < shape.size );
+
+		// the ones meant for payload elements that did not fit anymore
+		if( place != nullptr ) {
+			for( size_t i = leaf; i < place->size(); i++ ) {
+				for( unsigned k = 0; k < (*place)[i]; k++ )
+					special( stats );
+			}
+		}
+		while( !open.empty() ) {
+			doc += "</" + open.back().first + ">";
+			open.pop_back();
+		}
+		doc += end;
+		stats.bytes = doc.size();
+		return std::move( doc );
+	}
+
+	size_t specials_total() const {
+		return shape.matches + shape.signatures + shape.encrypted;
+	}
+
+private:
+	std::string element_name(const char *local) {
+		if( shape.namespaces > 0 && shape.ns_density > 0 && unit(state) < shape.ns_density )
+			return "n" + std::to_string( next(state) % shape.namespaces ) + ":" + local;
+		return local;
+	}
+
+	void payload(size_t n) {
+		std::string name = element_name( "item" );
+		std::string text;
+		doc += "<" + name + " id=\"i" + std::to_string(n) + "\"";
+		for( int w = 0, a = 0; w < 8; w++ ) {
+			const char *word = words[next(state) % 12];
+			if( unit(state) < shape.attr_ratio ) {
+				doc += " a" + std::to_string(a++) + "=\"" + word + "\"";
+			}
+			else {
+				if( !text.empty() )
+					text += ' ';
+				text += word;
+			}
+		}
+		doc += ">" + text + "</" + name + ">";
+	}
+
+	/* the next special element, matches first, then signatures, then encrypted data */
+	void special(DocStats &stats) {
+		if( emitted_matches < shape.matches ) {
+			doc += "<target id=\"t" + std::to_string( emitted_matches++ ) + "\">";
+			doc += words[next(state) % 12];
+			doc += "</target>";
+			stats.elements++;
+		}
+		else if( emitted_signatures < shape.signatures ) {
+			emitted_signatures++;
+			doc += "<ds:Signature xmlns:ds=\"http://www.w3.org/2000/09/xmldsig#\"><ds:SignedInfo>"
+			       "<ds:CanonicalizationMethod Algorithm=\"http://www.w3.org/2001/10/xml-exc-c14n#\"/>"
+			       "<ds:SignatureMethod Algorithm=\"http://www.w3.org/2001/04/xmldsig-more#rsa-sha256\"/>"
+			       "<ds:Reference URI=\"\"><ds:Transforms>"
+			       "<ds:Transform Algorithm=\"http://www.w3.org/2000/09/xmldsig#enveloped-signature\"/></ds:Transforms>"
+			       "<ds:DigestMethod Algorithm=\"http://www.w3.org/2001/04/xmlenc#sha256\"/><ds:DigestValue>";
+			append_base64( doc, state, 32 );
+			doc += "</ds:DigestValue></ds:Reference></ds:SignedInfo><ds:SignatureValue>";
+			append_base64( doc, state, 256 );
+			doc += "</ds:SignatureValue></ds:Signature>";
+			stats.elements += 10;
+		}
+		else if( emitted_encrypted < shape.encrypted ) {
+			emitted_encrypted++;
+			doc += "<xenc:EncryptedData xmlns:xenc=\"http://www.w3.org/2001/04/xmlenc#\""
+			       " Type=\"http://www.w3.org/2001/04/xmlenc#Element\">"
+			       "<xenc:EncryptionMethod Algorithm=\"http://www.w3.org/2001/04/xmlenc#aes256-cbc\"/>"
+			       "<ds:KeyInfo xmlns:ds=\"http://www.w3.org/2000/09/xmldsig#\"><ds:KeyName>kek256</ds:KeyName></ds:KeyInfo>"
+			       "<xenc:CipherData><xenc:CipherValue>";
+			append_base64( doc, state, 16 * (2 + next(state) % 16) );
+			doc += "</xenc:CipherValue></xenc:CipherData></xenc:EncryptedData>";
+			stats.elements += 6;
+		}
+	}
+
+	const DocShape &shape;
+	uint64_t state;
+	std::string doc;
+	size_t emitted_matches = 0, emitted_signatures = 0, emitted_encrypted = 0;
+};
+
+std::string make_document(const DocShape &shape, DocStats *stats) {
+	DocStats local;
+	DocStats &st = stats ? *stats : local;
+
+	DocBuilder plain( shape );
+	std::string doc = plain.build( nullptr, st );
+	size_t total = plain.specials_total();
+	if( total == 0 )
+		return doc;
+
+	// spread the special elements evenly over the payload of the plain document
+	std::vector<unsigned> place( std::max( st.payload, (size_t) 1 ), 0 );
+	for( size_t k = 0; k < total; k++ )
+		place[(k * 2 + 1) * place.size() / (total * 2)]++;
+
+	DocBuilder builder( shape );
+	return builder.build( &place, st );
+}
+
+std::string make_document(size_t size, uint64_t seed) {
+	DocShape shape;
+	shape.size = size;
+	shape.seed = seed;
+	return make_document( shape );
+}
+
+size_t parse_size(const std::string &s) {
+	char *end = nullptr;
+	unsigned long long n = strtoull( s.c_str(), &end, 10 );
+	if( end == s.c_str() )
+		return 0;
+	switch( *end ) {
+		case 'k': case 'K': n <<= 10; end++; break;
+		case 'm': case 'M': n <<= 20; end++; break;
+		case 'g': case 'G': n <<= 30; end++; break;
+	}
+	return *end == '\0' ? n : 0;
+}
+
+std::string format_size(size_t size) {
+	if( size >= (1 << 30) && size % (1 << 30) == 0 )
+		return std::to_string( size >> 30 ) + "G";
+	if( size >= (1 << 20) && size % (1 << 20) == 0 )
+		return std::to_string( size >> 20 ) + "M";
+	if( size >= (1 << 10) && size % (1 << 10) == 0 )
+		return std::to_string( size >> 10 ) + "K";
+	return std::to_string( size );
+}
+
+bool parse_size_list(const std::string &s, std::vector<size_t> &out) {
+	out.clear();
+	size_t pos = 0;
+	while( pos <= s.size() ) {
+		size_t end = s.find( ',', pos );
+		if( end == std::string::npos )
+			end = s.size();
+		size_t n = parse_size( s.substr( pos, end - pos ));
+		if( n == 0 )
+			return false;
+		out.push_back( n );
+		pos = end + 1;
+	}
+	return !out.empty();
+}
+
+} // namespace XSecTools
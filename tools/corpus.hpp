@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#ifndef XSEC_TOOLS_CORPUS_H
+#define XSEC_TOOLS_CORPUS_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+namespace XSecTools {
+
+/* paths of the key material written by make_keys() */
+struct KeySet {
+	std::string rsa_key;   // rsa private key, pem
+	std::string rsa_pub;   // its public key, pem
+	std::string rsa_cert;  // self-signed certificate of it, pem
+	std::string rsa_p12;   // key and certificate, pkcs12 with password p12_password
+	std::string ec_key;    // P-256 private key, pem
+	std::string ec_pub;
+	std::string ec_cert;   // self-signed certificate of it, pem
+	std::string hmac;      // 32 byte shared secret
+	std::string kek128;    // raw aes key encryption keys
+	std::string kek192;
+	std::string kek256;
+};
+
+extern const char *p12_password;
+
+/* writes key material into dir, returns 0 on success.
+ * The same seed gives the same keys: openssl's random source is replaced by a stream derived
+ * from the seed while they are generated. Not for anything but testing. */
+int make_keys(const std::string &dir, KeySet &keys, uint64_t seed = 1);
+
+/* shape of a generated document */
+struct DocShape {
+	uint64_t seed  = 1;
+	size_t   size  = 16 << 10;  // approximate, the document is closed once it is reached
+	unsigned depth = 3;         // element levels below the root, the last one holds the payload
+	unsigned fanout = 8;        // children per element above the payload level, unlimited under the root
+	unsigned namespaces = 0;    // prefixed namespaces declared on the root
+	double   ns_density = 0;    // share of elements in one of those namespaces
+	double   attr_ratio = 0.25; // share of payload words placed in attributes instead of text
+	size_t   matches    = 0;    // elements selected by match_xpath
+	size_t   signatures = 0;    // ds:Signature elements
+	size_t   encrypted  = 0;    // xenc:EncryptedData elements
+};
+
+/* what make_document() actually produced */
+struct DocStats {
+	size_t bytes    = 0;
+	size_t elements = 0;
+	size_t payload  = 0;        // elements on the payload level
+	unsigned max_depth = 0;
+};
+
+/* selects exactly DocShape::matches elements of a generated document */
+extern const char *match_xpath;
+
+/* a document of the given shape, the same one for the same shape.
+ * Signature and EncryptedData elements are well-formed but carry random values, they are meant
+ * for detection and parsing, not for verification or decryption. */
+std::string make_document(const DocShape &shape, DocStats *stats = nullptr);
+
+/* a document of the default shape with about size bytes */
+std::string make_document(size_t size, uint64_t seed);
+
+int write_file(const std::string &path, const std::string &data);
+
+/* "64K", "16M", "1G" or a plain number of bytes, 0 if it can't be parsed */
+size_t parse_size(const std::string &s);
+std::string format_size(size_t size);
+
+/* comma separated parse_size() values, false if one of them can't be parsed */
+bool parse_size_list(const std::string &s, std::vector<size_t> &out);
+
+} // namespace XSecTools
+#endif
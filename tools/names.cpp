@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#include "xseccore.hpp"
+#include "names.hpp"
+
+namespace XSecTools {
+
+using namespace XSec;
+
+const Name sign_format_names[] = {
+	{ "enveloped",  SF_ENVELOPED },
+	{ "enveloping", SF_ENVELOPING },
+	{ "detached",   SF_DETACHED },
+	{ nullptr, 0 }
+};
+
+const Name c14n_names[] = {
+	{ "c14n11",   C14N_11_INCLUSIVE },
+	{ "c14n",     C14N_INCLUSIVE },
+	{ "exc-c14n", C14N_EXCLUSIVE },
+	{ nullptr, 0 }
+};
+
+const Name sign_algo_names[] = {
+	{ "rsa-sha1",     SA_RSA_SHA1 },
+	{ "rsa-sha224",   SA_RSA_SHA224 },
+	{ "rsa-sha256",   SA_RSA_SHA256 },
+	{ "rsa-sha384",   SA_RSA_SHA384 },
+	{ "rsa-sha512",   SA_RSA_SHA512 },
+	{ "ecdsa-sha1",   SA_ECDSA_SHA1 },
+	{ "ecdsa-sha224", SA_ECDSA_SHA224 },
+	{ "ecdsa-sha256", SA_ECDSA_SHA256 },
+	{ "ecdsa-sha384", SA_ECDSA_SHA384 },
+	{ "ecdsa-sha512", SA_ECDSA_SHA512 },
+	{ "hmac-sha256",  SA_HMAC_SHA256 },
+	{ "hmac-sha384",  SA_HMAC_SHA384 },
+	{ "hmac-sha512",  SA_HMAC_SHA512 },
+	{ nullptr, 0 }
+};
+
+const Name hash_names[] = {
+	{ "sha1",   HA_SHA1 },
+	{ "sha224", HA_SHA224 },
+	{ "sha256", HA_SHA256 },
+	{ "sha384", HA_SHA384 },
+	{ "sha512", HA_SHA512 },
+	{ nullptr, 0 }
+};
+
+const Name enc_algo_names[] = {
+	{ "aes128-cbc", EA_AES128_CBC },
+	{ "aes192-cbc", EA_AES192_CBC },
+	{ "aes256-cbc", EA_AES256_CBC },
+	{ "3des-cbc",   EA_3DES_CBC },
+	{ "aes128-gcm", EA_AES128_GCM },
+	{ "aes192-gcm", EA_AES192_GCM },
+	{ "aes256-gcm", EA_AES256_GCM },
+	{ nullptr, 0 }
+};
+
+const Name enc_form_names[] = {
+	{ "element", EF_ELEMENT },
+	{ "content", EF_CONTENT },
+	{ "root",    EF_ROOT },
+	{ nullptr, 0 }
+};
+
+const Name key_trans_names[] = {
+	{ "rsa-pkcs1",  KT_RSA_PKCS1 },
+	{ "rsa-oaep",   KT_RSA_OAEP },
+	{ "kw-aes128",  KT_AES128_KW },
+	{ "kw-aes192",  KT_AES192_KW },
+	{ "kw-aes256",  KT_AES256_KW },
+	{ nullptr, 0 }
+};
+
+const Name dtd_names[] = {
+	{ "ignore", PD_IGNORE },
+	{ "load",   PD_LOAD },
+	{ nullptr, 0 }
+};
+
+int value_of(const Name *table, const std::string &name) {
+	for( auto n = table; n->name != nullptr; n++ ) {
+		if( name == n->name )
+			return n->value;
+	}
+	return -1;
+}
+
+const char *name_of(const Name *table, int value) {
+	for( auto n = table; n->name != nullptr; n++ ) {
+		if( n->value == value )
+			return n->name;
+	}
+	return "?";
+}
+
+std::string names_of(const Name *table) {
+	std::string out;
+	for( auto n = table; n->name != nullptr; n++ ) {
+		if( !out.empty() )
+			out += ", ";
+		out += n->name;
+	}
+	return out;
+}
+
+} // namespace XSecTools
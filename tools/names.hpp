@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#ifndef XSEC_TOOLS_NAMES_H
+#define XSEC_TOOLS_NAMES_H
+
+#include <string>
+
+
+namespace XSecTools {
+
+/* command line names of the XSec enums, tables end with a nullptr name */
+struct Name {
+	const char *name;
+	int value;
+};
+
+extern const Name sign_format_names[];   // SignFormat
+extern const Name c14n_names[];          // C14NAlgo
+extern const Name sign_algo_names[];     // SignAlgo
+extern const Name hash_names[];          // HashAlgo
+extern const Name enc_algo_names[];      // EncAlgo
+extern const Name enc_form_names[];      // EncFormat
+extern const Name key_trans_names[];     // KeyTransAlgo
+extern const Name dtd_names[];           // ParseDtd
+
+/* value of name in table, -1 if it isn't there */
+int value_of(const Name *table, const std::string &name);
+
+/* name of value in table, "?" if it isn't there */
+const char *name_of(const Name *table, int value);
+
+/* "a, b, c" for usage texts */
+std::string names_of(const Name *table);
+
+} // namespace XSecTools
+#endif
@@ -0,0 +1,335 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "protocol.hpp"
+
+namespace XSecTools {
+
+static const size_t header_size = 12;  // the size field and what follows up to the body
+static const int max_fds = 2;
+
+
+static void put_u32(std::string &out, uint32_t v) {
+	v = htonl( v );
+	out.append( (const char*)&v, 4 );
+}
+
+static void put_u16(std::string &out, uint16_t v) {
+	v = htons( v );
+	out.append( (const char*)&v, 2 );
+}
+
+static void put_string(std::string &out, const std::string &s) {
+	put_u32( out, s.size() );
+	out += s;
+}
+
+/* reads the body of a frame front to back, any read past its end fails and sticks */
+class Reader {
+public:
+	Reader(const std::string &body) : body(body) {}
+
+	uint32_t u32() {
+		uint32_t v = 0;
+		if( take( 4 ))
+			memcpy( &v, body.data() + pos - 4, 4 );
+		return ntohl( v );
+	}
+
+	uint16_t u16() {
+		uint16_t v = 0;
+		if( take( 2 ))
+			memcpy( &v, body.data() + pos - 2, 2 );
+		return ntohs( v );
+	}
+
+	std::string string() {
+		uint32_t len = u32();
+		if( !take( len ))
+			return std::string();
+		return body.substr( pos - len, len );
+	}
+
+	/* true if everything was read, nothing more and nothing less */
+	bool done() const { return ok && pos == body.size(); }
+
+private:
+	bool take(size_t len) {
+		if( !ok || body.size() - pos < len )
+			return ok = false;
+		pos += len;
+		return true;
+	}
+
+	const std::string &body;
+	size_t pos = 0;
+	bool ok = true;
+};
+
+
+Channel::~Channel() {
+	for( int fd : passed )
+		close( fd );
+	if( sock >= 0 )
+		close( sock );
+}
+
+int Channel::write_frame(uint32_t id, int type, int flags, const std::string &head, const std::string &data,
+                         const int *fds, int nfds) {
+	std::string header;
+	put_u32( header, header_size - 4 + head.size() + data.size() );
+	put_u32( header, id );
+	header += (char)type;
+	header += (char)flags;
+	put_u16( header, 0 );
+
+	struct iovec iov[3] = {
+		{ (void*)header.data(), header.size() },
+		{ (void*)head.data(), head.size() },
+		{ (void*)data.data(), data.size() }
+	};
+	union {
+		char buf[CMSG_SPACE(sizeof(int) * max_fds)];
+		struct cmsghdr align;
+	} control;
+
+	struct msghdr msg;
+	memset( &msg, 0, sizeof(msg) );
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 3;
+	if( nfds > 0 ) {
+		msg.msg_control = control.buf;
+		msg.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+		auto cmsg = CMSG_FIRSTHDR( &msg );
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+		memcpy( CMSG_DATA(cmsg), fds, sizeof(int) * nfds );
+	}
+
+	while( msg.msg_iovlen > 0 ) {
+		ssize_t n = sendmsg( sock, &msg, MSG_NOSIGNAL );
+		if( n < 0 && errno == EINTR )
+			continue;
+		if( n < 0 )
+			return -1;
+
+		// the descriptors went with the first part, skip what was sent of the rest
+		msg.msg_control = nullptr;
+		msg.msg_controllen = 0;
+		while( msg.msg_iovlen > 0 && (size_t)n >= msg.msg_iov->iov_len ) {
+			n -= msg.msg_iov->iov_len;
+			msg.msg_iov++;
+			msg.msg_iovlen--;
+		}
+		if( msg.msg_iovlen > 0 ) {
+			msg.msg_iov->iov_base = (char*)msg.msg_iov->iov_base + n;
+			msg.msg_iov->iov_len -= n;
+		}
+	}
+	return 0;
+}
+
+int Channel::read_exactly(char *buf, size_t len) {
+	size_t got = 0;
+	while( got < len ) {
+		union {
+			char buf[CMSG_SPACE(sizeof(int) * max_fds)];
+			struct cmsghdr align;
+		} control;
+		struct iovec iov = { buf + got, len - got };
+		struct msghdr msg;
+		memset( &msg, 0, sizeof(msg) );
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof(control.buf);
+
+		ssize_t n = recvmsg( sock, &msg, MSG_CMSG_CLOEXEC );
+		if( n < 0 && errno == EINTR )
+			continue;
+		if( n < 0 )
+			return -1;
+
+		for( auto cmsg = CMSG_FIRSTHDR( &msg ); cmsg != nullptr; cmsg = CMSG_NXTHDR( &msg, cmsg )) {
+			if( cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS )
+				continue;
+			size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			for( size_t i = 0; i < count; i++ ) {
+				int fd;
+				memcpy( &fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int) );
+				passed.push_back( fd );
+			}
+		}
+		if( msg.msg_flags & MSG_CTRUNC )
+			return -1;
+		if( n == 0 )
+			return got == 0 ? 0 : -1;
+		got += n;
+	}
+	return 1;
+}
+
+int Channel::read_frame(uint32_t &id, int &type, int &flags, std::string &body) {
+	char header[header_size];
+	int ret = read_exactly( header, header_size );
+	if( ret <= 0 )
+		return ret;
+
+	uint32_t size;
+	memcpy( &size, header, 4 );
+	memcpy( &id, header + 4, 4 );
+	size = ntohl( size );
+	id = ntohl( id );
+	type = (unsigned char)header[8];
+	flags = (unsigned char)header[9];
+	if( size < header_size - 4 || size - (header_size - 4) > max_frame )
+		return -1;
+
+	body.resize( size - (header_size - 4) );
+	return body.empty() ? 1 : read_exactly( &body[0], body.size() ) == 1 ? 1 : -1;
+}
+
+
+int Channel::send(const Request &req) {
+	std::string head;
+	put_u16( head, req.args.size() );
+	for( auto &arg : req.args )
+		put_string( head, arg );
+	put_u32( head, req.document.size() );
+
+	int fds[max_fds], nfds = 0, flags = 0;
+	if( req.input_fd >= 0 ) {
+		fds[nfds++] = req.input_fd;
+		flags |= FF_INPUT_FD;
+	}
+	if( req.output_fd >= 0 ) {
+		fds[nfds++] = req.output_fd;
+		flags |= FF_OUTPUT_FD;
+	}
+	return write_frame( req.id, FT_REQUEST, flags, head, req.document, fds, nfds );
+}
+
+int Channel::send(const Response &res) {
+	std::string head;
+	put_u32( head, (uint32_t)res.status );
+	put_string( head, res.message );
+	put_string( head, res.metrics );
+	put_u32( head, res.result.size() );
+	return write_frame( res.id, FT_RESPONSE, 0, head, res.result, nullptr, 0 );
+}
+
+int Channel::receive(Request &req) {
+	int type, flags;
+	std::string body;
+	int ret = read_frame( req.id, type, flags, body );
+	if( ret <= 0 )
+		return ret;
+
+	req.input_fd = req.output_fd = -1;
+	if( flags & FF_INPUT_FD ) {
+		if( passed.empty() )
+			return -1;
+		req.input_fd = passed.front();
+		passed.pop_front();
+	}
+	if( flags & FF_OUTPUT_FD ) {
+		if( passed.empty() ) {
+			if( req.input_fd >= 0 )
+				close( req.input_fd );
+			req.input_fd = -1;
+			return -1;
+		}
+		req.output_fd = passed.front();
+		passed.pop_front();
+	}
+
+	Reader r( body );
+	req.args.resize( r.u16() );
+	for( auto &arg : req.args )
+		arg = r.string();
+	req.document = r.string();
+	if( type != FT_REQUEST || !r.done() ) {
+		if( req.input_fd >= 0 )
+			close( req.input_fd );
+		if( req.output_fd >= 0 )
+			close( req.output_fd );
+		req.input_fd = req.output_fd = -1;
+		return -1;
+	}
+	return 1;
+}
+
+int Channel::receive(Response &res) {
+	int type, flags;
+	std::string body;
+	int ret = read_frame( res.id, type, flags, body );
+	if( ret <= 0 )
+		return ret;
+
+	Reader r( body );
+	res.status = (int32_t)r.u32();
+	res.message = r.string();
+	res.metrics = r.string();
+	res.result = r.string();
+	return type == FT_RESPONSE && r.done() ? 1 : -1;
+}
+
+
+std::string default_socket_path() {
+	const char *dir = getenv( "XDG_RUNTIME_DIR" );
+	if( dir != nullptr && *dir != '\0' )
+		return std::string( dir ) + "/xsecd.sock";
+	return "/tmp/xsecd-" + std::to_string( getuid() ) + ".sock";
+}
+
+int connect_socket(const std::string &path) {
+	struct sockaddr_un addr;
+	memset( &addr, 0, sizeof(addr) );
+	addr.sun_family = AF_UNIX;
+	if( path.size() >= sizeof(addr.sun_path) ) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	memcpy( addr.sun_path, path.c_str(), path.size() + 1 );
+
+	int fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+	if( fd < 0 )
+		return -1;
+	if( connect( fd, (struct sockaddr*)&addr, sizeof(addr) ) != 0 ) {
+		int err = errno;
+		close( fd );
+		errno = err;
+		return -1;
+	}
+	return fd;
+}
+
+} // namespace XSecTools
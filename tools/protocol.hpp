@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+#ifndef XSEC_TOOLS_PROTOCOL_H
+#define XSEC_TOOLS_PROTOCOL_H
+
+#include <stdint.h>
+#include <deque>
+#include <string>
+
+#include "commands.hpp"
+
+
+namespace XSecTools {
+
+/* frames exchanged with xsecd over its unix socket, all integers are big endian
+ *
+ *   u32 size      of everything after this field
+ *   u32 id        picked by the client, a response carries the one of its request
+ *   u8  type      FT_*
+ *   u8  flags     FF_*
+ *   u16 reserved  0
+ *
+ * a request goes on with
+ *   u16 argc, argc times u32 length + bytes    the command as xsec takes it: "sign", "--key", "/k.pem", ...
+ *   u32 length + bytes                         the document, empty with FF_INPUT_FD
+ * a response with
+ *   i32 status                                 EXIT_OK, EXIT_INVALID or EXIT_ERROR
+ *   u32 length + bytes                         error message
+ *   u32 length + bytes                         metrics_json() of the call if --metrics was given
+ *   u32 length + bytes                         the result, empty with FF_OUTPUT_FD or for verify
+ *
+ * The file descriptors of FF_INPUT_FD and FF_OUTPUT_FD (in this order) travel with the first
+ * byte of the request, they have to be files, pipes or terminals, xsecd opens them again through
+ * /proc. A client may send any number of requests without waiting, the responses come as the
+ * requests are done, not necessarily in order. Input and output paths among the arguments are
+ * ignored, relative paths of other options are relative to the directory of xsecd. */
+
+enum FrameType {
+	FT_REQUEST = 1,
+	FT_RESPONSE
+};
+
+enum FrameFlags {
+	FF_INPUT_FD  = 0x01,
+	FF_OUTPUT_FD = 0x02
+};
+
+/* requests with inline documents above this size are refused by default */
+const uint32_t default_max_frame = 64 << 20;
+
+struct Request {
+	uint32_t id = 0;
+	Args args;
+	std::string document;
+	int input_fd = -1;
+	int output_fd = -1;
+};
+
+struct Response {
+	uint32_t id = 0;
+	int32_t  status = EXIT_ERROR;
+	std::string message;
+	std::string metrics;
+	std::string result;
+};
+
+/* frames over a connected unix stream socket. Not synchronized, one thread may send
+ * while another one receives, but no two may send at the same time */
+class Channel {
+public:
+	explicit Channel(int fd, uint32_t max_frame = default_max_frame) : sock(fd), max_frame(max_frame) {}
+	~Channel();
+
+	Channel(const Channel &) = delete;
+	Channel &operator=(const Channel &) = delete;
+
+	int fd() const { return sock; }
+
+	/* 0 on success, -1 if the connection broke, the file descriptors of a request are not closed */
+	int send(const Request &req);
+	int send(const Response &res);
+
+	/* 1 with a frame, 0 at the end of the connection, -1 if it broke or the peer violated the protocol,
+	 * the file descriptors of a request belong to the caller then */
+	int receive(Request &req);
+	int receive(Response &res);
+
+private:
+	int write_frame(uint32_t id, int type, int flags, const std::string &head, const std::string &data,
+	                const int *fds, int nfds);
+	int read_exactly(char *buf, size_t len);
+	int read_frame(uint32_t &id, int &type, int &flags, std::string &body);
+
+	int sock;
+	uint32_t max_frame;
+	std::deque<int> passed;  // received descriptors not yet claimed by a request
+};
+
+/* $XDG_RUNTIME_DIR/xsecd.sock, or /tmp/xsecd-UID.sock without a runtime directory */
+std::string default_socket_path();
+
+/* a socket connected to xsecd at path, -1 with errno set if there is none */
+int connect_socket(const std::string &path);
+
+} // namespace XSecTools
+#endif
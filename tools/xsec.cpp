@@ -0,0 +1,548 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+/*
+ * xsec - command line interface of xseccore, without the GUI
+ *
+ *   xsec sign    [options] [FILE]     signs FILE, the signed document goes to -o or stdout
+ *   xsec verify  [options] [FILE]     exits with 0 if the signature is valid, 1 if it isn't
+ *   xsec encrypt [options] [FILE]
+ *   xsec decrypt [options] [FILE]
+ *   xsec detect  [FILE...]            tells whether files are signed and/or encrypted
+ *   xsec batch   [FILE]               runs one of the commands above per line, sharing one Core
+ *
+ * FILE defaults to "-", stdin. Exit status 2 means the command failed or was used wrong.
+ * With --connect SOCKET in front of the command, xsecd runs it instead of this process.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <map>
+#include <memory>
+
+#include "xseccore.hpp"
+#include "xseccrlstore.hpp"
+#include "commands.hpp"
+#include "names.hpp"
+#include "protocol.hpp"
+
+using namespace XSec;
+using namespace XSecTools;
+
+
+/* requests a batch keeps sent to xsecd before waiting for the first response */
+static const size_t batch_window = 32;
+
+static void usage(FILE *fp) {
+	fprintf( fp,
+		"usage: xsec [--connect SOCKET] [--ca-dir DIR] [--crl PATH]... [--crl-index DIR] [--id-attr NAME]... [--limit NAME=N]... COMMAND ...\n"
+		"  --connect SOCKET        let the xsecd listening on SOCKET run the command\n"
+		"  --ca-dir DIR            trust the certificates in DIR too, hashed by \"openssl rehash\"\n"
+		"  --crl PATH              reject certificates revoked by the CRL in PATH, a file or directory, repeatable\n"
+		"  --crl-index DIR         keep the indexes of the CRLs in DIR, so big ones are read only once\n"
+		"  --id-attr NAME          treat attributes NAME, or {NAMESPACE}NAME, as IDs too, repeatable\n"
+		"  --limit NAME=N          fail commands going beyond N, repeatable, NAME is one of\n"
+		"                          %s\n"
+		"\n"
+		"usage: xsec sign [options] [FILE]\n"
+		"  -o FILE                 output, default stdout\n"
+		"  --format F              %s\n"
+		"  --c14n C                %s\n"
+		"  --algorithm A           %s\n"
+		"  --hash H                digest of the references, %s\n"
+		"  --key FILE              private key, pem\n"
+		"  --public-key FILE       embedded into the signature\n"
+		"  --cert                  --public-key is a certificate\n"
+		"  --p12                   --key is a pkcs12 file holding key and certificate\n"
+		"  --password P            of --key\n"
+		"  --secret FILE           shared secret for hmac-*\n"
+		"  --base-url URL\n"
+		"  --store-references      keep the canonicalized references (debugging)\n"
+		"  --ref URI[;hash=H][;transform=C][;intersect=X][;subtract=X][;union=X]\n"
+		"                          reference to sign, repeatable, enveloped signatures default to URI \"\"\n"
+		"\n"
+		"usage: xsec verify [options] [FILE]\n"
+		"  --public-key FILE       key the signature must verify with\n"
+		"  --cert                  --public-key is a certificate\n"
+		"  --p12                   --public-key is a pkcs12 file\n"
+		"  --trust-selfsigned      trust the certificate given as --public-key,\n"
+		"                          without one the first one embedded into FILE\n"
+		"  --secret FILE           shared secret for hmac-*\n"
+		"  --base-url URL\n"
+		"  -q                      print nothing, the exit status tells\n"
+		"\n"
+		"usage: xsec encrypt [options] [FILE]\n"
+		"  -o FILE                 output, default stdout\n"
+		"  --algorithm A           %s\n"
+		"  --form F                %s\n"
+		"  --transport T           %s\n"
+		"  --public-key FILE       of the recipient\n"
+		"  --cert                  --public-key is a certificate\n"
+		"  --p12                   --public-key is a pkcs12 file\n"
+		"  --password P            of --public-key\n"
+		"  --kek FILE              raw aes key for kw-aes*\n"
+		"  --trust-selfsigned\n"
+		"  --recipient FILE[;cert][;p12][;password=P]\n"
+		"                          further recipient, repeatable\n"
+		"  --xpath X               encrypt the nodes X selects, repeatable\n"
+		"\n"
+		"usage: xsec decrypt [options] [FILE]\n"
+		"  -o FILE                 output, default stdout\n"
+		"  --key FILE              private key\n"
+		"  --p12                   --key is a pkcs12 file\n"
+		"  --password P            of --key\n"
+		"  --kek FILE              raw aes key for kw-aes*\n"
+		"  --trust-selfsigned\n"
+		"  --indent                indent the output unless it is signed or still encrypted\n"
+		"\n"
+		"usage: xsec detect [FILE...]\n"
+		"usage: xsec batch [FILE]          one command per line, outputs must be files\n"
+		"\n"
+		"all commands take --metrics, it prints the timing of each call to stderr, and these on how FILE is parsed:\n"
+		"  --huge                  lift the limits on depth and text size, for trusted documents only\n"
+		"  --compact               store short text inside the nodes\n"
+		"  --no-blanks             drop whitespace-only text, which changes what is signed\n"
+		"  --dtd D                 %s, files default to load, in-memory documents to ignore\n",
+		limit_names().c_str(),
+		names_of( sign_format_names ).c_str(), names_of( c14n_names ).c_str(), names_of( sign_algo_names ).c_str(),
+		names_of( hash_names ).c_str(), names_of( enc_algo_names ).c_str(), names_of( enc_form_names ).c_str(),
+		names_of( key_trans_names ).c_str(), names_of( dtd_names ).c_str() );
+}
+
+
+/* parses a sign, verify, encrypt or decrypt command, prints why if it's wrong */
+static bool parse(const Args &args, Command &cmd, bool batch) {
+	std::string error;
+	bool ok = parse_command( args, cmd, error );
+	if( ok && batch && cmd.op != MO_VERIFY && cmd.output == "-" ) {
+		error = "batch commands need -o";
+		ok = false;
+	}
+	if( !ok )
+		fprintf( stderr, "xsec %s: %s\n", args[0].c_str(), error.c_str() );
+	return ok;
+}
+
+/* prints the outcome of a command, wherever it ran */
+static int report(const Command &cmd, const char *name, int status, const std::string &error,
+                  const std::string &metrics) {
+	if( !metrics.empty() )
+		fprintf( stderr, "%s\n", metrics.c_str() );
+	if( status == EXIT_ERROR ) {
+		fprintf( stderr, "xsec %s: %s\n", name, error.c_str() );
+		return EXIT_ERROR;
+	}
+	if( cmd.op == MO_VERIFY && !cmd.quiet )
+		printf( "%s: %s\n", cmd.input == "-" ? "stdin" : cmd.input.c_str(), status == EXIT_OK ? "valid" : "invalid" );
+	return status;
+}
+
+/* runs sign, verify, encrypt and decrypt in this process */
+static int cmd_local(Core &core, const Args &args, bool batch) {
+	Command cmd;
+	if( !parse( args, cmd, batch ))
+		return EXIT_ERROR;
+
+	int status = run_command( core, cmd );
+	return report( cmd, args[0].c_str(), status, core.error_message(),
+	               cmd.metrics ? metrics_json( args[0].c_str(), cmd.measured ) : std::string() );
+}
+
+
+/* xsecd resolves relative paths against its own directory, the ones of options are made absolute first,
+ * the document and result go as file descriptors */
+static Args absolute_paths(const Args &args) {
+	char cwd[PATH_MAX];
+	if( getcwd( cwd, sizeof(cwd) ) == nullptr )
+		return args;
+
+	Args out( args );
+	for( size_t i = 1; i + 1 < out.size(); i++ ) {
+		if( !is_path_option( out[i] ))
+			continue;
+		std::string &value = out[++i];
+		if( !value.empty() && value[0] != '/' && value[0] != '#' && value.find( "://" ) == std::string::npos )
+			value = std::string( cwd ) + "/" + value;
+	}
+	return out;
+}
+
+/* commands run by xsecd, they may be sent ahead of the responses */
+class Remote {
+public:
+	Remote(int fd) : channel( fd ) {}
+
+	/* sends a sign, verify, encrypt or decrypt command, EXIT_OK if it's on its way */
+	int submit(uint32_t id, const Args &args, bool batch) {
+		std::unique_ptr<Pending> p( new Pending );
+		if( !parse( args, p->cmd, batch ))
+			return EXIT_ERROR;
+		p->name = args[0];
+
+		Request req;
+		req.id = id;
+		req.args = absolute_paths( args );
+		const std::string &input = p->cmd.input, &output = p->cmd.output;
+		req.input_fd = input == "-" ? 0 : open( input.c_str(), O_RDONLY | O_CLOEXEC );
+		if( req.input_fd < 0 ) {
+			fprintf( stderr, "xsec %s: cannot open %s: %s\n", args[0].c_str(), input.c_str(), strerror( errno ));
+			return EXIT_ERROR;
+		}
+		if( p->cmd.op != MO_VERIFY ) {
+			struct stat st;
+			p->created = output != "-" && stat( output.c_str(), &st ) != 0;
+			req.output_fd = output == "-" ? 1 : open( output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666 );
+			if( req.output_fd < 0 ) {
+				fprintf( stderr, "xsec %s: cannot open %s: %s\n", args[0].c_str(), output.c_str(), strerror( errno ));
+				if( req.input_fd > 0 )
+					close( req.input_fd );
+				return EXIT_ERROR;
+			}
+		}
+
+		int ret = channel.send( req );
+		// xsecd has descriptors of its own now
+		if( req.input_fd > 0 )
+			close( req.input_fd );
+		if( req.output_fd > 1 )
+			close( req.output_fd );
+		if( ret != 0 ) {
+			fprintf( stderr, "xsec %s: lost the connection to xsecd\n", args[0].c_str() );
+			return EXIT_ERROR;
+		}
+		pending[id] = std::move( p );
+		return EXIT_OK;
+	}
+
+	/* waits for the next response and reports it, id tells which command it was.
+	 * Returns its status or -1 if the connection broke */
+	int complete(uint32_t &id) {
+		Response res;
+		if( channel.receive( res ) != 1 || pending.count( res.id ) == 0 ) {
+			fprintf( stderr, "xsec: lost the connection to xsecd\n" );
+			return -1;
+		}
+		id = res.id;
+		std::unique_ptr<Pending> p = std::move( pending[id] );
+		pending.erase( id );
+
+		if( res.status == EXIT_ERROR && p->created )
+			unlink( p->cmd.output.c_str() );
+		return report( p->cmd, p->name.c_str(), res.status, res.message, res.metrics );
+	}
+
+	size_t in_flight() const { return pending.size(); }
+
+private:
+	struct Pending {
+		Command cmd;
+		std::string name;
+		bool created = false;  // of the output, removed again if the command fails
+	};
+
+	Channel channel;
+	std::map<uint32_t, std::unique_ptr<Pending>> pending;
+};
+
+static std::unique_ptr<Remote> connect_remote(const std::string &path) {
+	int fd = connect_socket( path );
+	if( fd < 0 ) {
+		fprintf( stderr, "xsec: cannot connect to xsecd at %s: %s\n", path.c_str(), strerror( errno ));
+		return nullptr;
+	}
+	return std::unique_ptr<Remote>( new Remote( fd ));
+}
+
+static int cmd_remote(Remote &remote, const Args &args) {
+	int ret = remote.submit( 1, args, false );
+	if( ret != EXIT_OK )
+		return ret;
+	uint32_t id;
+	ret = remote.complete( id );
+	return ret < 0 ? EXIT_ERROR : ret;
+}
+
+/* stdin can only be parsed once, it is spooled to a file for the two checks */
+static std::string spool_stdin() {
+	char path[] = "/tmp/xsec.XXXXXX";
+	int fd = mkstemp( path );
+	if( fd < 0 )
+		return std::string();
+
+	char buf[65536];
+	ssize_t n;
+	bool ok = true;
+	while( ok && (n = read( 0, buf, sizeof(buf) )) > 0 )
+		ok = write( fd, buf, n ) == n;
+	close( fd );
+	if( !ok || n < 0 ) {
+		unlink( path );
+		return std::string();
+	}
+	return path;
+}
+
+static int cmd_detect(const Args &args, bool batch) {
+	Args files( args.begin() + 1, args.end() );
+	if( files.empty() )
+		files.push_back( "-" );
+
+	int ret = EXIT_OK;
+	for( auto &file : files ) {
+		if( file == "--metrics" )
+			continue;
+		if( file.size() > 1 && file[0] == '-' ) {
+			fprintf( stderr, "xsec detect: %s: unknown option\n", file.c_str() );
+			return EXIT_ERROR;
+		}
+
+		std::string path = file;
+		if( file == "-" ) {
+			if( batch ) {
+				fprintf( stderr, "xsec detect: batch commands can't read stdin\n" );
+				return EXIT_ERROR;
+			}
+			path = spool_stdin();
+			if( path.empty() ) {
+				fprintf( stderr, "xsec detect: cannot read stdin\n" );
+				return EXIT_ERROR;
+			}
+		}
+
+		if( access( path.c_str(), R_OK ) != 0 ) {
+			fprintf( stderr, "xsec detect: cannot read %s\n", file.c_str() );
+			ret = EXIT_ERROR;
+			continue;
+		}
+		bool sig = Core::hasSignature( path ), enc = Core::isEncrypted( path );
+		printf( "%s: %s\n", file == "-" ? "stdin" : file.c_str(),
+		        sig && enc ? "signed, encrypted" : sig ? "signed" : enc ? "encrypted" : "plain" );
+		if( path != file )
+			unlink( path.c_str() );
+	}
+	return ret;
+}
+
+
+/* splits a batch line like a shell would, without expansions: 'single', "double" and \ quoting */
+static bool split_line(const char *line, Args &out) {
+	out.clear();
+	std::string cur;
+	bool in_word = false;
+	char quote = 0;
+	for( const char *p = line; *p != '\0' && *p != '\n'; p++ ) {
+		char c = *p;
+		if( quote != 0 ) {
+			if( c == quote )
+				quote = 0;
+			else if( c == '\\' && quote == '"' && (p[1] == '"' || p[1] == '\\') )
+				cur += *++p;
+			else
+				cur += c;
+		}
+		else if( c == '\'' || c == '"' ) {
+			quote = c;
+			in_word = true;
+		}
+		else if( c == '\\' && p[1] != '\0' && p[1] != '\n' ) {
+			cur += *++p;
+			in_word = true;
+		}
+		else if( c == ' ' || c == '\t' || c == '\r' ) {
+			if( in_word )
+				out.push_back( cur );
+			cur.clear();
+			in_word = false;
+		}
+		else if( c == '#' && !in_word ) {
+			break;
+		}
+		else {
+			cur += c;
+			in_word = true;
+		}
+	}
+	if( in_word )
+		out.push_back( cur );
+	return quote == 0;
+}
+
+static void print_line(size_t lineno, int status) {
+	printf( "%zu %s\n", lineno, status == EXIT_OK ? "ok" : status == EXIT_INVALID ? "invalid" : "error" );
+	fflush( stdout );
+}
+
+/* one command per line, blank lines and # comments are skipped. Prints "<line> ok", "<line> invalid"
+ * or "<line> error" for each command, exits with 1 if any of them did not succeed.
+ * Given a Remote, the commands are sent ahead and the lines printed as xsecd finishes them */
+static int cmd_batch(Core *core, Remote *remote, const Args &args) {
+	if( args.size() > 2 ) {
+		fprintf( stderr, "xsec batch: takes one file of commands\n" );
+		return EXIT_ERROR;
+	}
+	FILE *fp = args.size() < 2 || args[1] == "-" ? stdin : fopen( args[1].c_str(), "r" );
+	if( fp == nullptr ) {
+		fprintf( stderr, "xsec batch: cannot open %s\n", args[1].c_str() );
+		return EXIT_ERROR;
+	}
+
+	int ret = EXIT_OK;
+	bool broken = false;
+	uint32_t id;
+	auto complete = [&]() {
+		int status = remote->complete( id );
+		if( status < 0 ) {
+			broken = true;
+			return;
+		}
+		print_line( id, status );
+		if( status != EXIT_OK )
+			ret = EXIT_INVALID;
+	};
+
+	char *line = nullptr;
+	size_t cap = 0;
+	Args words;
+	for( size_t lineno = 1; !broken && getline( &line, &cap, fp ) > 0; lineno++ ) {
+		if( !split_line( line, words )) {
+			printf( "%zu error unbalanced quotes\n", lineno );
+			ret = EXIT_INVALID;
+			continue;
+		}
+		if( words.empty() )
+			continue;
+
+		int status = EXIT_ERROR;
+		if( words[0] == "detect" ) {
+			status = cmd_detect( words, true );
+		}
+		else if( command_op( words[0] ) < 0 ) {
+			fprintf( stderr, "xsec batch: %zu: unknown command \"%s\"\n", lineno, words[0].c_str() );
+		}
+		else if( remote != nullptr ) {
+			while( !broken && remote->in_flight() >= batch_window )
+				complete();
+			if( broken )
+				break;
+			status = remote->submit( lineno, words, true );
+			if( status == EXIT_OK )
+				continue;
+		}
+		else {
+			status = cmd_local( *core, words, true );
+		}
+
+		print_line( lineno, status );
+		if( status != EXIT_OK )
+			ret = EXIT_INVALID;
+	}
+	while( remote != nullptr && !broken && remote->in_flight() > 0 )
+		complete();
+	free( line );
+	if( fp != stdin )
+		fclose( fp );
+	return broken ? EXIT_ERROR : ret;
+}
+
+int main(int argc, char **argv) {
+	int first = 1;
+	std::string socket, ca_dir, crl_index;
+	std::vector<std::string> crls, id_attrs;
+	Limits limits;
+	while( argc > first + 1 ) {
+		if( strcmp( argv[first], "--connect" ) == 0 )
+			socket = argv[first + 1];
+		else if( strcmp( argv[first], "--ca-dir" ) == 0 )
+			ca_dir = argv[first + 1];
+		else if( strcmp( argv[first], "--crl" ) == 0 )
+			crls.push_back( argv[first + 1] );
+		else if( strcmp( argv[first], "--crl-index" ) == 0 )
+			crl_index = argv[first + 1];
+		else if( strcmp( argv[first], "--id-attr" ) == 0 )
+			id_attrs.push_back( argv[first + 1] );
+		else if( strcmp( argv[first], "--limit" ) == 0 ) {
+			if( !parse_limit( argv[first + 1], limits )) {
+				fprintf( stderr, "xsec: bad limit \"%s\", NAME=N with NAME one of %s\n", argv[first + 1],
+				         limit_names().c_str() );
+				return EXIT_ERROR;
+			}
+		}
+		else
+			break;
+		first += 2;
+	}
+	if( argc <= first || strcmp( argv[first], "-h" ) == 0 || strcmp( argv[first], "--help" ) == 0 ) {
+		usage( argc <= first ? stderr : stdout );
+		return argc <= first ? EXIT_ERROR : EXIT_OK;
+	}
+
+	Args args( argv + first, argv + argc );
+	bool batch = args[0] == "batch";
+	if( !batch && args[0] != "detect" && command_op( args[0] ) < 0 ) {
+		fprintf( stderr, "xsec: unknown command \"%s\"\n", args[0].c_str() );
+		usage( stderr );
+		return EXIT_ERROR;
+	}
+	if( args[0] == "detect" )
+		return cmd_detect( args, false );
+
+	// with a daemon to run the commands, there's no need to set up a Core here
+	if( !socket.empty() ) {
+		auto remote = connect_remote( socket );
+		if( !remote )
+			return EXIT_ERROR;
+		return batch ? cmd_batch( nullptr, remote.get(), args ) : cmd_remote( *remote, args );
+	}
+
+	Core core;
+	core.set_limits( limits );
+	if( !ca_dir.empty() && core.set_ca_dir( ca_dir ) != 0 ) {
+		fprintf( stderr, "xsec: %s", core.error_message().c_str() );
+		return EXIT_ERROR;
+	}
+	if( !id_attrs.empty() ) {
+		auto names = core.get_id_attributes();
+		names.insert( names.end(), id_attrs.begin(), id_attrs.end() );
+		if( core.set_id_attributes( names ) != 0 ) {
+			fprintf( stderr, "xsec: %s", core.error_message().c_str() );
+			return EXIT_ERROR;
+		}
+	}
+
+	CrlStore revocations( crl_index );
+	for( auto &crl : crls ) {
+		if( revocations.add( crl ) != 0 ) {
+			fprintf( stderr, "xsec: %s", revocations.error().c_str() );
+			return EXIT_ERROR;
+		}
+	}
+	if( !crls.empty() )
+		core.set_crl_store( &revocations );
+	return batch ? cmd_batch( &core, nullptr, args ) : cmd_local( core, args, false );
+}
@@ -0,0 +1,683 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+/*
+ * xseccore_baseline - records and compares the performance of a fixed xseccore workload
+ *
+ *   xseccore_baseline record FILE     runs the workload and writes the baseline to FILE
+ *   xseccore_baseline compare FILE    runs the workload and compares it to the baseline in FILE
+ *
+ * The cases run --rounds times, interleaved, each run in a child process of its own so its peak RSS
+ * is its own as well. A latency only counts as regressed if its median grew beyond the threshold and
+ * a Mann-Whitney U test over the rounds says the growth is no noise.
+ * compare exits with 0 if nothing regressed, 1 on a regression and 2 if the workload failed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/utsname.h>
+#include <algorithm>
+#include <list>
+
+#include <openssl/crypto.h>
+
+#include "xseccore.hpp"
+#include "bench.hpp"
+#include "corpus.hpp"
+
+using namespace XSec;
+using namespace XSecTools;
+
+
+/* layout of the baseline file */
+static const int baseline_format = 1;
+/* bumped whenever the cases below change, results of different workloads don't compare */
+static const int workload_version = 1;
+
+struct Thresholds {
+	double p50    = 0.10;   // relative growth of the median that counts as a regression
+	double p99    = 0.25;
+	double allocs = 0.02;
+	double rss    = 0.10;
+	double alpha  = 0.01;   // significance level of the U test on latencies
+};
+
+struct Options {
+	std::string command;
+	std::string file;
+	std::string json;
+	BenchConfig config;
+	Thresholds thresholds;
+	size_t rounds = 5;
+};
+
+/* one value per round */
+struct CaseResult {
+	std::string name;
+	std::vector<double> p50_ms, p99_ms;
+	std::vector<double> allocs, heap_peak;
+	std::vector<double> rss_kb;
+};
+
+/* what a single run of a case reports */
+struct RunResult {
+	int    error = -1;
+	double p50_ms = 0, p99_ms = 0;
+	double allocs = 0, heap_peak = 0;
+	double rss_kb = 0;
+};
+
+struct Case {
+	std::string name;
+	uint64_t bytes;
+	BenchOp op;
+};
+
+
+static void usage(FILE *fp) {
+	fprintf( fp,
+		"usage: xseccore_baseline record FILE [--rounds N] [--min-time SEC]\n"
+		"       xseccore_baseline compare FILE [--rounds N] [--min-time SEC] [--json FILE] [thresholds]\n"
+		"  --rounds N    runs of each case, default 5, the U test needs 5 on both sides to pass alpha 0.01\n"
+		"  --min-time S  seconds each run measures, default 0.2\n"
+		"  --json FILE   write the current results as a baseline as well\n"
+		"thresholds, relative growth counted as a regression:\n"
+		"  --p50 F       median latency, default 0.10\n"
+		"  --p99 F       99th percentile latency, default 0.25\n"
+		"  --allocs F    allocations per operation, default 0.02\n"
+		"  --rss F       peak resident set size, default 0.10\n"
+		"  --alpha F     significance level latencies must pass as well, default 0.01\n" );
+}
+
+static int parse_args(int argc, char **argv, Options &opt) {
+	if( argc < 3 )
+		return -1;
+	opt.command = argv[1];
+	opt.file = argv[2];
+	if( opt.command != "record" && opt.command != "compare" )
+		return -1;
+
+	opt.config.min_time = 0.2;
+	for( int i = 3; i < argc; i++ ) {
+		std::string arg = argv[i];
+		if( i + 1 >= argc )
+			return -1;
+		const char *value = argv[++i];
+		char *end = nullptr;
+		double n = strtod( value, &end );
+		if( arg != "--json" && (end == value || *end != '\0' || n < 0) )
+			return -1;
+
+		if( arg == "--json" )
+			opt.json = value;
+		else if( arg == "--min-time" )
+			opt.config.min_time = n;
+		else if( arg == "--rounds" && n >= 1 )
+			opt.rounds = (size_t) n;
+		else if( arg == "--p50" )
+			opt.thresholds.p50 = n;
+		else if( arg == "--p99" )
+			opt.thresholds.p99 = n;
+		else if( arg == "--allocs" )
+			opt.thresholds.allocs = n;
+		else if( arg == "--rss" )
+			opt.thresholds.rss = n;
+		else if( arg == "--alpha" )
+			opt.thresholds.alpha = n;
+		else
+			return -1;
+	}
+	return 0;
+}
+
+
+/* the workload, fixed seeds and shapes so every run measures the same documents */
+class Workload {
+public:
+	int prepare(const std::string &dir) {
+		if( make_keys( dir, keys, 1 ) != 0 )
+			return -1;
+
+		small = make_document( 4 << 10, 1 );
+		large = make_document( 256 << 10, 2 );
+
+		DocShape shape;
+		shape.seed = 3;
+		shape.size = 64 << 10;
+		shape.depth = 6;
+		shape.fanout = 4;
+		shape.namespaces = 4;
+		shape.ns_density = 0.3;
+		shape.attr_ratio = 0.5;
+		nested = make_document( shape );
+
+		small_path = dir + "/small.xml";
+		large_path = dir + "/large.xml";
+		if( write_file( small_path, small ) != 0 || write_file( large_path, large ) != 0 )
+			return -1;
+		for( int i = 0; i < 10; i++ ) {
+			refs[i].hash = HA_SHA256;
+			refs[i].transform = C14N_EXCLUSIVE;
+			refs[i].uri = dir + "/ref" + std::to_string(i) + ".xml";
+			if( write_file( refs[i].uri, make_document( 1 << 10, 100 + i )) != 0 )
+				return -1;
+		}
+		enveloped.hash = HA_SHA256;
+		enveloped.transform = C14N_EXCLUSIVE;
+		out_path = dir + "/out.xml";
+		enc_path = dir + "/enc.xml";
+		return 0;
+	}
+
+	/* the cases, inputs of verify and decrypt cases are produced here, returns 0 on success */
+	int build(Core &core, std::vector<Case> &cases) {
+		auto rsa = sign_opts( SA_RSA_SHA256, C14N_EXCLUSIVE );
+		rsa.private_key = keys.rsa_key;
+		rsa.public_key  = keys.rsa_pub;
+		auto ecdsa = sign_opts( SA_ECDSA_SHA256, C14N_EXCLUSIVE );
+		ecdsa.private_key = keys.ec_key;
+		auto hmac = sign_opts( SA_HMAC_SHA256, C14N_11_INCLUSIVE );
+		hmac.secret_key = keys.hmac;
+		auto detached = rsa;
+		detached.format = SF_DETACHED;
+		detached.references.clear();
+		for( auto &r : refs )
+			detached.references.push_back( &r );
+
+		verify_options_t rsa_v, ec_v, hmac_v;
+		rsa_v.doc_in_memory = ec_v.doc_in_memory = hmac_v.doc_in_memory = true;
+		rsa_v.public_key  = keys.rsa_pub;
+		ec_v.public_key   = keys.ec_pub;
+		hmac_v.secret_key = keys.hmac;
+
+		if( add_signature( core, cases, "enveloped/rsa-sha256/exc-c14n/4K", small, rsa, rsa_v )
+		    || add_signature( core, cases, "enveloped/rsa-sha256/exc-c14n/256K", large, rsa, rsa_v )
+		    || add_signature( core, cases, "enveloped/rsa-sha256/exc-c14n/nested-64K", nested, rsa, rsa_v )
+		    || add_signature( core, cases, "enveloped/ecdsa-sha256/exc-c14n/4K", small, ecdsa, ec_v )
+		    || add_signature( core, cases, "enveloped/hmac-sha256/c14n11/4K", small, hmac, hmac_v )
+		    || add_signature( core, cases, "detached/rsa-sha256/exc-c14n/10refs", std::string(), detached, rsa_v ))
+			return -1;
+
+		encrypt_options_t oaep;
+		oaep.encryption_algorithm = EA_AES256_GCM;
+		oaep.key_transport_algorithm = KT_RSA_OAEP;
+		oaep.public_key = keys.rsa_cert;
+		oaep.public_key_is_cert = true;
+		decrypt_options_t oaep_d;
+		oaep_d.private_key = keys.rsa_key;
+
+		encrypt_options_t kw;
+		kw.encryption_algorithm = EA_AES128_CBC;
+		kw.key_transport_algorithm = KT_AES256_KW;
+		kw.key_encryption_key = keys.kek256;
+		decrypt_options_t kw_d;
+		kw_d.key_encryption_key = keys.kek256;
+
+		if( add_encryption( core, cases, "aes256-gcm/rsa-oaep/4K", small_path, small.size(), oaep, oaep_d )
+		    || add_encryption( core, cases, "aes256-gcm/rsa-oaep/256K", large_path, large.size(), oaep, oaep_d )
+		    || add_encryption( core, cases, "aes128-cbc/kw-aes256/4K", small_path, small.size(), kw, kw_d ))
+			return -1;
+		return 0;
+	}
+
+private:
+	sign_options_t sign_opts(int algo, int c14n) {
+		sign_options_t so;
+		so.format = SF_ENVELOPED;
+		so.sign_algorithm = algo;
+		so.c14n_algorithm = c14n;
+		so.hash_algorithm = HA_SHA256;
+		so.doc_in_memory  = true;
+		so.references.push_back( &enveloped );
+		return so;
+	}
+
+	int add_signature(Core &core, std::vector<Case> &cases, const std::string &suffix, const std::string &doc,
+	                  const sign_options_t &so, const verify_options_t &vo) {
+		const std::string &input = *inputs.emplace( inputs.end(), doc );
+		std::string &signed_doc = *inputs.emplace( inputs.end() );
+		if( core.sign( input, signed_doc, so ) != 0 ) {
+			fprintf( stderr, "sign/%s: %s\n", suffix.c_str(), core.error_message().c_str() );
+			return -1;
+		}
+
+		uint64_t bytes = input.empty() ? 10 << 10 : input.size();
+		cases.push_back( { "sign/" + suffix, bytes, [&core, &input, so]( Metrics *m ) {
+			std::string out;
+			sign_options_t o = so;
+			o.metrics = m;
+			return core.sign( input, out, o );
+		} } );
+		cases.push_back( { "verify/" + suffix, signed_doc.size(), [&core, &signed_doc, vo]( Metrics *m ) {
+			bool valid = false;
+			verify_options_t o = vo;
+			o.metrics = m;
+			int ret = core.verify( signed_doc, valid, o );
+			return ret != 0 ? ret : (valid ? 0 : -1);
+		} } );
+		return 0;
+	}
+
+	int add_encryption(Core &core, std::vector<Case> &cases, const std::string &suffix, const std::string &path,
+	                   uint64_t bytes, const encrypt_options_t &eo, const decrypt_options_t &dopt) {
+		// every case gets its own encrypted input, they all run in children of this process
+		std::string &encrypted = *inputs.emplace( inputs.end(), enc_path + "." + std::to_string( cases.size() ));
+		std::string target = encrypted;
+		if( core.encrypt( path, target, eo ) != 0 ) {
+			fprintf( stderr, "encrypt/%s: %s\n", suffix.c_str(), core.error_message().c_str() );
+			return -1;
+		}
+
+		const std::string &out = out_path;
+		cases.push_back( { "encrypt/" + suffix, bytes, [&core, &path, &out, eo]( Metrics *m ) {
+			std::string target = out;
+			encrypt_options_t o = eo;
+			o.metrics = m;
+			return core.encrypt( path, target, o );
+		} } );
+		cases.push_back( { "decrypt/" + suffix, bytes, [&core, &encrypted, &out, dopt]( Metrics *m ) {
+			std::string target = out;
+			decrypt_options_t o = dopt;
+			o.metrics = m;
+			return core.decrypt( encrypted, target, o );
+		} } );
+		return 0;
+	}
+
+	KeySet keys;
+	std::string small, large, nested;
+	std::string small_path, large_path, out_path, enc_path;
+	Reference enveloped;
+	Reference refs[10];
+	std::list<std::string> inputs;   // documents and files of the cases, a list keeps their addresses
+};
+
+
+/* runs c in a child process, so its peak RSS and any crash stay its own */
+static RunResult run_case(const Case &c, const BenchConfig &config) {
+	RunResult r;
+
+	int fds[2];
+	if( pipe( fds ) != 0 )
+		return r;
+
+	fflush( stdout );
+	pid_t pid = fork();
+	if( pid < 0 ) {
+		close( fds[0] );
+		close( fds[1] );
+		return r;
+	}
+	if( pid == 0 ) {
+		close( fds[0] );
+		BenchResult b = run_bench( c.name, c.bytes, config, c.op );
+		char line[256];
+		int n = snprintf( line, sizeof(line), "%d %.6f %.6f %.1f %.0f\n",
+		                  b.error, b.p50_ms, b.p99_ms, b.allocs, b.heap_peak );
+		ssize_t written = write( fds[1], line, n );
+		_exit( written == n ? 0 : 1 );
+	}
+
+	close( fds[1] );
+	char line[256] = {0};
+	size_t got = 0;
+	ssize_t n;
+	while( got < sizeof(line) - 1 && (n = read( fds[0], line + got, sizeof(line) - 1 - got )) > 0 )
+		got += n;
+	close( fds[0] );
+
+	int status = 0;
+	struct rusage usage;
+	if( wait4( pid, &status, 0, &usage ) != pid || !WIFEXITED( status ) || WEXITSTATUS( status ) != 0 )
+		return r;
+
+	if( sscanf( line, "%d %lf %lf %lf %lf", &r.error, &r.p50_ms, &r.p99_ms, &r.allocs, &r.heap_peak ) != 5 )
+		r.error = -1;
+	r.rss_kb = usage.ru_maxrss;
+	return r;
+}
+
+static void remove_dir(const std::string &dir) {
+	DIR *d = opendir( dir.c_str() );
+	if( d == nullptr )
+		return;
+	while( auto ent = readdir( d )) {
+		if( strcmp( ent->d_name, "." ) != 0 && strcmp( ent->d_name, ".." ) != 0 )
+			unlink( (dir + "/" + ent->d_name).c_str() );
+	}
+	closedir( d );
+	rmdir( dir.c_str() );
+}
+
+static int run_workload(const Options &opt, std::vector<CaseResult> &results) {
+	// before Core touches libxml2
+	metrics_track_heap();
+
+	char tmpl[] = "/tmp/xseccore_baseline.XXXXXX";
+	if( mkdtemp( tmpl ) == nullptr ) {
+		fprintf( stderr, "cannot create a temporary directory\n" );
+		return -1;
+	}
+	std::string dir = tmpl;
+
+	Core core;
+	Workload workload;
+	std::vector<Case> cases;
+	int ret = 0;
+	if( workload.prepare( dir ) != 0 || workload.build( core, cases ) != 0 ) {
+		fprintf( stderr, "failed to prepare the workload in %s\n", dir.c_str() );
+		ret = -1;
+	}
+
+	results.resize( cases.size() );
+	for( size_t i = 0; i < cases.size(); i++ )
+		results[i].name = cases[i].name;
+
+	// round by round rather than case by case, so a slow phase of the machine hits all cases alike
+	for( size_t round = 0; ret == 0 && round < opt.rounds; round++ ) {
+		fprintf( stderr, "round %zu/%zu\n", round + 1, opt.rounds );
+		for( size_t i = 0; ret == 0 && i < cases.size(); i++ ) {
+			RunResult r = run_case( cases[i], opt.config );
+			if( r.error != 0 ) {
+				fprintf( stderr, "%s failed (%d)\n", cases[i].name.c_str(), r.error );
+				ret = -1;
+			}
+			results[i].p50_ms.push_back( r.p50_ms );
+			results[i].p99_ms.push_back( r.p99_ms );
+			results[i].allocs.push_back( r.allocs );
+			results[i].heap_peak.push_back( r.heap_peak );
+			results[i].rss_kb.push_back( r.rss_kb );
+		}
+	}
+
+	remove_dir( dir );
+	return ret;
+}
+
+
+static std::string json_array(const std::vector<double> &values, int precision) {
+	std::string out = "[";
+	char buf[64];
+	for( size_t i = 0; i < values.size(); i++ ) {
+		snprintf( buf, sizeof(buf), "%s%.*f", i > 0 ? ", " : "", precision, values[i] );
+		out += buf;
+	}
+	return out + "]";
+}
+
+static int write_baseline(const std::string &path, const std::vector<CaseResult> &results) {
+	char created[32];
+	time_t now = time( nullptr );
+	strftime( created, sizeof(created), "%Y-%m-%dT%H:%M:%SZ", gmtime( &now ));
+	struct utsname host;
+	uname( &host );
+
+	FILE *fp = fopen( path.c_str(), "w" );
+	if( fp == nullptr )
+		return -1;
+
+	// one case per line, read_baseline() depends on it
+	fprintf( fp, "{\n\"format\": %d,\n\"workload\": %d,\n\"created\": \"%s\",\n\"host\": \"%s %s %s\",\n"
+	             "\"libxml2\": \"%s\",\n\"xmlsec\": \"%s\",\n\"openssl\": \"%s\",\n\"cases\": [\n",
+	         baseline_format, workload_version, created, host.nodename, host.sysname, host.machine,
+	         LIBXML_DOTTED_VERSION, XMLSEC_VERSION, OpenSSL_version( OPENSSL_VERSION ));
+	for( size_t i = 0; i < results.size(); i++ ) {
+		auto &r = results[i];
+		fprintf( fp, "  {\"name\": \"%s\", \"p50_ms\": %s, \"p99_ms\": %s, \"allocs\": %s, \"heap_peak\": %s, \"rss_kb\": %s}%s\n",
+		         r.name.c_str(), json_array( r.p50_ms, 6 ).c_str(), json_array( r.p99_ms, 6 ).c_str(),
+		         json_array( r.allocs, 1 ).c_str(), json_array( r.heap_peak, 0 ).c_str(), json_array( r.rss_kb, 0 ).c_str(),
+		         i + 1 < results.size() ? "," : "" );
+	}
+	fprintf( fp, "]\n}\n" );
+	return fclose( fp ) == 0 ? 0 : -1;
+}
+
+/* value of "key": in text, only for the flat objects write_baseline() produces */
+static bool json_value(const std::string &text, const char *key, std::string &out) {
+	std::string needle = std::string( "\"" ) + key + "\":";
+	size_t pos = text.find( needle );
+	if( pos == std::string::npos )
+		return false;
+	pos = text.find_first_not_of( " ", pos + needle.size() );
+	if( pos == std::string::npos )
+		return false;
+	if( text[pos] == '"' ) {
+		size_t end = text.find( '"', pos + 1 );
+		out = text.substr( pos + 1, end - pos - 1 );
+	}
+	else if( text[pos] == '[' ) {
+		size_t end = text.find( ']', pos );
+		if( end == std::string::npos )
+			return false;
+		out = text.substr( pos + 1, end - pos - 1 );
+	}
+	else {
+		size_t end = text.find_first_of( ",}\n", pos );
+		out = text.substr( pos, end - pos );
+	}
+	return true;
+}
+
+static bool json_number(const std::string &text, const char *key, double &out) {
+	std::string value;
+	if( !json_value( text, key, value ))
+		return false;
+	char *end = nullptr;
+	out = strtod( value.c_str(), &end );
+	return end != value.c_str();
+}
+
+static bool json_numbers(const std::string &text, const char *key, std::vector<double> &out) {
+	std::string value;
+	if( !json_value( text, key, value ))
+		return false;
+	out.clear();
+	const char *cur = value.c_str();
+	while( true ) {
+		char *end = nullptr;
+		double n = strtod( cur, &end );
+		if( end == cur )
+			break;
+		out.push_back( n );
+		cur = end;
+		while( *cur == ',' || *cur == ' ' )
+			cur++;
+	}
+	return !out.empty();
+}
+
+static int read_baseline(const std::string &path, int &workload, std::vector<CaseResult> &results) {
+	FILE *fp = fopen( path.c_str(), "r" );
+	if( fp == nullptr ) {
+		fprintf( stderr, "cannot open %s\n", path.c_str() );
+		return -1;
+	}
+	std::string header;
+	char *line = nullptr;
+	size_t cap = 0;
+	double format = 0, version = 0;
+	bool in_cases = false;
+	int ret = 0;
+	while( getline( &line, &cap, fp ) > 0 ) {
+		std::string l = line;
+		if( !in_cases ) {
+			header += l;
+			in_cases = l.find( "\"cases\"" ) != std::string::npos;
+			continue;
+		}
+		if( l.find( "\"name\"" ) == std::string::npos )
+			continue;
+
+		CaseResult r;
+		if( !json_value( l, "name", r.name ) || !json_numbers( l, "p50_ms", r.p50_ms )
+		    || !json_numbers( l, "p99_ms", r.p99_ms ) || !json_numbers( l, "allocs", r.allocs )
+		    || !json_numbers( l, "heap_peak", r.heap_peak ) || !json_numbers( l, "rss_kb", r.rss_kb )) {
+			fprintf( stderr, "%s: malformed case: %s", path.c_str(), line );
+			ret = -1;
+			break;
+		}
+		results.push_back( r );
+	}
+	free( line );
+	fclose( fp );
+	if( ret != 0 )
+		return ret;
+
+	if( !json_number( header, "format", format ) || format != baseline_format ) {
+		fprintf( stderr, "%s: not a baseline of format %d\n", path.c_str(), baseline_format );
+		return -1;
+	}
+	json_number( header, "workload", version );
+	workload = (int) version;
+	return 0;
+}
+
+
+static double median(std::vector<double> values) {
+	if( values.empty() )
+		return 0;
+	std::sort( values.begin(), values.end() );
+	size_t n = values.size();
+	return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+/* one-sided p-value of the Mann-Whitney U test that cur tends to be larger than base,
+ * normal approximation with continuity correction */
+static double p_larger(const std::vector<double> &base, const std::vector<double> &cur) {
+	double n1 = base.size(), n2 = cur.size();
+	if( n1 == 0 || n2 == 0 )
+		return 1;
+
+	double u = 0;
+	for( double c : cur ) {
+		for( double b : base )
+			u += c > b ? 1 : c == b ? 0.5 : 0;
+	}
+	double mean = n1 * n2 / 2;
+	double sd = sqrt( n1 * n2 * (n1 + n2 + 1) / 12 );
+	double z = (u - mean - 0.5) / sd;
+	return 0.5 * erfc( z / sqrt(2) );
+}
+
+/* verdict on medians, larger and smaller tell whether a change that way is more than noise */
+static const char *verdict(double base, double cur, double threshold, bool larger, bool smaller) {
+	if( base <= 0 )
+		return "";
+	double change = (cur - base) / base;
+	if( change > threshold && larger )
+		return "REGRESSED";
+	if( change < -threshold && smaller )
+		return "improved";
+	return "";
+}
+
+static void print_row(const char *name, const char *metric, double base, double cur, const char *v) {
+	double change = base > 0 ? (cur - base) / base * 100 : 0;
+	printf( "%-48s %-7s %12.3f %12.3f %+8.1f%%  %s\n", name, metric, base, cur, change, v );
+}
+
+static int compare(const std::vector<CaseResult> &base, const std::vector<CaseResult> &cur, const Thresholds &t) {
+	int regressions = 0;
+	printf( "%-48s %-7s %12s %12s %9s\n", "case", "metric", "baseline", "current", "change" );
+	for( auto &c : cur ) {
+		auto b = std::find_if( base.begin(), base.end(), [&]( const CaseResult &r ) { return r.name == c.name; } );
+		if( b == base.end() ) {
+			printf( "%-48s not in the baseline\n", c.name.c_str() );
+			continue;
+		}
+
+		double p50[2] = { median( b->p50_ms ), median( c.p50_ms ) };
+		double p99[2] = { median( b->p99_ms ), median( c.p99_ms ) };
+		double allocs[2] = { median( b->allocs ), median( c.allocs ) };
+		double rss[2] = { median( b->rss_kb ), median( c.rss_kb ) };
+
+		// allocations and rss hardly vary between rounds, the threshold alone decides there
+		const char *v[4] = {
+			verdict( p50[0], p50[1], t.p50, p_larger( b->p50_ms, c.p50_ms ) < t.alpha,
+			                                 p_larger( c.p50_ms, b->p50_ms ) < t.alpha ),
+			verdict( p99[0], p99[1], t.p99, p_larger( b->p99_ms, c.p99_ms ) < t.alpha,
+			                                 p_larger( c.p99_ms, b->p99_ms ) < t.alpha ),
+			verdict( allocs[0], allocs[1], t.allocs, true, true ),
+			verdict( rss[0], rss[1], t.rss, true, true ),
+		};
+		print_row( c.name.c_str(), "p50 ms", p50[0], p50[1], v[0] );
+		print_row( "", "p99 ms", p99[0], p99[1], v[1] );
+		print_row( "", "allocs", allocs[0], allocs[1], v[2] );
+		print_row( "", "rss KB", rss[0], rss[1], v[3] );
+		for( auto s : v )
+			regressions += strcmp( s, "REGRESSED" ) == 0;
+	}
+	for( auto &b : base ) {
+		if( std::none_of( cur.begin(), cur.end(), [&]( const CaseResult &r ) { return r.name == b.name; } ))
+			printf( "%-48s missing from this run\n", b.name.c_str() );
+	}
+
+	if( regressions > 0 )
+		printf( "\n%d regression%s\n", regressions, regressions > 1 ? "s" : "" );
+	else
+		printf( "\nno regressions\n" );
+	return regressions;
+}
+
+
+int main(int argc, char **argv) {
+	Options opt;
+	if( parse_args( argc, argv, opt ) != 0 ) {
+		usage( stderr );
+		return 2;
+	}
+
+	std::vector<CaseResult> base;
+	int base_workload = 0;
+	if( opt.command == "compare" ) {
+		if( read_baseline( opt.file, base_workload, base ) != 0 )
+			return 2;
+		if( base_workload != workload_version ) {
+			fprintf( stderr, "%s was recorded with workload %d, this is workload %d\n",
+			         opt.file.c_str(), base_workload, workload_version );
+			return 2;
+		}
+	}
+
+	std::vector<CaseResult> results;
+	if( run_workload( opt, results ) != 0 )
+		return 2;
+
+	if( opt.command == "record" ) {
+		if( write_baseline( opt.file, results ) != 0 ) {
+			fprintf( stderr, "cannot write %s\n", opt.file.c_str() );
+			return 2;
+		}
+		return 0;
+	}
+
+	if( !opt.json.empty() && write_baseline( opt.json, results ) != 0 )
+		fprintf( stderr, "cannot write %s\n", opt.json.c_str() );
+	return compare( base, results, opt.thresholds ) > 0 ? 1 : 0;
+}
@@ -0,0 +1,365 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+/*
+ * xseccore_bench - measures Core::sign, verify, encrypt and decrypt
+ *
+ * every SignFormat x SignAlgo x C14NAlgo is signed and verified, enveloped signatures over
+ * documents of each --sizes, enveloping and detached ones over each --refs count of documents,
+ * every EncAlgo encrypts and decrypts documents of each --sizes.
+ * Keys and documents are generated into a temporary directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "xseccore.hpp"
+#include "bench.hpp"
+#include "corpus.hpp"
+#include "names.hpp"
+
+using namespace XSec;
+using namespace XSecTools;
+
+
+struct Options {
+	std::string filter;
+	std::vector<size_t> sizes = { 1 << 10, 16 << 10, 256 << 10, 4 << 20 };
+	std::vector<size_t> refs  = { 1, 10, 100, 1000 };
+	size_t ref_size = 1 << 10;
+	bool quick = false;
+	bool list  = false;
+	bool keep  = false;
+	std::string json;
+	BenchConfig config;
+};
+
+static void usage(FILE *fp) {
+	fprintf( fp,
+		"usage: xseccore_bench [options]\n"
+		"  --filter TEXT    only run cases whose name contains TEXT\n"
+		"  --sizes LIST     document sizes, default 1K,16K,256K,4M (up to 1G)\n"
+		"  --refs LIST      reference counts of enveloping and detached signatures, default 1,10,100,1000\n"
+		"  --ref-size SIZE  size of each referenced document, default 1K\n"
+		"  --min-time SEC   minimal time spent on each case, default 0.5\n"
+		"  --quick          only rsa-sha256, exc-c14n and aes256-gcm on the two smallest sizes\n"
+		"  --json FILE      write the results to FILE as well\n"
+		"  --list           print the case names without running them\n"
+		"  --keep           keep the directory with the generated keys and documents\n" );
+}
+
+static int parse_args(int argc, char **argv, Options &opt) {
+	for( int i = 1; i < argc; i++ ) {
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if( arg == "--filter" && has_value )
+			opt.filter = argv[++i];
+		else if( arg == "--sizes" && has_value ) {
+			if( !parse_size_list( argv[++i], opt.sizes ))
+				return -1;
+		}
+		else if( arg == "--refs" && has_value ) {
+			if( !parse_size_list( argv[++i], opt.refs ))
+				return -1;
+		}
+		else if( arg == "--ref-size" && has_value ) {
+			if(( opt.ref_size = parse_size( argv[++i] )) == 0 )
+				return -1;
+		}
+		else if( arg == "--min-time" && has_value )
+			opt.config.min_time = atof( argv[++i] );
+		else if( arg == "--json" && has_value )
+			opt.json = argv[++i];
+		else if( arg == "--quick" )
+			opt.quick = true;
+		else if( arg == "--list" )
+			opt.list = true;
+		else if( arg == "--keep" )
+			opt.keep = true;
+		else
+			return -1;
+	}
+
+	if( opt.quick && opt.sizes.size() > 2 )
+		opt.sizes.resize( 2 );
+	return 0;
+}
+
+static void remove_dir(const std::string &dir) {
+	DIR *d = opendir( dir.c_str() );
+	if( d == nullptr )
+		return;
+	while( auto ent = readdir( d )) {
+		if( strcmp( ent->d_name, "." ) != 0 && strcmp( ent->d_name, ".." ) != 0 )
+			unlink( (dir + "/" + ent->d_name).c_str() );
+	}
+	closedir( d );
+	rmdir( dir.c_str() );
+}
+
+
+class Bench {
+public:
+	Bench(const Options &opt) : opt(opt) {}
+
+	bool want(const std::string &name) const {
+		return opt.filter.empty() || name.find( opt.filter ) != std::string::npos;
+	}
+
+	void run(const std::string &name, uint64_t bytes, const BenchOp &op, Core &core) {
+		if( opt.list ) {
+			printf( "%s\n", name.c_str() );
+			return;
+		}
+		auto r = run_bench( name, bytes, opt.config, op );
+		print_result( stdout, r );
+		if( r.error != 0 )
+			fprintf( stdout, "    %s\n", core.error_message().c_str() );
+		results.push_back( r );
+	}
+
+	int failures() const {
+		int n = 0;
+		for( auto &r : results )
+			n += r.error != 0;
+		return n;
+	}
+
+	const Options &opt;
+	std::vector<BenchResult> results;
+};
+
+/* signs with the key matching algo */
+static void set_sign_key(sign_options_t &so, int algo, const KeySet &keys) {
+	if( is_hmac( algo )) {
+		so.secret_key = keys.hmac;
+	}
+	else if( algo >= SA_ECDSA_SHA1 && algo <= SA_ECDSA_SHA512 ) {
+		// no public_key, xmlsec 1.2 cannot write an ECDSAKeyValue, the verifier gets ec_pub directly
+		so.private_key = keys.ec_key;
+	}
+	else {
+		so.private_key = keys.rsa_key;
+		so.public_key  = keys.rsa_pub;
+	}
+}
+
+static void set_verify_key(verify_options_t &vo, int algo, const KeySet &keys) {
+	if( is_hmac( algo ))
+		vo.secret_key = keys.hmac;
+	else if( algo >= SA_ECDSA_SHA1 && algo <= SA_ECDSA_SHA512 )
+		vo.public_key = keys.ec_pub;
+	else
+		vo.public_key = keys.rsa_pub;
+}
+
+/* one sign and one verify case */
+static void bench_signature(Bench &bench, Core &core, const std::string &suffix, const std::string &document,
+                            uint64_t bytes, sign_options_t so, int algo, const KeySet &keys) {
+	std::string name = "sign/" + suffix;
+	if( bench.want( name )) {
+		bench.run( name, bytes, [&]( Metrics *m ) {
+			std::string out;
+			so.metrics = m;
+			return core.sign( document, out, so );
+		}, core );
+	}
+
+	name = "verify/" + suffix;
+	if( !bench.want( name ))
+		return;
+
+	std::string signed_doc;
+	if( !bench.opt.list && core.sign( document, signed_doc, so ) != 0 ) {
+		fprintf( stdout, "%-44s FAILED to sign the input: %s\n", name.c_str(), core.error_message().c_str() );
+		return;
+	}
+
+	verify_options_t vo;
+	vo.doc_in_memory = true;
+	set_verify_key( vo, algo, keys );
+	bench.run( name, signed_doc.size(), [&]( Metrics *m ) {
+		bool valid = false;
+		vo.metrics = m;
+		int ret = core.verify( signed_doc, valid, vo );
+		return ret != 0 ? ret : (valid ? 0 : -1);
+	}, core );
+}
+
+int main(int argc, char **argv) {
+	Options opt;
+	if( parse_args( argc, argv, opt ) != 0 ) {
+		usage( stderr );
+		return 2;
+	}
+
+	// before Core touches libxml2
+	metrics_track_heap();
+
+	char tmpl[] = "/tmp/xseccore_bench.XXXXXX";
+	std::string dir = opt.list ? std::string() : (mkdtemp( tmpl ) ? tmpl : "");
+	KeySet keys;
+	if( !opt.list && (dir.empty() || make_keys( dir, keys ) != 0 )) {
+		fprintf( stderr, "failed to create keys in %s\n", dir.c_str() );
+		return 1;
+	}
+
+	Core core;
+	Bench bench( opt );
+	if( !opt.list )
+		print_header( stdout );
+
+	// documents for enveloped signatures and encryption, one per size
+	std::vector<std::string> docs;
+	std::vector<std::string> doc_paths;
+	for( size_t size : opt.sizes ) {
+		docs.push_back( opt.list ? std::string() : make_document( size, size ));
+		doc_paths.push_back( dir + "/doc-" + format_size( size ) + ".xml" );
+		if( !opt.list && write_file( doc_paths.back(), docs.back() ) != 0 ) {
+			fprintf( stderr, "failed to write %s\n", doc_paths.back().c_str() );
+			return 1;
+		}
+	}
+
+	// referenced documents of enveloping and detached signatures
+	size_t max_refs = 0;
+	for( size_t n : opt.refs )
+		max_refs = std::max( max_refs, n );
+	std::vector<std::string> ref_paths;
+	for( size_t i = 0; i < max_refs && !opt.list; i++ ) {
+		ref_paths.push_back( dir + "/ref" + std::to_string(i) + ".xml" );
+		if( write_file( ref_paths.back(), make_document( opt.ref_size, 1000 + i )) != 0 ) {
+			fprintf( stderr, "failed to write %s\n", ref_paths.back().c_str() );
+			return 1;
+		}
+	}
+
+	for( auto format = sign_format_names; format->name != nullptr; format++ ) {
+		for( auto sa = sign_algo_names; sa->name != nullptr; sa++ ) {
+			if( opt.quick && sa->value != SA_RSA_SHA256 )
+				continue;
+			for( auto c14n = c14n_names; c14n->name != nullptr; c14n++ ) {
+				if( opt.quick && c14n->value != C14N_EXCLUSIVE )
+					continue;
+
+				std::string suffix = std::string( format->name ) + "/" + sa->name + "/" + c14n->name;
+				sign_options_t so;
+				so.format = format->value;
+				so.sign_algorithm = sa->value;
+				so.c14n_algorithm = c14n->value;
+				so.hash_algorithm = HA_SHA256;
+				set_sign_key( so, sa->value, keys );
+
+				if( format->value == SF_ENVELOPED ) {
+					Reference ref;
+					ref.hash = HA_SHA256;
+					ref.transform = c14n->value;
+					so.references.push_back( &ref );
+					so.doc_in_memory = true;
+
+					for( size_t i = 0; i < opt.sizes.size(); i++ ) {
+						bench_signature( bench, core, suffix + "/" + format_size( opt.sizes[i] ),
+						                 docs[i], docs[i].size(), so, sa->value, keys );
+					}
+					continue;
+				}
+
+				for( size_t n : opt.refs ) {
+					if( opt.quick && n > 10 )
+						continue;
+					std::vector<Reference> refs( n );
+					so.references.clear();
+					for( size_t i = 0; i < n; i++ ) {
+						refs[i].hash = HA_SHA256;
+						refs[i].transform = c14n->value;
+						refs[i].uri = opt.list ? std::string() : ref_paths[i];
+						so.references.push_back( &refs[i] );
+					}
+					so.doc_in_memory = true;
+					bench_signature( bench, core, suffix + "/" + std::to_string(n) + "refs",
+					                 std::string(), n * opt.ref_size, so, sa->value, keys );
+				}
+			}
+		}
+	}
+
+	std::string enc_path = dir + "/enc.xml", dec_path = dir + "/dec.xml";
+	for( auto ea = enc_algo_names; ea->name != nullptr; ea++ ) {
+		if( opt.quick && ea->value != EA_AES256_GCM )
+			continue;
+
+		for( size_t i = 0; i < opt.sizes.size(); i++ ) {
+			std::string suffix = std::string( ea->name ) + "/" + format_size( opt.sizes[i] );
+			encrypt_options_t eo;
+			eo.encryption_algorithm = ea->value;
+			eo.key_transport_algorithm = KT_RSA_OAEP;
+			eo.public_key = keys.rsa_cert;
+			eo.public_key_is_cert = true;
+
+			std::string name = "encrypt/" + suffix;
+			if( bench.want( name )) {
+				bench.run( name, docs[i].size(), [&]( Metrics *m ) {
+					std::string out = enc_path;
+					eo.metrics = m;
+					return core.encrypt( doc_paths[i], out, eo );
+				}, core );
+			}
+
+			name = "decrypt/" + suffix;
+			if( !bench.want( name ))
+				continue;
+
+			std::string out = enc_path;
+			if( !opt.list && core.encrypt( doc_paths[i], out, eo ) != 0 ) {
+				fprintf( stdout, "%-44s FAILED to encrypt the input: %s\n", name.c_str(), core.error_message().c_str() );
+				continue;
+			}
+			struct stat st;
+			uint64_t enc_size = !opt.list && stat( enc_path.c_str(), &st ) == 0 ? st.st_size : 0;
+			decrypt_options_t dopt;
+			dopt.private_key = keys.rsa_key;
+			bench.run( name, enc_size, [&]( Metrics *m ) {
+				std::string out = dec_path;
+				dopt.metrics = m;
+				return core.decrypt( enc_path, out, dopt );
+			}, core );
+		}
+	}
+
+	if( !opt.json.empty() && write_json( opt.json, bench.results ) != 0 )
+		fprintf( stderr, "failed to write %s\n", opt.json.c_str() );
+
+	if( !opt.list ) {
+		if( opt.keep )
+			fprintf( stderr, "keys and documents kept in %s\n", dir.c_str() );
+		else
+			remove_dir( dir );
+	}
+
+	return bench.failures() > 0 ? 1 : 0;
+}
@@ -0,0 +1,506 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+/*
+ * xsecd - keeps xseccore warm for short lived clients
+ *
+ *   xsecd [--socket PATH] [--workers N] [--keys N] [--max-frame BYTES] [--queue N] [--ca-dir DIR]
+ *         [--verify-cache N [--verify-ttl SECONDS] [--verify-shadow]] [--chain-cache N [--chain-ttl SECONDS]]
+ *         [--cert-cache N] [--crl PATH]... [--crl-index DIR] [--id-attr NAME]... [--limit NAME=N]...
+ *
+ * Serves sign, verify, encrypt and decrypt over a unix socket (protocol.hpp), each worker
+ * thread has a Core of its own, all of them share one cache of unlocked keys (and those of verify results and validated and parsed certificates, and the CRLs).
+ * "xsec --connect PATH ..." is a client. Only the user running xsecd may connect.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include "xseccore.hpp"
+#include "xseckeycache.hpp"
+#include "xsecverifycache.hpp"
+#include "xsecchaincache.hpp"
+#include "xseccertcache.hpp"
+#include "xseccrlstore.hpp"
+#include "commands.hpp"
+#include "protocol.hpp"
+
+using namespace XSec;
+using namespace XSecTools;
+
+
+static void usage(FILE *fp) {
+	fprintf( fp,
+		"usage: xsecd [options]\n"
+		"  --socket PATH           default %s\n"
+		"  --workers N             threads running requests, default: one per cpu\n"
+		"  --keys N                unlocked keys kept in memory, default 64, 0 loads them for every request\n"
+		"  --max-frame BYTES       largest request taken, documents passed as fd don't count, default %u\n"
+		"  --queue N               requests of one connection in flight before it's read no further, default 64\n"
+		"  --ca-dir DIR            trust the certificates in DIR too, hashed by \"openssl rehash\"\n"
+		"  --verify-cache N        remember the results of N verified documents, default 0\n"
+		"  --verify-ttl SECONDS    for as long as this, default 300\n"
+		"  --verify-shadow         verify anyway, only count what the cache would have answered\n"
+		"  --chain-cache N         remember N embedded certificates whose chain was validated, default 0\n"
+		"  --chain-ttl SECONDS     for at most this long, default 600\n"
+		"  --cert-cache N          keep N embedded certificates parsed, default 0\n"
+		"  --crl PATH              reject certificates revoked by the CRL in PATH, a file or directory, repeatable\n"
+		"  --crl-index DIR         keep the indexes of the CRLs in DIR, so big ones are read only once\n"
+		"  --id-attr NAME          treat attributes NAME, or {NAMESPACE}NAME, as IDs too, repeatable\n"
+		"  --limit NAME=N          fail requests going beyond N, repeatable, NAME is one of\n"
+		"                          %s\n",
+		default_socket_path().c_str(), default_max_frame, limit_names().c_str() );
+}
+
+
+struct Connection {
+	Connection(int fd, uint32_t max_frame) : channel( fd, max_frame ) {}
+
+	Channel channel;
+	std::mutex send_lock;
+
+	std::mutex lock;
+	std::condition_variable done;
+	unsigned in_flight = 0;
+};
+
+struct Job {
+	std::shared_ptr<Connection> conn;
+	Request req;
+};
+
+static struct {
+	std::mutex lock;
+	std::condition_variable ready;
+	std::deque<Job> jobs;
+	bool stopping = false;
+} queue;
+
+static struct {
+	std::mutex lock;
+	std::condition_variable gone;
+	std::set<std::shared_ptr<Connection>> open;
+} connections;
+
+static unsigned max_in_flight = 64;
+
+
+static void close_fds(Request &req) {
+	if( req.input_fd >= 0 )
+		close( req.input_fd );
+	if( req.output_fd >= 0 )
+		close( req.output_fd );
+	req.input_fd = req.output_fd = -1;
+}
+
+/* path under which libxml2 and xmlsec open a descriptor of ours again */
+static std::string fd_path(int fd) {
+	return "/proc/self/fd/" + std::to_string( fd );
+}
+
+/* an anonymous file holding data, -1 if it can't be made */
+static int memory_file(const std::string &data) {
+	int fd = memfd_create( "xsecd", MFD_CLOEXEC );
+	if( fd < 0 )
+		return -1;
+	size_t done = 0;
+	while( done < data.size() ) {
+		ssize_t n = write( fd, data.data() + done, data.size() - done );
+		if( n < 0 && errno == EINTR )
+			continue;
+		if( n <= 0 ) {
+			close( fd );
+			return -1;
+		}
+		done += n;
+	}
+	return fd;
+}
+
+static bool read_file(int fd, std::string &out) {
+	struct stat st;
+	if( fstat( fd, &st ) != 0 )
+		return false;
+	out.resize( st.st_size );
+	size_t done = 0;
+	while( done < out.size() ) {
+		ssize_t n = pread( fd, &out[done], out.size() - done, done );
+		if( n < 0 && errno == EINTR )
+			continue;
+		if( n <= 0 )
+			return false;
+		done += n;
+	}
+	return true;
+}
+
+static bool write_fd(int fd, const std::string &data) {
+	size_t done = 0;
+	while( done < data.size() ) {
+		ssize_t n = write( fd, data.data() + done, data.size() - done );
+		if( n < 0 && errno == EINTR )
+			continue;
+		if( n <= 0 )
+			return false;
+		done += n;
+	}
+	return true;
+}
+
+/* runs one request, input and output are always the ones of the frame, never paths among the arguments */
+static void execute(Core &core, Request &req, Response &res) {
+	Command cmd;
+	res.id = req.id;
+	res.status = EXIT_ERROR;
+	if( !parse_command( req.args, cmd, res.message ))
+		return;
+
+	bool has_output = cmd.op != MO_VERIFY;
+	int in_file = -1, out_file = -1;
+
+	// sign and verify take inline documents as they are, encrypt and decrypt only read files
+	bool in_memory = req.input_fd < 0 && (cmd.op == MO_SIGN || cmd.op == MO_VERIFY);
+	if( in_memory ) {
+		cmd.input.swap( req.document );
+		cmd.sign.doc_in_memory = cmd.verify.doc_in_memory = true;
+	}
+	else if( req.input_fd >= 0 ) {
+		cmd.input = fd_path( req.input_fd );
+	}
+	else if( (in_file = memory_file( req.document )) >= 0 ) {
+		cmd.input = fd_path( in_file );
+	}
+	else {
+		res.message = std::string( "cannot buffer the document: " ) + strerror( errno );
+		return;
+	}
+	req.document = std::string();
+
+	if( has_output && !in_memory ) {
+		if( req.output_fd >= 0 )
+			cmd.output = fd_path( req.output_fd );
+		else if( (out_file = memfd_create( "xsecd", MFD_CLOEXEC )) >= 0 )
+			cmd.output = fd_path( out_file );
+		else
+			res.message = std::string( "cannot buffer the result: " ) + strerror( errno );
+	}
+
+	if( res.message.empty() ) {
+		res.status = run_command( core, cmd );
+		if( res.status == EXIT_ERROR )
+			res.message = core.error_message();
+		else if( in_memory && has_output && req.output_fd >= 0 && !write_fd( req.output_fd, cmd.output ))
+			res.status = EXIT_ERROR, res.message = std::string( "cannot write the result: " ) + strerror( errno );
+		else if( in_memory && has_output && req.output_fd < 0 )
+			res.result.swap( cmd.output );
+		else if( out_file >= 0 && !read_file( out_file, res.result ))
+			res.status = EXIT_ERROR, res.message = "cannot read back the result";
+		if( cmd.metrics )
+			res.metrics = metrics_json( metrics_op_name( cmd.op ), cmd.measured );
+	}
+
+	if( in_file >= 0 )
+		close( in_file );
+	if( out_file >= 0 )
+		close( out_file );
+}
+
+static void worker(KeyCache *cache, VerifyCache *results, ChainCache *chains, CertCache *certs,
+                   CrlStore *revocations, const std::string &ca_dir, const std::vector<std::string> &id_attrs,
+                   const Limits &limits) {
+	Core core;
+	core.set_limits( limits );
+	if( !ca_dir.empty() )
+		core.set_ca_dir( ca_dir );
+	if( !id_attrs.empty() ) {
+		auto names = core.get_id_attributes();
+		names.insert( names.end(), id_attrs.begin(), id_attrs.end() );
+		core.set_id_attributes( names );
+	}
+	core.set_verify_cache( results );
+	core.set_chain_cache( chains );
+	core.set_cert_cache( certs );
+	core.set_crl_store( revocations );
+	if( !core.error_message().empty() ) {
+		fprintf( stderr, "xsecd: %s\n", core.error_message().c_str() );
+		exit( EXIT_ERROR );
+	}
+	core.set_key_cache( cache );
+
+	for( ;; ) {
+		Job job;
+		{
+			std::unique_lock<std::mutex> guard( queue.lock );
+			queue.ready.wait( guard, [] { return queue.stopping || !queue.jobs.empty(); } );
+			if( queue.jobs.empty() )
+				return;
+			job = std::move( queue.jobs.front() );
+			queue.jobs.pop_front();
+		}
+
+		Response res;
+		execute( core, job.req, res );
+		close_fds( job.req );
+		{
+			// a failed send shows up as the end of the connection on the reading side
+			std::lock_guard<std::mutex> guard( job.conn->send_lock );
+			job.conn->channel.send( res );
+		}
+
+		std::lock_guard<std::mutex> guard( job.conn->lock );
+		job.conn->in_flight--;
+		job.conn->done.notify_all();
+	}
+}
+
+/* reads the requests of one client until it hangs up, the workers answer them */
+static void reader(std::shared_ptr<Connection> conn) {
+	for( ;; ) {
+		Job job;
+		if( conn->channel.receive( job.req ) != 1 )
+			break;
+
+		{
+			std::unique_lock<std::mutex> guard( conn->lock );
+			conn->done.wait( guard, [&] { return conn->in_flight < max_in_flight; } );
+			conn->in_flight++;
+		}
+		job.conn = conn;
+		std::lock_guard<std::mutex> guard( queue.lock );
+		queue.jobs.push_back( std::move( job ));
+		queue.ready.notify_one();
+	}
+
+	{
+		std::unique_lock<std::mutex> guard( conn->lock );
+		conn->done.wait( guard, [&] { return conn->in_flight == 0; } );
+	}
+	std::lock_guard<std::mutex> guard( connections.lock );
+	connections.open.erase( conn );
+	connections.gone.notify_all();
+}
+
+static int listen_socket(const std::string &path) {
+	struct sockaddr_un addr;
+	memset( &addr, 0, sizeof(addr) );
+	addr.sun_family = AF_UNIX;
+	if( path.size() >= sizeof(addr.sun_path) ) {
+		fprintf( stderr, "xsecd: socket path too long\n" );
+		return -1;
+	}
+	memcpy( addr.sun_path, path.c_str(), path.size() + 1 );
+
+	// a socket nobody answers on is left over from a daemon that didn't shut down
+	int probe = connect_socket( path );
+	if( probe >= 0 ) {
+		close( probe );
+		fprintf( stderr, "xsecd: another xsecd is listening on %s\n", path.c_str() );
+		return -1;
+	}
+	if( errno == ECONNREFUSED )
+		unlink( path.c_str() );
+
+	int fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+	if( fd < 0 ) {
+		fprintf( stderr, "xsecd: socket: %s\n", strerror( errno ));
+		return -1;
+	}
+
+	// the keys in the cache are unlocked, nobody but us may talk to the daemon
+	mode_t mask = umask( 0177 );
+	int ret = bind( fd, (struct sockaddr*)&addr, sizeof(addr) );
+	umask( mask );
+	if( ret != 0 || listen( fd, SOMAXCONN ) != 0 ) {
+		fprintf( stderr, "xsecd: %s: %s\n", path.c_str(), strerror( errno ));
+		close( fd );
+		return -1;
+	}
+	return fd;
+}
+
+static bool same_user(int fd) {
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+	return getsockopt( fd, SOL_SOCKET, SO_PEERCRED, &cred, &len ) == 0 && cred.uid == getuid();
+}
+
+static bool parse_count(const char *s, unsigned long &out) {
+	char *end;
+	errno = 0;
+	out = strtoul( s, &end, 10 );
+	return errno == 0 && end != s && *end == '\0' && s[0] != '-';
+}
+
+int main(int argc, char **argv) {
+	std::string path = default_socket_path(), ca_dir, crl_index;
+	std::vector<std::string> crls, id_attrs;
+	Limits limits;
+	unsigned long workers = std::thread::hardware_concurrency(), keys = 64, max_frame = default_max_frame;
+	unsigned long verify_entries = 0, verify_ttl = 300, chain_entries = 0, chain_ttl = 600;
+	unsigned long cert_entries = 0;
+	bool verify_shadow = false;
+
+	for( int i = 1; i < argc; i++ ) {
+		std::string arg = argv[i];
+		unsigned long *count = nullptr;
+		if( arg == "-h" || arg == "--help" ) {
+			usage( stdout );
+			return EXIT_OK;
+		}
+		else if( arg == "--socket" && i + 1 < argc ) path = argv[++i];
+		else if( arg == "--ca-dir" && i + 1 < argc ) ca_dir = argv[++i];
+		else if( arg == "--crl" && i + 1 < argc )    crls.push_back( argv[++i] );
+		else if( arg == "--crl-index" && i + 1 < argc ) crl_index = argv[++i];
+		else if( arg == "--id-attr" && i + 1 < argc ) id_attrs.push_back( argv[++i] );
+		else if( arg == "--limit" ) {
+			if( i + 1 >= argc || !parse_limit( argv[++i], limits )) {
+				fprintf( stderr, "xsecd: --limit takes NAME=N, NAME one of %s\n", limit_names().c_str() );
+				return EXIT_ERROR;
+			}
+			continue;
+		}
+		else if( arg == "--workers" )                count = &workers;
+		else if( arg == "--keys" )                   count = &keys;
+		else if( arg == "--max-frame" )              count = &max_frame;
+		else if( arg == "--verify-cache" )           count = &verify_entries;
+		else if( arg == "--verify-ttl" )             count = &verify_ttl;
+		else if( arg == "--verify-shadow" )          verify_shadow = true;
+		else if( arg == "--chain-cache" )            count = &chain_entries;
+		else if( arg == "--chain-ttl" )              count = &chain_ttl;
+		else if( arg == "--cert-cache" )             count = &cert_entries;
+		else if( arg == "--queue" ) {
+			unsigned long n;
+			if( i + 1 >= argc || !parse_count( argv[++i], n ) || n == 0 ) {
+				fprintf( stderr, "xsecd: --queue takes a number above 0\n" );
+				return EXIT_ERROR;
+			}
+			max_in_flight = n;
+			continue;
+		}
+		else {
+			fprintf( stderr, "xsecd: unknown option \"%s\"\n", argv[i] );
+			usage( stderr );
+			return EXIT_ERROR;
+		}
+		if( count != nullptr && (i + 1 >= argc || !parse_count( argv[++i], *count ))) {
+			fprintf( stderr, "xsecd: %s takes a number\n", arg.c_str() );
+			return EXIT_ERROR;
+		}
+	}
+	if( workers == 0 )
+		workers = 1;
+	if( max_frame > UINT32_MAX )
+		max_frame = UINT32_MAX;
+
+	// big lists take a while to index, better before anyone connects
+	std::unique_ptr<CrlStore> revocations( crls.empty() ? nullptr : new CrlStore( crl_index ));
+	for( auto &crl : crls ) {
+		if( revocations->add( crl ) != 0 ) {
+			fprintf( stderr, "xsecd: %s", revocations->error().c_str() );
+			return EXIT_ERROR;
+		}
+	}
+
+	// the signals are taken by the main loop, no thread started below may get them
+	sigset_t signals;
+	sigemptyset( &signals );
+	sigaddset( &signals, SIGINT );
+	sigaddset( &signals, SIGTERM );
+	sigaddset( &signals, SIGHUP );
+	pthread_sigmask( SIG_BLOCK, &signals, nullptr );
+	signal( SIGPIPE, SIG_IGN );
+	int sig_fd = signalfd( -1, &signals, SFD_CLOEXEC );
+
+	int listen_fd = listen_socket( path );
+	if( listen_fd < 0 || sig_fd < 0 )
+		return EXIT_ERROR;
+
+	std::unique_ptr<KeyCache> cache( keys > 0 ? new KeyCache( keys ) : nullptr );
+	std::unique_ptr<VerifyCache> results( verify_entries > 0 ?
+			new VerifyCache( verify_entries, verify_ttl, verify_shadow ? VCM_SHADOW : VCM_USE ) : nullptr );
+	std::unique_ptr<ChainCache> chains( chain_entries > 0 ? new ChainCache( chain_entries, chain_ttl ) : nullptr );
+	std::unique_ptr<CertCache> certs( cert_entries > 0 ? new CertCache( cert_entries ) : nullptr );
+	std::vector<std::thread> threads;
+	for( unsigned long i = 0; i < workers; i++ )
+		threads.emplace_back( worker, cache.get(), results.get(), chains.get(), certs.get(), revocations.get(), ca_dir,
+		                      id_attrs, limits );
+
+	fprintf( stderr, "xsecd: listening on %s with %lu workers\n", path.c_str(), workers );
+
+	struct pollfd fds[2] = { { listen_fd, POLLIN, 0 }, { sig_fd, POLLIN, 0 } };
+	while( !(fds[1].revents & POLLIN) ) {
+		if( poll( fds, 2, -1 ) < 0 && errno != EINTR )
+			break;
+		if( !(fds[0].revents & POLLIN) )
+			continue;
+
+		int fd = accept4( listen_fd, nullptr, nullptr, SOCK_CLOEXEC );
+		if( fd < 0 )
+			continue;
+		if( !same_user( fd )) {
+			close( fd );
+			continue;
+		}
+
+		auto conn = std::make_shared<Connection>( fd, max_frame );
+		{
+			std::lock_guard<std::mutex> guard( connections.lock );
+			connections.open.insert( conn );
+		}
+		std::thread( reader, conn ).detach();
+	}
+
+	// stop taking requests, answer the ones already read and let the workers go
+	close( listen_fd );
+	unlink( path.c_str() );
+	{
+		std::unique_lock<std::mutex> guard( connections.lock );
+		for( auto &conn : connections.open )
+			shutdown( conn->channel.fd(), SHUT_RD );
+		connections.gone.wait( guard, [] { return connections.open.empty(); } );
+	}
+	{
+		std::lock_guard<std::mutex> guard( queue.lock );
+		queue.stopping = true;
+		queue.ready.notify_all();
+	}
+	for( auto &t : threads )
+		t.join();
+	return EXIT_OK;
+}
@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2015-2016 brainpower <fbaumgae at haw-landshut dot de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+*/
+
+/*
+ * xsecgen - deterministic test keys and documents
+ *
+ *   xsecgen keys DIR                   RSA, EC, PKCS#12, HMAC and key-wrap keys
+ *   xsecgen doc FILE                   one document, "-" writes to stdout
+ *   xsecgen corpus DIR                 --count documents for each of --sizes, with a manifest.json
+ *
+ * Everything depends on --seed only, so corpora can be rebuilt on any machine instead of shipped.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "corpus.hpp"
+
+using namespace XSecTools;
+
+
+struct Options {
+	std::string command;
+	std::string target;
+	DocShape shape;
+	std::vector<size_t> sizes;
+	size_t count = 1;
+};
+
+static void usage(FILE *fp) {
+	fprintf( fp,
+		"usage: xsecgen keys DIR [--seed N]\n"
+		"       xsecgen doc FILE [shape options]\n"
+		"       xsecgen corpus DIR [--sizes LIST] [--count N] [shape options]\n"
+		"shape options:\n"
+		"  --seed N           default 1\n"
+		"  --size SIZE        approximate document size, default 16K\n"
+		"  --depth N          element levels below the root, default 3\n"
+		"  --fanout N         children per element, default 8\n"
+		"  --namespaces N     prefixed namespaces declared on the root, default 0\n"
+		"  --ns-density F     share of elements in those namespaces, default 0\n"
+		"  --attr-ratio F     share of payload words in attributes instead of text, default 0.25\n"
+		"  --matches N        elements selected by %s, default 0\n"
+		"  --signatures N     ds:Signature elements, default 0\n"
+		"  --encrypted N      xenc:EncryptedData elements, default 0\n", match_xpath );
+}
+
+static bool parse_number(const char *arg, size_t &out) {
+	char *end = nullptr;
+	out = strtoull( arg, &end, 10 );
+	return end != arg && *end == '\0';
+}
+
+static bool parse_fraction(const char *arg, double &out) {
+	char *end = nullptr;
+	out = strtod( arg, &end );
+	return end != arg && *end == '\0' && out >= 0 && out <= 1;
+}
+
+static int parse_args(int argc, char **argv, Options &opt) {
+	if( argc < 3 )
+		return -1;
+	opt.command = argv[1];
+	opt.target = argv[2];
+	if( opt.command != "keys" && opt.command != "doc" && opt.command != "corpus" )
+		return -1;
+
+	for( int i = 3; i < argc; i++ ) {
+		std::string arg = argv[i];
+		if( i + 1 >= argc )
+			return -1;
+		const char *value = argv[++i];
+		size_t n = 0;
+		bool ok = true;
+
+		if( arg == "--seed" ) {
+			ok = parse_number( value, n );
+			opt.shape.seed = n;
+		}
+		else if( arg == "--size" )
+			ok = (opt.shape.size = parse_size( value )) != 0;
+		else if( arg == "--sizes" )
+			ok = parse_size_list( value, opt.sizes );
+		else if( arg == "--count" )
+			ok = parse_number( value, opt.count ) && opt.count > 0;
+		else if( arg == "--depth" ) {
+			ok = parse_number( value, n ) && n > 0;
+			opt.shape.depth = n;
+		}
+		else if( arg == "--fanout" ) {
+			ok = parse_number( value, n ) && n > 0;
+			opt.shape.fanout = n;
+		}
+		else if( arg == "--namespaces" ) {
+			ok = parse_number( value, n );
+			opt.shape.namespaces = n;
+		}
+		else if( arg == "--ns-density" )
+			ok = parse_fraction( value, opt.shape.ns_density );
+		else if( arg == "--attr-ratio" )
+			ok = parse_fraction( value, opt.shape.attr_ratio );
+		else if( arg == "--matches" )
+			ok = parse_number( value, opt.shape.matches );
+		else if( arg == "--signatures" )
+			ok = parse_number( value, opt.shape.signatures );
+		else if( arg == "--encrypted" )
+			ok = parse_number( value, opt.shape.encrypted );
+		else
+			ok = false;
+
+		if( !ok )
+			return -1;
+	}
+
+	if( opt.sizes.empty() )
+		opt.sizes.push_back( opt.shape.size );
+	return 0;
+}
+
+static std::string manifest_entry(const std::string &file, const DocShape &shape, const DocStats &stats) {
+	char buf[1024];
+	snprintf( buf, sizeof(buf),
+		"  {\"file\": \"%s\", \"seed\": %llu, \"size\": %zu, \"bytes\": %zu, \"depth\": %u, \"fanout\": %u, "
+		"\"namespaces\": %u, \"ns_density\": %.3f, \"attr_ratio\": %.3f, \"elements\": %zu, \"payload\": %zu, "
+		"\"matches\": %zu, \"signatures\": %zu, \"encrypted\": %zu}",
+		file.c_str(), (unsigned long long) shape.seed, shape.size, stats.bytes, stats.max_depth, shape.fanout,
+		shape.namespaces, shape.ns_density, shape.attr_ratio, stats.elements, stats.payload,
+		shape.matches, shape.signatures, shape.encrypted );
+	return buf;
+}
+
+static int write_corpus(const Options &opt) {
+	if( mkdir( opt.target.c_str(), 0755 ) != 0 && errno != EEXIST ) {
+		fprintf( stderr, "cannot create %s: %s\n", opt.target.c_str(), strerror( errno ));
+		return 1;
+	}
+
+	std::string manifest = "{\n\"xpath\": \"" + std::string( match_xpath ) + "\",\n\"documents\": [\n";
+	bool first = true;
+	for( size_t size : opt.sizes ) {
+		for( size_t i = 0; i < opt.count; i++ ) {
+			DocShape shape = opt.shape;
+			shape.size = size;
+			shape.seed = opt.shape.seed + i;
+
+			DocStats stats;
+			std::string file = "doc-" + format_size( size ) + "-" + std::to_string(i) + ".xml";
+			if( write_file( opt.target + "/" + file, make_document( shape, &stats )) != 0 ) {
+				fprintf( stderr, "cannot write %s/%s\n", opt.target.c_str(), file.c_str() );
+				return 1;
+			}
+			manifest += (first ? "" : ",\n") + manifest_entry( file, shape, stats );
+			first = false;
+		}
+	}
+	manifest += "\n]\n}\n";
+
+	if( write_file( opt.target + "/manifest.json", manifest ) != 0 ) {
+		fprintf( stderr, "cannot write %s/manifest.json\n", opt.target.c_str() );
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	Options opt;
+	if( parse_args( argc, argv, opt ) != 0 ) {
+		usage( stderr );
+		return 2;
+	}
+
+	if( opt.command == "keys" ) {
+		KeySet keys;
+		if( mkdir( opt.target.c_str(), 0755 ) != 0 && errno != EEXIST ) {
+			fprintf( stderr, "cannot create %s: %s\n", opt.target.c_str(), strerror( errno ));
+			return 1;
+		}
+		if( make_keys( opt.target, keys, opt.shape.seed ) != 0 ) {
+			fprintf( stderr, "failed to create keys in %s\n", opt.target.c_str() );
+			return 1;
+		}
+		return 0;
+	}
+
+	if( opt.command == "corpus" )
+		return write_corpus( opt );
+
+	DocStats stats;
+	std::string doc = make_document( opt.shape, &stats );
+	if( opt.target == "-" ) {
+		fwrite( doc.data(), 1, doc.size(), stdout );
+		return 0;
+	}
+	if( write_file( opt.target, doc ) != 0 ) {
+		fprintf( stderr, "cannot write %s\n", opt.target.c_str() );
+		return 1;
+	}
+	return 0;
+}